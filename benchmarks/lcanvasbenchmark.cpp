@@ -0,0 +1,328 @@
+#include "lcanvasview.h"
+#include "lcanvaswriter.h"
+#include "lcanvasgenerator.h"
+
+#include <QtTest>
+
+// Benchmarks of the editor engine over synthetic documents. Build with
+// -DSVGEDITOR_BUILD_BENCHMARKS=ON and run, for example:
+//
+//   SVGEditorBenchmarks -o results.csv,csv
+//   SVGEditorBenchmarks -o results.xml,xml paint:10000
+//
+// SVGEDITOR_BENCHMARK_MAX_ITEMS caps the document sizes for quick runs.
+
+namespace lwscode {
+
+static const int DocumentSizes[] = { 1000, 10000, 100000, 1000000 };
+static const QSize CanvasSize(2000, 2000);
+// items stay clear of this margin, so a press inside it always starts a marquee
+static const int EmptyMargin = 40;
+static const int ProbeCount = 64;
+static const int FileTaskTimeout = 10 * 60 * 1000;
+
+class LCanvasBenchmark : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+
+	void paint_data();
+	void paint();
+	void hitTest_data();
+	void hitTest();
+	void marquee_data();
+	void marquee();
+	void load_data();
+	void load();
+	void save_data();
+	void save();
+	void copyPaste_data();
+	void copyPaste();
+	void reorder_data();
+	void reorder();
+
+private:
+	void addDocumentSizes();
+	QString documentPath(int count);
+	bool loadDocument(LCanvasView &view, const QString &filePath);
+	bool runFileTask(LCanvasView &view, const char *slot, const QString &filePath);
+	QVector<QPoint> probePoints(int count);
+
+	static LCanvasItemList generateItems(int count);
+
+private:
+	QTemporaryDir m_dir;
+	QHash<int, QString> m_documents;
+	QHash<int, QVector<QPoint> > m_probes;
+};
+
+void LCanvasBenchmark::initTestCase()
+{
+	// views open their journal on construction, keep it out of the user's data
+	QStandardPaths::setTestModeEnabled(true);
+	QVERIFY(m_dir.isValid());
+}
+
+void LCanvasBenchmark::cleanupTestCase()
+{
+	m_documents.clear();
+	m_probes.clear();
+}
+
+void LCanvasBenchmark::paint_data()
+{
+	addDocumentSizes();
+}
+
+void LCanvasBenchmark::paint()
+{
+	QFETCH(int, count);
+
+	LCanvasView view;
+	QVERIFY(loadDocument(view, documentPath(count)));
+
+	QImage image(view.size(), QImage::Format_ARGB32_Premultiplied);
+	QBENCHMARK
+	{
+		view.render(&image);
+	}
+
+	LCanvasFrameStats frame = view.stats().lastFrame();
+	QCOMPARE(frame.itemsDrawn + frame.itemsCulled, count);
+}
+
+void LCanvasBenchmark::hitTest_data()
+{
+	addDocumentSizes();
+}
+
+void LCanvasBenchmark::hitTest()
+{
+	QFETCH(int, count);
+
+	LCanvasView view;
+	QVERIFY(loadDocument(view, documentPath(count)));
+
+	// a press runs the hit test, the release resets the view for the next probe
+	QVector<QPoint> points = probePoints(count);
+	QBENCHMARK
+	{
+		foreach (auto &point, points)
+		{
+			QTest::mousePress(&view, Qt::LeftButton, Qt::NoModifier, point);
+			QTest::mouseRelease(&view, Qt::LeftButton, Qt::NoModifier, point);
+		}
+	}
+}
+
+void LCanvasBenchmark::marquee_data()
+{
+	addDocumentSizes();
+}
+
+void LCanvasBenchmark::marquee()
+{
+	QFETCH(int, count);
+
+	LCanvasView view;
+	QVERIFY(loadDocument(view, documentPath(count)));
+
+	// sweep a quarter of the canvas and then all of it
+	QPoint origin(EmptyMargin / 2, EmptyMargin / 2);
+	QBENCHMARK
+	{
+		QTest::mousePress(&view, Qt::LeftButton, Qt::NoModifier, origin);
+		QTest::mouseMove(&view, QPoint(view.width() / 2, view.height() / 2));
+		QTest::mouseMove(&view, QPoint(view.width() - 1, view.height() - 1));
+		QTest::mouseRelease(&view, Qt::LeftButton, Qt::NoModifier, QPoint(view.width() - 1, view.height() - 1));
+	}
+}
+
+void LCanvasBenchmark::load_data()
+{
+	addDocumentSizes();
+}
+
+void LCanvasBenchmark::load()
+{
+	QFETCH(int, count);
+
+	QString filePath = documentPath(count);
+	LCanvasView view;
+	view.setJournalEnabled(false);
+	QBENCHMARK
+	{
+		QVERIFY(runFileTask(view, "readItemsFromFile", filePath));
+	}
+}
+
+void LCanvasBenchmark::save_data()
+{
+	addDocumentSizes();
+}
+
+void LCanvasBenchmark::save()
+{
+	QFETCH(int, count);
+
+	LCanvasView view;
+	QVERIFY(loadDocument(view, documentPath(count)));
+
+	// the first round writes everything, later rounds take the unchanged block path
+	QString filePath = m_dir.filePath(QString::fromUtf8("save-%1.svg").arg(count));
+	QBENCHMARK
+	{
+		QVERIFY(runFileTask(view, "writeItemsToFile", filePath));
+	}
+}
+
+void LCanvasBenchmark::copyPaste_data()
+{
+	addDocumentSizes();
+}
+
+void LCanvasBenchmark::copyPaste()
+{
+	QFETCH(int, count);
+
+	LCanvasView view;
+	QVERIFY(loadDocument(view, documentPath(count)));
+
+	// select about a hundredth of the canvas; deleting the pasted copies keeps
+	// the document the same size from round to round
+	QPoint origin(EmptyMargin / 2, EmptyMargin / 2);
+	QPoint corner(view.width() / 10, view.height() / 10);
+	QTest::mousePress(&view, Qt::LeftButton, Qt::NoModifier, origin);
+	QTest::mouseMove(&view, corner);
+	QTest::mouseRelease(&view, Qt::LeftButton, Qt::NoModifier, corner);
+
+	QBENCHMARK
+	{
+		QMetaObject::invokeMethod(&view, "copyItem", Qt::DirectConnection);
+		QMetaObject::invokeMethod(&view, "pasteItem", Qt::DirectConnection);
+		QMetaObject::invokeMethod(&view, "deleteItem", Qt::DirectConnection);
+	}
+}
+
+void LCanvasBenchmark::reorder_data()
+{
+	addDocumentSizes();
+}
+
+void LCanvasBenchmark::reorder()
+{
+	QFETCH(int, count);
+
+	LCanvasView view;
+	QVERIFY(loadDocument(view, documentPath(count)));
+
+	// a click selects a single item, which then travels the whole z-order
+	QPoint point = probePoints(count).first();
+	QTest::mousePress(&view, Qt::LeftButton, Qt::NoModifier, point);
+	QTest::mouseRelease(&view, Qt::LeftButton, Qt::NoModifier, point);
+
+	QBENCHMARK
+	{
+		QMetaObject::invokeMethod(&view, "moveBottomItem", Qt::DirectConnection);
+		QMetaObject::invokeMethod(&view, "moveUpItem", Qt::DirectConnection);
+		QMetaObject::invokeMethod(&view, "moveTopItem", Qt::DirectConnection);
+		QMetaObject::invokeMethod(&view, "moveDownItem", Qt::DirectConnection);
+	}
+}
+
+void LCanvasBenchmark::addDocumentSizes()
+{
+	int maxItems = qEnvironmentVariableIntValue("SVGEDITOR_BENCHMARK_MAX_ITEMS");
+
+	QTest::addColumn<int>("count");
+	for (auto count : DocumentSizes)
+	{
+		if (maxItems > 0 && count > maxItems)
+			break;
+
+		QTest::newRow(QByteArray::number(count).constData()) << count;
+	}
+}
+
+QString LCanvasBenchmark::documentPath(int count)
+{
+	if (m_documents.contains(count))
+		return m_documents.value(count);
+
+	QString filePath = m_dir.filePath(QString::fromUtf8("document-%1.svg").arg(count));
+	LCanvasItemList items = generateItems(count);
+	LCanvasWriter writer;
+	if (!writer.write(filePath, items, CanvasSize))
+		return QString();
+
+	// the centres of the bottom-most items, so the hit test walks most of the
+	// z-order before it finds them
+	QVector<QPoint> points;
+	for (int i = 0; i < qMin(count, ProbeCount); ++i)
+		points << items[i]->boundingRect().center();
+	m_probes.insert(count, points);
+
+	m_documents.insert(count, filePath);
+	return filePath;
+}
+
+bool LCanvasBenchmark::loadDocument(LCanvasView &view, const QString &filePath)
+{
+	// without a journal no edit compacts it inside a timed section
+	view.setJournalEnabled(false);
+	view.setMaximumSize(CanvasSize);
+	view.resize(CanvasSize);
+	view.show();
+	if (!QTest::qWaitForWindowExposed(&view))
+		return false;
+
+	return runFileTask(view, "readItemsFromFile", filePath);
+}
+
+bool LCanvasBenchmark::runFileTask(LCanvasView &view, const char *slot, const QString &filePath)
+{
+	if (filePath.isEmpty())
+		return false;
+
+	QSignalSpy spy(&view, SIGNAL(fileTaskFinished(bool)));
+	QMetaObject::invokeMethod(&view, slot, Qt::DirectConnection, Q_ARG(QString, filePath));
+	if (spy.isEmpty() && !spy.wait(FileTaskTimeout))
+		return false;
+
+	return spy.first().first().toBool();
+}
+
+QVector<QPoint> LCanvasBenchmark::probePoints(int count)
+{
+	documentPath(count);
+	return m_probes.value(count);
+}
+
+LCanvasItemList LCanvasBenchmark::generateItems(int count)
+{
+	LCanvasGenerator generator;
+	generator.setItemCount(count);
+	generator.setSeed(count);
+	generator.setCanvasSize(CanvasSize);
+	generator.setBounds(QRect(EmptyMargin, EmptyMargin, CanvasSize.width() - 2 * EmptyMargin, CanvasSize.height() - 2 * EmptyMargin));
+	generator.setPathLength(2, 16);
+	return generator.generate();
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+	// paint into an offscreen surface unless a platform was asked for
+	if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+
+	QApplication app(argc, argv);
+	lwscode::LCanvasBenchmark benchmark;
+	return QTest::qExec(&benchmark, argc, argv);
+}
+
+#include "lcanvasbenchmark.moc"
@@ -2,6 +2,7 @@
 #include "lcanvasitem.h"
 #include "lcanvasview.h"
 #include "utility.h"
+#include "lcanvastrace.h"
 
 namespace lwscode {
 
@@ -226,6 +227,7 @@ void LCanvasScene::drawViewArea(LCanvasView *view, QPainter *painter, const QRec
 
 void LCanvasScene::update()
 {
+	LCANVAS_TRACE("paint", "LCanvasScene::update");
 	QRect rect = changeBounds();
 	for (int i = 0; i < m_viewList.size(); ++i)
 	{
@@ -328,6 +330,7 @@ void LCanvasScene::drawArea(const QRect &rect, QPainter *painter)
 
 void LCanvasScene::drawCanvasArea(const QRect &rect, QPainter *painter)
 {
+	LCANVAS_TRACE("paint", "LCanvasScene::drawCanvasArea");
 	if (!painter)
 		return;
 
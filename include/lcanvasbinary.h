@@ -0,0 +1,107 @@
+#ifndef LCANVASBINARY_H
+#define LCANVASBINARY_H
+
+#include "lcanvasitem.h"
+#include "lcanvasprogress.h"
+
+namespace lwscode {
+
+// native document layout, little-endian and 4-byte aligned:
+// header | item records | style table | point array | string table
+// a group record is followed by the records of its pointCount children; symbol
+// records come first, laid out like groups with the id as their text, and an
+// instance record names its symbol in its text and its transform in its font
+struct LBinaryHeader
+{
+	char magic[4];
+	quint32 version;
+	qint32 canvasWidth;
+	qint32 canvasHeight;
+	quint32 itemCount;
+	quint32 itemOffset;
+	quint32 styleCount;
+	quint32 styleOffset;
+	quint32 pointCount;
+	quint32 pointOffset;
+	quint32 stringSize;
+	quint32 stringOffset;
+};
+
+enum BinaryStyleFlag {
+	FillValid = 0x00000001,
+	StrokeValid = 0x00000002,
+	FillOverridden = 0x00000004,
+	StrokeOverridden = 0x00000008,
+	StrokeWidthOverridden = 0x00000010
+};
+
+// record types past the item types
+enum BinaryRecordType {
+	SymbolRecord = 0x100
+};
+
+struct LBinaryStyle
+{
+	quint32 fill;
+	quint32 stroke;
+	qint32 strokeWidth;
+	quint32 flags;
+};
+
+struct LBinaryItem
+{
+	qint32 type;
+	quint32 style;
+	qint32 x1;
+	qint32 y1;
+	qint32 x2;
+	qint32 y2;
+	quint32 pointIndex;
+	quint32 pointCount;
+	quint32 textOffset;
+	quint32 textSize;
+	quint32 fontOffset;
+	quint32 fontSize;
+	qint32 fontPointSize;
+};
+
+struct LBinaryPoint
+{
+	qint32 x;
+	qint32 y;
+};
+
+class LCanvasBinaryFormat
+{
+public:
+	LCanvasBinaryFormat();
+
+	void setProgress(LCanvasProgress *progress);
+
+	bool read(const QString &filePath);
+	bool write(const QString &filePath, const LCanvasItemList &items, const QSize &canvasSize);
+
+	LCanvasItemList items() const;
+	QHash<QString, SPtrLCanvasSymbol> symbols() const;
+	QSize canvasSize() const;
+
+	static bool isBinaryFile(const QString &filePath);
+	static bool convert(const QString &sourcePath, const QString &targetPath,
+						bool minified = false, int pathQuantum = 1);
+
+private:
+	bool readMapped(const char *data, qint64 size);
+	SPtrLCanvasItem readItem(const LBinaryItem &record, const LBinaryStyle *styles,
+							 const LBinaryPoint *points, const char *strings);
+	SPtrLCanvasItem readInstance(const LBinaryItem &record, const LBinaryStyle &style, const char *strings);
+
+private:
+	LCanvasItemList m_items;
+	QHash<QString, SPtrLCanvasSymbol> m_symbols;
+	QSize m_canvasSize;
+	LCanvasProgress *m_progress;
+};
+
+} // namespace
+
+#endif // LCANVASBINARY_H
@@ -0,0 +1,55 @@
+#ifndef LCANVASDEDUP_H
+#define LCANVASDEDUP_H
+
+#include "lcanvasitem.h"
+
+namespace lwscode {
+
+// finds items that only differ by position in a loaded document and lets them
+// share one copy: repeated paths and texts become copies of the first, sharing
+// its points, path and strings, repeated groups become instances of one symbol
+class LCanvasDeduplicator
+{
+public:
+	LCanvasDeduplicator();
+
+	LCanvasItemList deduplicate(const LCanvasItemList &items);
+
+	int itemCount() const;
+	int sharedCount() const;
+	int instanceCount() const;
+	int shapeCount() const;
+	qint64 bytesBefore() const;
+	qint64 bytesAfter() const;
+	QString summary() const;
+
+private:
+	LCanvasItemList shareItems(const LCanvasItemList &items);
+	QString symbolId();
+
+	static bool anchor(const SPtrLCanvasItem &item, QPoint &pos);
+	static bool sameContent(const SPtrLCanvasItem &item, const SPtrLCanvasItem &other);
+
+private:
+	struct LSharedShape
+	{
+		SPtrLCanvasItem item;
+		QPoint anchor;
+		// the item moved to the origin, what later items are compared with
+		SPtrLCanvasItem normalized;
+	};
+
+	// the first item of every shape met and where it sits
+	QHash<quint64, LSharedShape> m_shapes;
+	QHash<quint64, SPtrLCanvasSymbol> m_symbols;
+	QSet<QString> m_symbolIds;
+	int m_nItemCount;
+	int m_nSharedCount;
+	int m_nInstanceCount;
+	qint64 m_nBytesBefore;
+	qint64 m_nBytesAfter;
+};
+
+} // namespace
+
+#endif // LCANVASDEDUP_H
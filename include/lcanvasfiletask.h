@@ -0,0 +1,49 @@
+#ifndef LCANVASFILETASK_H
+#define LCANVASFILETASK_H
+
+#include "lcanvasitem.h"
+#include "lcanvasprogress.h"
+#include "lcanvasreader.h"
+
+namespace lwscode {
+
+enum FileTaskMode {
+	NoneTask = 0,
+	LoadTask,
+	SaveTask
+};
+
+// runs a load or save on a pool thread and posts the result back to the
+// receiver's finishFileTask(bool, LCanvasItemList) slot; loads also post
+// early batches to appendLoadedItems(LCanvasItemList) and, when geometry is
+// shared, the savings to reportSharedGeometry(QString)
+class LCanvasFileTask : public QRunnable, public LCanvasReadHandler
+{
+public:
+	LCanvasFileTask(FileTaskMode mode, const QString &filePath,
+					QSharedPointer<LCanvasProgress> progress, QObject *receiver);
+
+	void setItems(const LCanvasItemList &items);
+	void setCanvasSize(const QSize &size);
+	void setPriorityRect(const QRect &rect);
+	void setShareGeometry(bool share);
+
+	void run() override;
+	void readItems(const LCanvasItemList &items) override;
+
+private:
+	FileTaskMode m_mode;
+	QString m_filePath;
+	QSharedPointer<LCanvasProgress> m_progress;
+	QObject *m_receiver;
+	LCanvasItemList m_items;
+	QSize m_canvasSize;
+	QRect m_priorityRect;
+	bool m_bShareGeometry;
+};
+
+} // namespace
+
+Q_DECLARE_METATYPE(lwscode::LCanvasItemList)
+
+#endif // LCANVASFILETASK_H
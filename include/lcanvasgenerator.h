@@ -0,0 +1,70 @@
+#ifndef LCANVASGENERATOR_H
+#define LCANVASGENERATOR_H
+
+#include "lcanvasitem.h"
+
+namespace lwscode {
+
+enum GeneratorDistribution {
+	UniformDistribution,
+	ClusteredDistribution,
+	GridDistribution
+};
+
+// builds reproducible synthetic documents for stress and scaling runs; the
+// same settings and seed always give the same items in the same order
+class LCanvasGenerator
+{
+public:
+	LCanvasGenerator();
+
+	void setItemCount(int count);
+	void setSeed(quint32 seed);
+	void setCanvasSize(const QSize &size);
+	void setBounds(const QRect &bounds);
+	void setTypeWeight(ItemType itemType, int weight);
+	bool setTypeMix(const QString &mix);
+	void setDistribution(GeneratorDistribution distribution, int clusterCount = 16);
+	void setOverlap(double overlap);
+	void setPathLength(int minPoints, int maxPoints);
+	void setStyleCount(int count);
+	void setGroupSize(int size);
+	void setSymbolCount(int count);
+
+	QSize canvasSize() const;
+	LCanvasItemList generate() const;
+	bool write(const QString &filePath) const;
+
+private:
+	struct LGeneratorStyle
+	{
+		QColor fill;
+		QColor stroke;
+		int width;
+	};
+
+	ItemType pickType(QRandomGenerator &generator, int total) const;
+	QPoint pickPos(QRandomGenerator &generator, int index, const QVector<QPoint> &clusters, int side) const;
+	LGeneratorStyle pickStyle(QRandomGenerator &generator, const QVector<LGeneratorStyle> &styles) const;
+
+	static LGeneratorStyle randomStyle(QRandomGenerator &generator);
+
+private:
+	int m_nItemCount;
+	quint32 m_nSeed;
+	QSize m_canvasSize;
+	QRect m_bounds;
+	int m_typeWeights[ItemType::Text + 1];
+	GeneratorDistribution m_distribution;
+	int m_nClusterCount;
+	double m_fOverlap;
+	int m_nMinPathPoints;
+	int m_nMaxPathPoints;
+	int m_nStyleCount;
+	int m_nGroupSize;
+	int m_nSymbolCount;
+};
+
+} // namespace
+
+#endif // LCANVASGENERATOR_H
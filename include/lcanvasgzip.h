@@ -0,0 +1,85 @@
+#ifndef LCANVASGZIP_H
+#define LCANVASGZIP_H
+
+#include <QtWidgets>
+
+#include <zlib.h>
+
+namespace lwscode {
+
+class LInflateThread;
+
+// sequential device over a gzip stream; a helper thread reads and inflates the
+// source in chunks ahead of the consumer, so inflate runs alongside parsing
+// and at most a few chunks of plain text are held at once
+class LGzipInflateDevice : public QIODevice
+{
+	friend class LInflateThread;
+
+public:
+	explicit LGzipInflateDevice(QIODevice *source);
+	~LGzipInflateDevice();
+
+	bool isSequential() const override;
+	qint64 pos() const override;
+	bool open(OpenMode mode) override;
+	void close() override;
+	bool hasError() const;
+
+	static bool isGzipData(const QByteArray &data);
+	static qint64 uncompressedSize(QFile &file);
+
+protected:
+	qint64 readData(char *data, qint64 maxSize) override;
+	qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+	bool pushChunk(const QByteArray &chunk);
+	void finish(bool error);
+
+private:
+	QIODevice *m_source;
+	LInflateThread *m_thread;
+	QMutex m_mutex;
+	QWaitCondition m_chunkReady;
+	QWaitCondition m_chunkTaken;
+	QQueue<QByteArray> m_chunks;
+	QByteArray m_current;
+	int m_nCurrentPos;
+	qint64 m_nInflated;
+	bool m_bFinished;
+	bool m_bError;
+	bool m_bStopping;
+};
+
+// deflates everything written to it into a gzip stream on the target device
+class LGzipDeflateDevice : public QIODevice
+{
+public:
+	explicit LGzipDeflateDevice(QIODevice *target);
+	~LGzipDeflateDevice();
+
+	bool open(OpenMode mode) override;
+	void close() override;
+	bool hasError() const;
+
+	static bool isGzipSuffix(const QString &filePath);
+
+protected:
+	qint64 readData(char *data, qint64 maxSize) override;
+	qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+	bool deflateInput(const char *data, qint64 size, int flush);
+
+private:
+	QIODevice *m_target;
+	z_stream m_stream;
+	QByteArray m_output;
+	bool m_bInitialized;
+	bool m_bError;
+};
+
+} // namespace
+
+#endif // LCANVASGZIP_H
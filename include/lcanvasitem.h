@@ -6,7 +6,12 @@
 namespace lwscode {
 
 class LCanvasItem;
+class LCanvasSymbol;
+class LSvgStreamWriter;
+class LCanvasMemoryReport;
 typedef QSharedPointer<LCanvasItem> SPtrLCanvasItem;
+typedef QSharedPointer<LCanvasSymbol> SPtrLCanvasSymbol;
+typedef QList<SPtrLCanvasItem> LCanvasItemList;
 typedef QList<QPoint> QPoints;
 
 enum ItemType {
@@ -17,7 +22,29 @@ enum ItemType {
 	Ellipse,
 	Triangle,
 	Hexagon,
-	Text
+	Text,
+	Group,
+	Instance
+};
+
+// geometry derived from the item's state, rebuilt on first use after a change
+enum DerivedGeometry {
+	NoGeometry = 0x0,
+	BoundsGeometry = 0x1,
+	PathGeometry = 0x2,
+	VerticesGeometry = 0x4,
+	HitGeometry = 0x8,
+	RasterGeometry = 0x10,
+	AllGeometry = BoundsGeometry | PathGeometry | VerticesGeometry | HitGeometry | RasterGeometry
+};
+
+// the style an instance sets over its symbol's own; the journal names the
+// property a style edit changed with the same flags
+enum StyleOverride {
+	NoOverride = 0x0,
+	FillOverride = 0x1,
+	StrokeOverride = 0x2,
+	StrokeWidthOverride = 0x4
 };
 
 enum StretchItemDir {
@@ -42,6 +69,8 @@ public:
 	LCanvasItem();
 	virtual ~LCanvasItem() {}
 
+	static SPtrLCanvasItem createItem(ItemType itemType);
+
 	ItemType getItemType();
 
 	QPoint startPos();
@@ -51,34 +80,66 @@ public:
 	void setEndPos(const QPoint &point);
 	void moveEndPos(int dx, int dy);
 
-	void setFillColor(const QColor &color);
-	void setStrokeColor(const QColor &color);
-	void setStrokeWidth(int width);
+	QColor fillColor() const;
+	virtual void setFillColor(const QColor &color);
+	QColor strokeColor() const;
+	virtual void setStrokeColor(const QColor &color);
+	int strokeWidth() const;
+	virtual void setStrokeWidth(int width);
+	void setStyle(int properties, const QColor &fillColor, const QColor &strokeColor, int strokeWidth);
 
 	bool isSelected();
 	void setSelected(bool selected);
 
 	QRect boundingRect();
+	virtual QRect geometryRect();
+	const QPainterPath &path();
+	void updateGeometry(int geometry = DerivedGeometry::BoundsGeometry);
+	void stretchItemTo(StretchItemDir dir, int x, int y);
+
+	static QTransform stretchTransform(const QRect &rect, StretchItemDir dir, const QPoint &pos);
+
+	quint64 dirtyEpoch() const;
+	quint64 contentHash();
+	void accountMemory(LCanvasMemoryReport &report) const;
 
 	virtual void paintItem(QPainter &painter) = 0;
 	virtual void moveItem(int dx, int dy) = 0;
 	virtual void scaleItem(double sx, double sy) = 0;
-	virtual void stretchItemTo(StretchItemDir dir, int x, int y) = 0;
-	virtual void updatePath() = 0;
-	virtual void setBoundingRect() = 0;
+	virtual void transformItem(const QTransform &transform) = 0;
 	virtual bool containsPos(const QPoint &point) = 0;
+	virtual void paintPickShape(QPainter &painter) = 0;
 	virtual SPtrLCanvasItem clone() = 0;
-	virtual void writeItemToXml(QXmlStreamWriter &writer) = 0;
+	virtual void writeItemToXml(LSvgStreamWriter &writer) = 0;
 
 	virtual void addPoint(const QPoint &point) {}
-	virtual void movePathTo(const QPoint &point) {}
-	virtual void linePathTo(const QPoint &point) {}
+	virtual QPoints points() const { return QPoints(); }
+	virtual QPoints vertices() const { return QPoints(); }
 
 	virtual void setFont(const QFont &font) {}
 	virtual QFont font() const { return QFont(); }
 	virtual void setText(const QString &text) {}
 	virtual QString text() const { return QString(); }
 
+	virtual void addChild(const SPtrLCanvasItem &item) {}
+	virtual LCanvasItemList children() const { return LCanvasItemList(); }
+
+	virtual SPtrLCanvasSymbol symbol() const { return SPtrLCanvasSymbol(); }
+	virtual QTransform transform() const { return QTransform(); }
+	virtual int styleOverrides() const { return StyleOverride::NoOverride; }
+
+protected:
+	virtual void updatePath() = 0;
+	virtual void setBoundingRect() = 0;
+	virtual qint64 cacheBytes() const { return 0; }
+	virtual QPoints pointBlock() const { return points(); }
+	virtual QPoint pointOffset() const { return QPoint(); }
+
+	void markDirty(int geometry = DerivedGeometry::AllGeometry) { ++m_nEpoch; m_nDirtyGeometry |= geometry; }
+	void markMoved(int dx, int dy);
+	bool isDirty(DerivedGeometry geometry) const { return m_nDirtyGeometry & geometry; }
+	void markClean(DerivedGeometry geometry) const { m_nDirtyGeometry &= ~geometry; }
+
 protected:
 	ItemType m_itemType;
 	QPoint m_startPos;
@@ -90,6 +151,10 @@ protected:
 	bool m_bSelected;
 	QRect m_boundingRect;
 	QPainterPath m_path;
+	quint64 m_nEpoch;
+	quint64 m_nHashEpoch;
+	quint64 m_nContentHash;
+	mutable int m_nDirtyGeometry;
 };
 
 class LCanvasPath : public LCanvasItem
@@ -99,21 +164,31 @@ public:
 	virtual ~LCanvasPath() {}
 
 	void addPoint(const QPoint &point) override;
-	void movePathTo(const QPoint &point) override;
-	void linePathTo(const QPoint &point) override;
+	QPoints points() const override;
 
 	void paintItem(QPainter &painter) override;
 	void moveItem(int dx, int dy) override;
 	void scaleItem(double sx, double sy) override;
-	void stretchItemTo(StretchItemDir dir, int x, int y) override;
-	void updatePath() override;
-	void setBoundingRect() override;
+	void transformItem(const QTransform &transform) override;
 	bool containsPos(const QPoint &point) override;
+	void paintPickShape(QPainter &painter) override;
 	SPtrLCanvasItem clone() override;
-	void writeItemToXml(QXmlStreamWriter &writer) override;
+	void writeItemToXml(LSvgStreamWriter &writer) override;
+
+protected:
+	void updatePath() override;
+	void setBoundingRect() override;
+	QPoints pointBlock() const override;
+	QPoint pointOffset() const override;
+
+private:
+	void applyPointOffset();
 
 private:
+	// shared with copies until one of them changes its shape; moves are kept
+	// in the offset, so the block and the path built from it stay shared
 	QPoints m_points;
+	QPoint m_pointOffset;
 };
 
 class LCanvasLine : public LCanvasItem
@@ -125,12 +200,15 @@ public:
 	void paintItem(QPainter &painter) override;
 	void moveItem(int dx, int dy) override;
 	void scaleItem(double sx, double sy) override;
-	void stretchItemTo(StretchItemDir dir, int x, int y) override;
-	void updatePath() override;
-	void setBoundingRect() override;
+	void transformItem(const QTransform &transform) override;
 	bool containsPos(const QPoint &point) override;
+	void paintPickShape(QPainter &painter) override;
 	SPtrLCanvasItem clone() override;
-	void writeItemToXml(QXmlStreamWriter &writer) override;
+	void writeItemToXml(LSvgStreamWriter &writer) override;
+
+protected:
+	void updatePath() override;
+	void setBoundingRect() override;
 };
 
 class LCanvasRect : public LCanvasItem
@@ -142,12 +220,15 @@ public:
 	void paintItem(QPainter &painter) override;
 	void moveItem(int dx, int dy) override;
 	void scaleItem(double sx, double sy) override;
-	void stretchItemTo(StretchItemDir dir, int x, int y) override;
-	void updatePath() override;
-	void setBoundingRect() override;
+	void transformItem(const QTransform &transform) override;
 	bool containsPos(const QPoint &point) override;
+	void paintPickShape(QPainter &painter) override;
 	SPtrLCanvasItem clone() override;
-	void writeItemToXml(QXmlStreamWriter &writer) override;
+	void writeItemToXml(LSvgStreamWriter &writer) override;
+
+protected:
+	void updatePath() override;
+	void setBoundingRect() override;
 
 private:
 	int m_nWidth;
@@ -163,16 +244,23 @@ public:
 	void paintItem(QPainter &painter) override;
 	void moveItem(int dx, int dy) override;
 	void scaleItem(double sx, double sy) override;
-	void stretchItemTo(StretchItemDir dir, int x, int y) override;
-	void updatePath() override;
-	void setBoundingRect() override;
+	void transformItem(const QTransform &transform) override;
 	bool containsPos(const QPoint &point) override;
+	void paintPickShape(QPainter &painter) override;
 	SPtrLCanvasItem clone() override;
-	void writeItemToXml(QXmlStreamWriter &writer) override;
+	void writeItemToXml(LSvgStreamWriter &writer) override;
+
+protected:
+	void updatePath() override;
+	void setBoundingRect() override;
+
+private:
+	void updateHitGeometry();
 
 private:
 	int m_nWidth;
 	int m_nHeight;
+	QPoint m_centerPos;
 };
 
 class LCanvasTriangle : public LCanvasItem
@@ -181,20 +269,29 @@ public:
 	LCanvasTriangle();
 	virtual ~LCanvasTriangle() {}
 
+	QPoints vertices() const override;
+
 	void paintItem(QPainter &painter) override;
 	void moveItem(int dx, int dy) override;
 	void scaleItem(double sx, double sy) override;
-	void stretchItemTo(StretchItemDir dir, int x, int y) override;
-	void updatePath() override;
-	void setBoundingRect() override;
+	void transformItem(const QTransform &transform) override;
 	bool containsPos(const QPoint &point) override;
+	void paintPickShape(QPainter &painter) override;
 	SPtrLCanvasItem clone() override;
-	void writeItemToXml(QXmlStreamWriter &writer) override;
+	void writeItemToXml(LSvgStreamWriter &writer) override;
+
+protected:
+	void updatePath() override;
+	void setBoundingRect() override;
+
+private:
+	const QPolygon &polygon();
 
 private:
 	int m_nWidth;
 	int m_nHeight;
-	QPoints m_vertices;
+	mutable QPoints m_vertices;
+	QPolygon m_polygon;
 };
 
 class LCanvasHexagon : public LCanvasItem
@@ -203,20 +300,29 @@ public:
 	LCanvasHexagon();
 	virtual ~LCanvasHexagon() {}
 
+	QPoints vertices() const override;
+
 	void paintItem(QPainter &painter) override;
 	void moveItem(int dx, int dy) override;
 	void scaleItem(double sx, double sy) override;
-	void stretchItemTo(StretchItemDir dir, int x, int y) override;
-	void updatePath() override;
-	void setBoundingRect() override;
+	void transformItem(const QTransform &transform) override;
 	bool containsPos(const QPoint &point) override;
+	void paintPickShape(QPainter &painter) override;
 	SPtrLCanvasItem clone() override;
-	void writeItemToXml(QXmlStreamWriter &writer) override;
+	void writeItemToXml(LSvgStreamWriter &writer) override;
+
+protected:
+	void updatePath() override;
+	void setBoundingRect() override;
+
+private:
+	const QPolygon &polygon();
 
 private:
 	int m_nWidth;
 	int m_nHeight;
-	QPoints m_vertices;
+	mutable QPoints m_vertices;
+	QPolygon m_polygon;
 };
 
 class LCanvasText : public LCanvasItem
@@ -230,15 +336,20 @@ public:
 	void setText(const QString &text) override;
 	QString text() const override;
 
+	QRect geometryRect() override;
+
 	void paintItem(QPainter &painter) override;
 	void moveItem(int dx, int dy) override;
 	void scaleItem(double sx, double sy) override;
-	void stretchItemTo(StretchItemDir dir, int x, int y) override;
-	void updatePath() override;
-	void setBoundingRect() override;
+	void transformItem(const QTransform &transform) override;
 	bool containsPos(const QPoint &point) override;
+	void paintPickShape(QPainter &painter) override;
 	SPtrLCanvasItem clone() override;
-	void writeItemToXml(QXmlStreamWriter &writer) override;
+	void writeItemToXml(LSvgStreamWriter &writer) override;
+
+protected:
+	void updatePath() override;
+	void setBoundingRect() override;
 
 private:
 	int m_nWidth;
@@ -247,6 +358,135 @@ private:
 	QString m_text;
 };
 
+// owns its children, which only change through the group, so the aggregate
+// bounds and the raster stay cached until the group itself is touched; a
+// style set on the group overrides its children's when drawn, as an
+// instance's does, and leaves their own style as it is
+class LCanvasGroup : public LCanvasItem
+{
+public:
+	LCanvasGroup();
+	virtual ~LCanvasGroup() {}
+
+	void addChild(const SPtrLCanvasItem &item) override;
+	LCanvasItemList children() const override;
+
+	void setCacheEnabled(bool enabled);
+	bool isCacheEnabled() const;
+	int styleOverrides() const override;
+
+	void setFillColor(const QColor &color) override;
+	void setStrokeColor(const QColor &color) override;
+	void setStrokeWidth(int width) override;
+
+	QRect geometryRect() override;
+
+	void paintItem(QPainter &painter) override;
+	void moveItem(int dx, int dy) override;
+	void scaleItem(double sx, double sy) override;
+	void transformItem(const QTransform &transform) override;
+	bool containsPos(const QPoint &point) override;
+	void paintPickShape(QPainter &painter) override;
+	SPtrLCanvasItem clone() override;
+	void writeItemToXml(LSvgStreamWriter &writer) override;
+
+protected:
+	void updatePath() override;
+	void setBoundingRect() override;
+	qint64 cacheBytes() const override;
+
+private:
+	const LCanvasItemList &styledChildren();
+	void updateRaster(const QRect &rect, qreal scale);
+
+private:
+	LCanvasItemList m_children;
+	// copies of the children with the overrides applied, for drawing
+	LCanvasItemList m_styledChildren;
+	quint64 m_nStyledEpoch;
+	int m_nOverrides;
+	bool m_bCacheEnabled;
+	QImage m_raster;
+	qreal m_fRasterScale;
+};
+
+// geometry shared by all instances of it: a master group in symbol
+// coordinates, never edited once the symbol exists, and one raster of it
+class LCanvasSymbol
+{
+public:
+	LCanvasSymbol(const QString &id, const SPtrLCanvasItem &master);
+
+	QString id() const;
+	SPtrLCanvasItem master() const;
+	QRect boundingRect() const;
+	quint64 contentHash() const;
+
+	SPtrLCanvasSymbol styledSymbol(int overrides, const QColor &fillColor, const QColor &strokeColor, int strokeWidth);
+	LCanvasItemList masters() const;
+	qint64 rasterBytes() const;
+
+	void paint(QPainter &painter);
+
+	static QList<SPtrLCanvasSymbol> collect(const LCanvasItemList &items);
+
+private:
+	bool updateRaster(qreal scale);
+
+private:
+	QString m_id;
+	SPtrLCanvasItem m_master;
+	QRect m_boundingRect;
+	quint64 m_nContentHash;
+	QImage m_raster;
+	qreal m_fRasterScale;
+	mutable QMutex m_mutex;
+	QHash<quint64, SPtrLCanvasSymbol> m_styledSymbols;
+};
+
+// a placement of a symbol, a transform and style overrides over the shared
+// master; copies cost the object, not the geometry
+class LCanvasInstance : public LCanvasItem
+{
+public:
+	explicit LCanvasInstance(const SPtrLCanvasSymbol &symbol = SPtrLCanvasSymbol());
+	virtual ~LCanvasInstance() {}
+
+	void setSymbol(const SPtrLCanvasSymbol &symbol);
+	SPtrLCanvasSymbol symbol() const override;
+	void setTransform(const QTransform &transform);
+	QTransform transform() const override;
+	int styleOverrides() const override;
+
+	void setFillColor(const QColor &color) override;
+	void setStrokeColor(const QColor &color) override;
+	void setStrokeWidth(int width) override;
+
+	QRect geometryRect() override;
+
+	void paintItem(QPainter &painter) override;
+	void moveItem(int dx, int dy) override;
+	void scaleItem(double sx, double sy) override;
+	void transformItem(const QTransform &transform) override;
+	bool containsPos(const QPoint &point) override;
+	void paintPickShape(QPainter &painter) override;
+	SPtrLCanvasItem clone() override;
+	void writeItemToXml(LSvgStreamWriter &writer) override;
+
+protected:
+	void updatePath() override;
+	void setBoundingRect() override;
+
+private:
+	LCanvasSymbol *styledSymbol();
+
+private:
+	SPtrLCanvasSymbol m_symbol;
+	SPtrLCanvasSymbol m_styledSymbol;
+	QTransform m_transform;
+	int m_nOverrides;
+};
+
 } // namespace
 
 #endif // LCANVASITEM_H
@@ -0,0 +1,73 @@
+#ifndef LCANVASJOURNAL_H
+#define LCANVASJOURNAL_H
+
+#include "lcanvasitem.h"
+
+namespace lwscode {
+
+enum JournalOp {
+	NoneOp = 0,
+	SnapshotOp,
+	AddItemsOp,
+	RemoveItemsOp,
+	MoveItemsOp,
+	SetGeometryOp,
+	SetStyleOp,
+	ReorderItemOp,
+	ClearItemsOp,
+	DocumentPathOp,
+	TransformItemsOp
+};
+
+// append-only log of model mutations, kept in the autosave directory while
+// the editor runs; items are addressed by their index in the model, so the
+// log replays onto the snapshot it starts from
+class LCanvasJournal
+{
+public:
+	LCanvasJournal();
+	~LCanvasJournal();
+
+	bool open();
+	void discard();
+	bool isOpen() const;
+
+	void setDocumentPath(const QString &filePath);
+	void addItems(int index, const LCanvasItemList &items);
+	void removeItems(const QVector<int> &indices);
+	void moveItems(const QVector<int> &indices, int dx, int dy);
+	void setItemGeometry(int index, const QPoint &startPos, const QPoint &endPos);
+	void transformItems(const QVector<int> &indices, const QTransform &transform);
+	void setItemFillColor(const QVector<int> &indices, const QColor &color);
+	void setItemStrokeColor(const QVector<int> &indices, const QColor &color);
+	void setItemStrokeWidth(const QVector<int> &indices, int width);
+	void reorderItem(int from, int to);
+	void clearItems();
+
+	bool needsCompaction() const;
+	bool compact(const LCanvasItemList &items, const QSize &canvasSize);
+
+	static QString findOrphan();
+	static bool replay(const QString &journalPath, LCanvasItemList &items,
+					   QSize &canvasSize, QString &documentPath);
+	static void remove(const QString &journalPath);
+
+private:
+	void setItemStyle(const QVector<int> &indices, int property, const QColor &color, int width);
+	void appendRecord(const QByteArray &record);
+
+	static QString autosaveDir();
+
+private:
+	QString m_filePath;
+	QString m_snapshotPath;
+	QString m_documentPath;
+	QFile m_file;
+	QScopedPointer<QLockFile> m_lock;
+	int m_nSnapshot;
+	int m_nRecords;
+};
+
+} // namespace
+
+#endif // LCANVASJOURNAL_H
@@ -0,0 +1,82 @@
+#ifndef LCANVASMEMORY_H
+#define LCANVASMEMORY_H
+
+#include "lcanvasitem.h"
+
+namespace lwscode {
+
+enum MemoryComponent {
+	ObjectMemory,
+	BoundsMemory,
+	StyleMemory,
+	PathMemory,
+	PointsMemory,
+	TextMemory,
+	RasterMemory,
+	HandleMemory,
+	ComponentCount
+};
+
+enum MemoryScope {
+	DocumentScope,
+	ClipboardScope,
+	ScopeCount
+};
+
+// bytes held by the model, by item type and component; payloads plus Qt's
+// container headers, allocator overhead not included. Shared data is counted
+// once, where it is first met
+class LCanvasMemoryReport
+{
+public:
+	LCanvasMemoryReport();
+
+	void addItems(const LCanvasItemList &items, MemoryScope scope);
+	void addList(const QString &name, const LCanvasItemList &items);
+	void add(ItemType itemType, MemoryComponent component, qint64 bytes);
+	bool claim(const void *data);
+
+	int itemCount(ItemType itemType, MemoryScope scope) const;
+	qint64 bytes(ItemType itemType, MemoryScope scope, MemoryComponent component) const;
+	qint64 typeBytes(ItemType itemType, MemoryScope scope) const;
+	qint64 scopeBytes(MemoryScope scope) const;
+	QList<QPair<QString, qint64> > lists() const;
+	qint64 totalBytes() const;
+	QString toText() const;
+
+	static QString typeName(ItemType itemType);
+	static QString componentName(MemoryComponent component);
+	static QString scopeName(MemoryScope scope);
+	static qint64 listSlotSize();
+	static qint64 handleSize();
+
+private:
+	static const int TypeCount = ItemType::Instance + 1;
+
+	MemoryScope m_scope;
+	qint64 m_bytes[ScopeCount][TypeCount][ComponentCount];
+	int m_nItems[ScopeCount][TypeCount];
+	QList<QPair<QString, qint64> > m_lists;
+	QSet<const void *> m_claimed;
+};
+
+class LCanvasMemoryPanel : public QDialog
+{
+	Q_OBJECT
+
+public:
+	LCanvasMemoryPanel(QWidget *parent = nullptr);
+
+	void setReport(const LCanvasMemoryReport &report);
+
+signals:
+	void refreshRequested();
+
+private:
+	QTreeWidget *m_tree;
+	QLabel *m_totalLabel;
+};
+
+} // namespace
+
+#endif // LCANVASMEMORY_H
@@ -0,0 +1,55 @@
+#ifndef LCANVASPICK_H
+#define LCANVASPICK_H
+
+#include "lcanvasitem.h"
+
+namespace lwscode {
+
+// an offscreen image holding, per pixel, the id of the topmost item whose
+// pick shape covers it, so picking is one pixel read; sync() compares the
+// items with what was drawn and only the areas edits touched are redrawn
+class LCanvasPickBuffer
+{
+public:
+	LCanvasPickBuffer();
+
+	bool isValid() const;
+	void reset();
+	void sync(const LCanvasItemList &items, const QSize &size);
+	SPtrLCanvasItem pick(const LCanvasItemList &items, const QPoint &pos);
+
+private:
+	struct LPickRecord
+	{
+		QWeakPointer<LCanvasItem> item;
+		quint32 id;
+		int order;
+		quint64 epoch;
+		QRect bounds;
+		quint32 stamp;
+	};
+
+	void render(const LCanvasItemList &items);
+	void invalidate(const QRect &rect);
+	void invalidateAll();
+	quint32 allocateId(const SPtrLCanvasItem &item);
+	void releaseId(quint32 id);
+
+private:
+	QImage m_image;
+	// nothing here keeps an item alive, the view owns them; a record whose
+	// item is gone no longer matches a new item at the same address
+	QHash<const LCanvasItem *, LPickRecord> m_records;
+	// indexed by id, id 0 is the background
+	QVector<QWeakPointer<LCanvasItem> > m_items;
+	QVector<quint32> m_freeIds;
+	QRegion m_dirty;
+	int m_nDirtyRects;
+	bool m_bAllDirty;
+	bool m_bOverflow;
+	quint32 m_nStamp;
+};
+
+} // namespace
+
+#endif // LCANVASPICK_H
@@ -0,0 +1,29 @@
+#ifndef LCANVASPROGRESS_H
+#define LCANVASPROGRESS_H
+
+#include <QtWidgets>
+
+namespace lwscode {
+
+// shared between a file task and the threads doing the work
+class LCanvasProgress
+{
+public:
+	LCanvasProgress();
+
+	void cancel();
+	bool isCanceled() const;
+
+	void setTotal(qint64 total);
+	void advance(qint64 amount);
+	int percent() const;
+
+private:
+	QAtomicInt m_canceled;
+	QAtomicInteger<qint64> m_done;
+	QAtomicInteger<qint64> m_total;
+};
+
+} // namespace
+
+#endif // LCANVASPROGRESS_H
@@ -0,0 +1,167 @@
+#ifndef LCANVASREADER_H
+#define LCANVASREADER_H
+
+#include "lcanvasitem.h"
+#include "lcanvasprogress.h"
+
+namespace lwscode {
+
+enum SvgTag {
+	TagNone = -1,
+	TagSvg,
+	TagPath,
+	TagLine,
+	TagRect,
+	TagPolygon,
+	TagEllipse,
+	TagText,
+	TagGroup,
+	TagDefs,
+	TagSymbol,
+	TagUse
+};
+
+enum SvgAttribute {
+	AttrNone = -1,
+	AttrD,
+	AttrX,
+	AttrY,
+	AttrX1,
+	AttrY1,
+	AttrX2,
+	AttrY2,
+	AttrCx,
+	AttrCy,
+	AttrRx,
+	AttrRy,
+	AttrWidth,
+	AttrHeight,
+	AttrPoints,
+	AttrFill,
+	AttrStroke,
+	AttrStrokeWidth,
+	AttrFontFamily,
+	AttrFontSize,
+	AttrSubset,
+	AttrId,
+	AttrHref,
+	AttrTransform,
+	AttrCount
+};
+
+// non-owning view into the mapped document bytes
+class LByteView
+{
+public:
+	LByteView();
+	LByteView(const char *data, int size);
+
+	const char *data() const { return m_data; }
+	int size() const { return m_nSize; }
+	bool isEmpty() const { return m_nSize <= 0; }
+
+	bool equals(const char *literal) const;
+	bool contains(const char *literal) const;
+	int toInt() const;
+	QColor toColor() const;
+	QString toString() const;
+
+private:
+	const char *m_data;
+	int m_nSize;
+};
+
+// forward-only scanner over the lwscode subset, working on raw UTF-8 bytes
+class LSvgMappedReader
+{
+public:
+	LSvgMappedReader(const char *data, qint64 size);
+
+	bool atEnd() const;
+	const char *position() const { return m_pos; }
+	const char *elementBegin() const { return m_elementBegin; }
+	bool isEmptyElement() const { return m_bEmptyElement; }
+	bool readNextStartElement();
+
+	LByteView name() const;
+	SvgTag tag() const { return m_tag; }
+	LByteView attribute(SvgAttribute id) const { return m_attributes[id]; }
+	LByteView readElementText();
+	LByteView readElementContent();
+
+private:
+	void skipPast(const char *pattern, int length);
+
+private:
+	const char *m_begin;
+	const char *m_end;
+	const char *m_pos;
+	const char *m_elementBegin;
+	LByteView m_name;
+	SvgTag m_tag;
+	// the attributes of the current element, read in one pass with its tag
+	LByteView m_attributes[SvgAttribute::AttrCount];
+	bool m_bEmptyElement;
+};
+
+// the attributes of the current stream element, read in one pass; the views
+// point into the reader's buffer and stay valid until it advances
+struct LSvgAttributes
+{
+	QStringView values[SvgAttribute::AttrCount];
+};
+
+// receives items as soon as they are built during a progressive load, possibly
+// from several threads at once
+class LCanvasReadHandler
+{
+public:
+	virtual ~LCanvasReadHandler() {}
+	virtual void readItems(const LCanvasItemList &items) = 0;
+};
+
+class LCanvasReader
+{
+	friend class LCanvasReadTask;
+	friend class LCanvasElementReadTask;
+
+public:
+	LCanvasReader();
+
+	void setProgress(LCanvasProgress *progress);
+	void setHandler(LCanvasReadHandler *handler, const QRect &priorityRect);
+	bool read(const QString &filePath);
+	LCanvasItemList items() const;
+	QSize canvasSize() const;
+
+private:
+	bool readMapped(const char *data, qint64 size);
+	void readRange(const char *begin, const char *end);
+	bool readProgressive(const QVector<const char *> &elements, const char *end);
+	void readElements(const char * const *elements, const int *indices, int count,
+					  const char *end, SPtrLCanvasItem *items);
+	bool readStream(QIODevice *device);
+	SPtrLCanvasItem readItem(LSvgMappedReader &reader);
+	SPtrLCanvasItem readGroup(const LSvgMappedReader &reader, const LByteView &content);
+	void readDefinitions(const LByteView &content);
+	QRect elementBounds(LSvgMappedReader &reader);
+	SPtrLCanvasItem readItemFromXml(SvgTag tag, const LSvgAttributes &attributes, QXmlStreamReader &reader);
+	void appendItem(SPtrLCanvasItem item);
+
+	static QVector<const char *> partitionElements(const char *begin, const char *end, int partitions);
+	static bool scanElements(const char *begin, const char *end, QVector<const char *> &elements);
+
+private:
+	LCanvasItemList m_items;
+	QSize m_canvasSize;
+	LCanvasProgress *m_progress;
+	LCanvasReadHandler *m_handler;
+	QRect m_priorityRect;
+	bool m_bDeferText;
+	QVector<QPair<int, const char *> > m_deferredTexts;
+	QHash<QString, SPtrLCanvasSymbol> m_symbols;
+};
+
+} // namespace
+
+#endif // LCANVASREADER_H
@@ -0,0 +1,92 @@
+#ifndef LCANVASRECORDER_H
+#define LCANVASRECORDER_H
+
+#include "lcanvasitem.h"
+
+namespace lwscode {
+
+class LCanvasView;
+
+enum InputRecordType {
+	NoneRecord = 0,
+	MouseRecord,
+	WheelRecord,
+	ActionRecord,
+	ChecksumRecord
+};
+
+// edits that reach the view through slots rather than input events
+enum InputAction {
+	NoneAction = 0,
+	ItemTypeAction,
+	FillColorAction,
+	StrokeColorAction,
+	StrokeWidthAction,
+	TextAction,
+	ClearAction,
+	CopyAction,
+	PasteAction,
+	DeleteAction,
+	MoveTopAction,
+	MoveUpAction,
+	MoveDownAction,
+	MoveBottomAction,
+	GroupAction,
+	UngroupAction,
+	SymbolAction,
+	ResizeAction
+};
+
+struct LInputRecord
+{
+	quint8 type;
+	qint64 time;
+	qint32 eventType;
+	QPoint pos;
+	quint32 button;
+	quint32 buttons;
+	quint32 modifiers;
+	QPoint pixelDelta;
+	QPoint angleDelta;
+	quint8 action;
+	QVariant value;
+	quint64 checksum;
+};
+
+// writes the input a view receives to a session file, which replay() feeds
+// back into a fresh view as fast as it can, timing every event
+class LCanvasRecorder : public QObject
+{
+	Q_OBJECT
+
+public:
+	LCanvasRecorder(LCanvasView *view);
+	~LCanvasRecorder();
+
+	bool start(const QString &sessionPath, const QString &documentPath);
+	void stop();
+	bool isRecording() const;
+	void recordAction(InputAction action, const QVariant &value = QVariant());
+
+	static bool replay(const QString &sessionPath, const QString &documentPath, QTextStream &report);
+
+protected:
+	bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+	void writeRecord(const LInputRecord &record);
+
+	static LInputRecord emptyRecord();
+	static bool readRecord(QDataStream &stream, LInputRecord &record);
+	static QEvent *createEvent(const LInputRecord &record);
+
+private:
+	LCanvasView *m_view;
+	QFile m_file;
+	QDataStream m_stream;
+	QElapsedTimer m_timer;
+};
+
+} // namespace
+
+#endif // LCANVASRECORDER_H
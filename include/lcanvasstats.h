@@ -0,0 +1,75 @@
+#ifndef LCANVASSTATS_H
+#define LCANVASSTATS_H
+
+#include <QtWidgets>
+
+namespace lwscode {
+
+enum PaintPhase {
+	ItemsPhase,
+	SelectionPhase,
+	OverlayPhase,
+	PhaseCount
+};
+
+// counters of one paintEvent; times are in nanoseconds
+struct LCanvasFrameStats
+{
+	qint64 frameTime;
+	qint64 phaseTimes[PaintPhase::PhaseCount];
+	int itemsDrawn;
+	int itemsCulled;
+	qint64 cacheHits;
+	qint64 cacheMisses;
+	qint64 dirtyArea;
+	// from the first input event not yet shown to the end of the frame showing
+	// it, -1 when the frame was not caused by input
+	qint64 inputLatency;
+};
+
+// collects per-frame engine counters over a rolling window and draws them as
+// an overlay; readable by benchmarks whether or not the overlay is shown
+class LCanvasStats
+{
+public:
+	LCanvasStats();
+
+	void beginFrame(const QRegion &dirtyRegion);
+	void beginPhase(PaintPhase phase);
+	void endPhase(PaintPhase phase);
+	void addDrawn(int count);
+	void addCulled(int count);
+	void markInput();
+	void endFrame();
+	void reset();
+
+	int frameCount() const;
+	LCanvasFrameStats lastFrame() const;
+	LCanvasFrameStats averageFrame() const;
+	QVector<LCanvasFrameStats> history() const;
+	QVector<int> histogram(qint64 bucketTime, int bucketCount) const;
+
+	void paintOverlay(QPainter &painter, const QPoint &pos) const;
+
+	// the raster and pick caches count their lookups here, from any view; a
+	// frame takes the lookups made since the frame before it
+	static void addCacheHit();
+	static void addCacheMiss();
+
+private:
+	QElapsedTimer m_frameTimer;
+	QElapsedTimer m_phaseTimer;
+	QElapsedTimer m_inputTimer;
+	bool m_bInputPending;
+	LCanvasFrameStats m_current;
+	QVector<LCanvasFrameStats> m_history;
+	int m_nNext;
+	int m_nCount;
+	// the shared counters as the last frame left them
+	qint64 m_nCacheHits;
+	qint64 m_nCacheMisses;
+};
+
+} // namespace
+
+#endif // LCANVASSTATS_H
@@ -0,0 +1,66 @@
+#ifndef LCANVASTRACE_H
+#define LCANVASTRACE_H
+
+#include <QtWidgets>
+
+namespace lwscode {
+
+// records scoped events from any thread and writes them as Chrome trace JSON,
+// for chrome://tracing or Perfetto; the trace points below only exist in
+// builds configured with SVGEDITOR_ENABLE_TRACE
+class LCanvasTrace
+{
+public:
+	static bool isAvailable();
+	static void start();
+	static void stop();
+	static bool isRecording();
+	static bool write(const QString &filePath);
+
+	static qint64 now();
+	static void addEvent(const char *category, const char *name, qint64 begin, qint64 duration, qint64 arg);
+};
+
+class LCanvasTraceScope
+{
+public:
+	LCanvasTraceScope(const char *category, const char *name, qint64 arg = -1)
+		: m_category(category)
+		, m_name(name)
+		, m_nArg(arg)
+		, m_nBegin(LCanvasTrace::isRecording() ? LCanvasTrace::now() : -1)
+	{
+	}
+
+	~LCanvasTraceScope()
+	{
+		if (m_nBegin >= 0)
+			LCanvasTrace::addEvent(m_category, m_name, m_nBegin, LCanvasTrace::now() - m_nBegin, m_nArg);
+	}
+
+private:
+	Q_DISABLE_COPY(LCanvasTraceScope)
+
+	const char *m_category;
+	const char *m_name;
+	qint64 m_nArg;
+	qint64 m_nBegin;
+};
+
+} // namespace
+
+#define LCANVAS_TRACE_CONCAT_(a, b) a##b
+#define LCANVAS_TRACE_CONCAT(a, b) LCANVAS_TRACE_CONCAT_(a, b)
+
+// category and name must be string literals, they are kept by pointer
+#ifdef LCANVAS_TRACE_ENABLED
+#define LCANVAS_TRACE(category, name) \
+	lwscode::LCanvasTraceScope LCANVAS_TRACE_CONCAT(traceScope, __LINE__)(category, name)
+#define LCANVAS_TRACE_ARG(category, name, arg) \
+	lwscode::LCanvasTraceScope LCANVAS_TRACE_CONCAT(traceScope, __LINE__)(category, name, arg)
+#else
+#define LCANVAS_TRACE(category, name) do {} while (0)
+#define LCANVAS_TRACE_ARG(category, name, arg) do {} while (0)
+#endif
+
+#endif // LCANVASTRACE_H
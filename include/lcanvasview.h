@@ -2,11 +2,15 @@
 #define LCANVASVIEW_H
 
 #include "lcanvasitem.h"
+#include "lcanvasfiletask.h"
+#include "lcanvasjournal.h"
+#include "lcanvasstats.h"
+#include "lcanvasrecorder.h"
+#include "lcanvasmemory.h"
+#include "lcanvaspick.h"
 
 namespace lwscode {
 
-typedef QList<SPtrLCanvasItem> LCanvasItemList;
-
 enum HitTestStatus
 {
 	NoneStatus = 0x00000000,
@@ -42,16 +46,41 @@ public:
 	void setFillColor(const QColor &color);
 	void setStrokeColor(const QColor &color);
 	void setStrokeWidth(int width);
+	void setCanvasSize(const QSize &size);
 	void clearCanvas();
 	bool existItems();
+	bool isFileTaskRunning() const;
+	bool recoverFromJournal();
+	void setJournalEnabled(bool enabled);
+	bool isJournalEnabled() const;
+	bool isStatsVisible() const;
+	const LCanvasStats &stats() const;
+	bool startRecording(const QString &sessionPath);
+	void stopRecording();
+	bool isRecording() const;
+	void applyAction(InputAction action, const QVariant &value);
+	quint64 documentChecksum();
+	LCanvasMemoryReport memoryReport() const;
+
+signals:
+	void fileTaskStarted(const QString &filePath);
+	void fileTaskProgress(int value);
+	void fileTaskFinished(bool success);
+	void geometryShared(const QString &summary);
+
+public slots:
+	void cancelFileTask();
+	void setStatsVisible(bool visible);
+	void setShareGeometry(bool share);
 
 protected:
-	void paintEvent(QPaintEvent *);
+	void paintEvent(QPaintEvent *event);
 	void mousePressEvent(QMouseEvent *event);
 	void mouseMoveEvent(QMouseEvent *event);
 	void mouseReleaseEvent(QMouseEvent *event);
 	void mouseDoubleClickEvent(QMouseEvent *event);
 	void wheelEvent(QWheelEvent *event);
+	void resizeEvent(QResizeEvent *event);
 	void contextMenuEvent(QContextMenuEvent *event);
 
 protected slots:
@@ -68,6 +97,15 @@ protected slots:
 	void moveUpItem();
 	void moveDownItem();
 	void moveBottomItem();
+	void groupItems();
+	void ungroupItems();
+	void makeSymbol();
+
+private slots:
+	void updateFileTaskProgress();
+	void appendLoadedItems(const LCanvasItemList &items);
+	void finishFileTask(bool success, const LCanvasItemList &items);
+	void reportSharedGeometry(const QString &summary);
 
 private:
 	ItemHitPos getItemHitPos(const QPoint &point);
@@ -77,10 +115,22 @@ private:
 	void setCursorByPos(const QPoint &pos);
 	void deselectAllItems();
 	void paintRubberBand(SPtrLCanvasItem item, QPainter &painter, bool flag = false);
+	void paintHandles(const QRect &rect, QPainter &painter);
 	void startMouseAction(const QPoint &pos);
 	void hitTest(const QPoint &pos);
+	SPtrLCanvasItem pickItem(const QPoint &pos);
 	void resizeSelectedItem(const QPoint &pos);
-	void readItemFromXml(ItemType itemType, QXmlStreamReader &reader);
+	QRect selectionRect();
+	QRect selectionGeometryRect();
+	QRect resizeHandleRect();
+	QTransform selectionTransform(const SPtrLCanvasItem &item);
+	void commitSelectionTransform();
+	void startFileTask(FileTaskMode mode, const QString &filePath);
+	void replaceItems(const LCanvasItemList &items);
+	QVector<int> selectedIndices() const;
+	SPtrLCanvasItem detachSelectedItem(int index);
+	void compactJournal();
+	void recordAction(InputAction action, const QVariant &value = QVariant());
 
 private:
 	ItemType m_itemType;
@@ -89,6 +139,9 @@ private:
 	LCanvasItemList m_textItems;
 	LCanvasItemList m_selectedItems;
 	LCanvasItemList m_duplicatedItems;
+	// the group a text being edited was taken out of, and where
+	SPtrLCanvasItem m_textGroup;
+	QVector<int> m_textPath;
 	QLineEdit *m_lineEdit;
 	QMenu *m_rightClickMenu;
 	QColor m_canvasColor;
@@ -109,6 +162,28 @@ private:
 	QRect m_bottomLeftPos;
 	QRect m_middleLeftPos;
 	QRect m_selectedBox;
+	QPoint m_selectionOffset;
+	QTransform m_selectionTransform;
+	QRect m_resizeBox;
+	QMargins m_resizeMargins;
+	QPoint m_resizeGrab;
+	QThreadPool m_fileTaskPool;
+	QSharedPointer<LCanvasProgress> m_fileTaskProgress;
+	FileTaskMode m_fileTaskMode;
+	QString m_fileTaskPath;
+	QTimer *m_fileTaskTimer;
+	LCanvasItemList m_replacedItems;
+	// items a running save shares with the view; they are copied before an edit
+	QSet<const LCanvasItem *> m_savingItems;
+	bool m_bLoadingPreview;
+	bool m_bShareGeometry;
+	int m_nSymbolNumber;
+	LCanvasPickBuffer m_pickBuffer;
+	bool m_bPickSynced;
+	LCanvasJournal m_journal;
+	LCanvasStats m_stats;
+	bool m_bStatsVisible;
+	QScopedPointer<LCanvasRecorder> m_recorder;
 };
 
 } // namespace
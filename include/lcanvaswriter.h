@@ -0,0 +1,184 @@
+#ifndef LCANVASWRITER_H
+#define LCANVASWRITER_H
+
+#include "lcanvasitem.h"
+#include "lcanvasprogress.h"
+
+namespace lwscode {
+
+// attribute names pre-rendered with their leading space and opening quote
+namespace SvgAttr {
+static const char D[] = " d=\"";
+static const char X[] = " x=\"";
+static const char Y[] = " y=\"";
+static const char X1[] = " x1=\"";
+static const char Y1[] = " y1=\"";
+static const char X2[] = " x2=\"";
+static const char Y2[] = " y2=\"";
+static const char Cx[] = " cx=\"";
+static const char Cy[] = " cy=\"";
+static const char Rx[] = " rx=\"";
+static const char Ry[] = " ry=\"";
+static const char Width[] = " width=\"";
+static const char Height[] = " height=\"";
+static const char Points[] = " points=\"";
+static const char Fill[] = " fill=\"";
+static const char Stroke[] = " stroke=\"";
+static const char StrokeWidth[] = " stroke-width=\"";
+static const char FontFamily[] = " font-family=\"";
+static const char FontSize[] = " font-size=\"";
+static const char Subset[] = " subset=\"";
+static const char Xmlns[] = " xmlns=\"";
+static const char Id[] = " id=\"";
+static const char Href[] = " href=\"";
+static const char Transform[] = " transform=\"";
+}
+
+// streams svg markup as UTF-8 into a reusable buffer that is handed to the
+// device in large blocks; a lean replacement for QXmlStreamWriter on save
+class LSvgStreamWriter
+{
+public:
+	explicit LSvgStreamWriter(QIODevice *device);
+
+	void setMinified(bool minified);
+	bool isMinified() const;
+	void setPathQuantum(int quantum);
+	int pathQuantum() const;
+	bool hasError() const;
+	qint64 position() const;
+
+	void writeStartDocument();
+	void writeEndDocument();
+	void writeStartElement(const char *name);
+	void writeEndElement();
+	void writeCharacters(const QString &text);
+	qint64 beginBlock();
+	void writeRaw(const char *data, qint64 size);
+
+	template <int N>
+	void writeAttribute(const char (&attr)[N], int value)
+	{
+		m_buffer.append(attr, N - 1);
+		appendNumber(value);
+		m_buffer.append('"');
+	}
+
+	template <int N>
+	void writeAttribute(const char (&attr)[N], const QColor &color)
+	{
+		m_buffer.append(attr, N - 1);
+		appendColor(color);
+		m_buffer.append('"');
+	}
+
+	template <int N>
+	void writeAttribute(const char (&attr)[N], const QString &value)
+	{
+		m_buffer.append(attr, N - 1);
+		appendEscaped(value);
+		m_buffer.append('"');
+	}
+
+	template <int N, int M>
+	void writeAttribute(const char (&attr)[N], const char (&value)[M])
+	{
+		m_buffer.append(attr, N - 1);
+		m_buffer.append(value, M - 1);
+		m_buffer.append('"');
+	}
+
+	template <int N>
+	void writeAttribute(const char (&attr)[N], const QTransform &transform)
+	{
+		m_buffer.append(attr, N - 1);
+		appendTransform(transform);
+		m_buffer.append('"');
+	}
+
+	template <int N>
+	void writePathAttribute(const char (&attr)[N], const QPoints &points)
+	{
+		m_buffer.append(attr, N - 1);
+		appendPath(points);
+		m_buffer.append('"');
+	}
+
+	template <int N>
+	void writePointsAttribute(const char (&attr)[N], const QPoints &points)
+	{
+		m_buffer.append(attr, N - 1);
+		appendPoints(points);
+		m_buffer.append('"');
+	}
+
+	static int formatNumber(char *out, int value);
+
+private:
+	void appendNumber(int value);
+	void appendColor(const QColor &color);
+	void appendTransform(const QTransform &transform);
+	void appendEscaped(const QString &text);
+	void appendPath(const QPoints &points);
+	void appendCompactPath(const QPoints &points);
+	void appendCompactNumber(int value);
+	void appendPoints(const QPoints &points);
+	void appendIndent();
+	void closeStartTag();
+	void flushBlock();
+
+private:
+	struct Element
+	{
+		const char *name;
+		bool hasChildren;
+	};
+
+	QIODevice *m_device;
+	qint64 m_nWritten;
+	QByteArray m_buffer;
+	QVector<Element> m_elements;
+	bool m_bMinified;
+	int m_nPathQuantum;
+	bool m_bStartTagOpen;
+	bool m_bError;
+};
+
+// where an item's markup sits in a saved file, keyed by its content hash
+struct LSaveBlock
+{
+	quint64 hash;
+	qint64 offset;
+	qint64 size;
+};
+
+// a saved file is a sequence of item blocks; the sidecar index lets the next
+// save copy the blocks of unchanged items instead of formatting them again
+class LCanvasWriter
+{
+public:
+	LCanvasWriter();
+
+	void setProgress(LCanvasProgress *progress);
+	void setMinified(bool minified);
+	void setPathQuantum(int quantum);
+	bool write(const QString &filePath, const LCanvasItemList &items, const QSize &canvasSize);
+	QByteArray toByteArray(const LCanvasItemList &items, const QSize &canvasSize);
+
+private:
+	void writeStartDocument(LSvgStreamWriter &writer, const QSize &canvasSize) const;
+	void writeSymbols(LSvgStreamWriter &writer, const LCanvasItemList &items) const;
+	QVector<LSaveBlock> readIndex(const QString &filePath) const;
+	void writeIndex(const QString &filePath, const QVector<LSaveBlock> &blocks) const;
+
+	static QString indexPath(const QString &filePath);
+
+private:
+	LCanvasProgress *m_progress;
+	bool m_bMinified;
+	int m_nPathQuantum;
+};
+
+} // namespace
+
+#endif // LCANVASWRITER_H
@@ -37,6 +37,14 @@ protected slots:
 	void setFillColor();
 	void setStrokeColor();
 	void setStrokeWidth(int width);
+	void onFileTaskStarted(const QString &filePath);
+	void onFileTaskProgress(int value);
+	void onFileTaskFinished(bool success);
+	void onGeometryShared(const QString &summary);
+	void onRecordTrace(bool checked);
+	void onRecordInput(bool checked);
+	void onShowMemoryUsage();
+	void updateMemoryUsage();
 
 private:
 	void initUI();
@@ -45,6 +53,7 @@ private:
 	void initLeftToolBar();
 	void initRightToolBar();
 	void initBottomToolBar();
+	void initStatusBar();
 
 private:
 	QMenuBar *m_mainMenuBar;
@@ -54,6 +63,10 @@ private:
 	QScrollArea *m_centralWidget;
 	LCanvasView *m_canvas;
 	QPushButton *m_canvasColorButton;
+	QLabel *m_fileTaskLabel;
+	QProgressBar *m_fileTaskProgressBar;
+	QToolButton *m_fileTaskCancelButton;
+	LCanvasMemoryPanel *m_memoryPanel;
 	QColor m_canvasColor;
 	int m_canvasWidth;
 	int m_canvasHeight;
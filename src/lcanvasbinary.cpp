@@ -0,0 +1,471 @@
+#include "lcanvasbinary.h"
+#include "lcanvasreader.h"
+#include "lcanvaswriter.h"
+#include "lcanvastrace.h"
+
+namespace lwscode {
+
+static const char BinaryMagic[4] = { 'L', 'W', 'S', 'B' };
+static const quint32 BinaryVersion = 1;
+
+Q_STATIC_ASSERT(sizeof(LBinaryHeader) == 48);
+Q_STATIC_ASSERT(sizeof(LBinaryStyle) == 16);
+Q_STATIC_ASSERT(sizeof(LBinaryItem) == 52);
+Q_STATIC_ASSERT(sizeof(LBinaryPoint) == 8);
+
+static bool validRange(quint32 offset, quint64 count, quint64 size, qint64 fileSize)
+{
+	return offset % 4 == 0 && quint64(offset) + count * size <= quint64(fileSize);
+}
+
+static quint32 appendString(QByteArray &strings, QHash<QString, quint32> &offsets, const QString &string)
+{
+	auto it = offsets.constFind(string);
+	if (it != offsets.constEnd())
+		return it.value();
+
+	quint32 offset = quint32(strings.size());
+	strings += string.toUtf8();
+	offsets.insert(string, offset);
+	return offset;
+}
+
+// groups are stored ahead of their children, depth first
+static void flattenItems(const LCanvasItemList &items, LCanvasItemList &flat)
+{
+	foreach (auto &item, items)
+	{
+		flat << item;
+		flattenItems(item->children(), flat);
+	}
+}
+
+// svg matrix order, m11 m12 m21 m22 dx dy
+static QString transformString(const QTransform &transform)
+{
+	return QString::fromUtf8("%1 %2 %3 %4 %5 %6")
+			.arg(transform.m11(), 0, 'g', 17).arg(transform.m12(), 0, 'g', 17)
+			.arg(transform.m21(), 0, 'g', 17).arg(transform.m22(), 0, 'g', 17)
+			.arg(transform.dx(), 0, 'g', 17).arg(transform.dy(), 0, 'g', 17);
+}
+
+static void appendPadding(QByteArray &data)
+{
+	while (data.size() % 4)
+		data += '\0';
+}
+
+LCanvasBinaryFormat::LCanvasBinaryFormat()
+	: m_progress(nullptr)
+{
+
+}
+
+void LCanvasBinaryFormat::setProgress(LCanvasProgress *progress)
+{
+	m_progress = progress;
+}
+
+bool LCanvasBinaryFormat::read(const QString &filePath)
+{
+	LCANVAS_TRACE("load", "readBinary");
+
+	m_items.clear();
+	m_symbols.clear();
+
+	if (filePath.isEmpty() || QSysInfo::ByteOrder != QSysInfo::LittleEndian)
+		return false;
+
+	QFile file(filePath);
+	if (!file.open(QFile::ReadOnly) || file.size() < qint64(sizeof(LBinaryHeader)))
+		return false;
+
+	uchar *data = file.map(0, file.size());
+	if (!data)
+		return false;
+
+	bool result = readMapped(reinterpret_cast<const char *>(data), file.size());
+	file.unmap(data);
+	file.close();
+
+	return result;
+}
+
+bool LCanvasBinaryFormat::write(const QString &filePath, const LCanvasItemList &items, const QSize &canvasSize)
+{
+	LCANVAS_TRACE_ARG("save", "writeBinary", items.size());
+
+	if (filePath.isEmpty() || QSysInfo::ByteOrder != QSysInfo::LittleEndian)
+		return false;
+
+	// symbols go first, each as its master group followed by the master's children
+	LCanvasItemList flat;
+	flat.reserve(items.size());
+	QHash<const LCanvasItem *, QString> masters;
+	foreach (auto &symbol, LCanvasSymbol::collect(items))
+	{
+		masters.insert(symbol->master().data(), symbol->id());
+		flattenItems(LCanvasItemList() << symbol->master(), flat);
+	}
+	flattenItems(items, flat);
+
+	if (m_progress)
+		m_progress->setTotal(flat.size());
+
+	QVector<LBinaryItem> records;
+	QVector<LBinaryStyle> styles;
+	QVector<LBinaryPoint> points;
+	QByteArray strings;
+	QHash<QString, quint32> stringOffsets;
+	QHash<QByteArray, quint32> styleIndices;
+	records.reserve(flat.size());
+
+	for (int i = 0; i < flat.size(); ++i)
+	{
+		const SPtrLCanvasItem &item = flat[i];
+
+		LBinaryStyle style;
+		style.fill = item->fillColor().rgba();
+		style.stroke = item->strokeColor().rgba();
+		style.strokeWidth = item->strokeWidth();
+		style.flags = (item->fillColor().isValid() ? BinaryStyleFlag::FillValid : 0)
+				| (item->strokeColor().isValid() ? BinaryStyleFlag::StrokeValid : 0);
+
+		int overrides = item->styleOverrides();
+		style.flags |= ((overrides & StyleOverride::FillOverride) ? BinaryStyleFlag::FillOverridden : 0)
+				| ((overrides & StyleOverride::StrokeOverride) ? BinaryStyleFlag::StrokeOverridden : 0)
+				| ((overrides & StyleOverride::StrokeWidthOverride) ? BinaryStyleFlag::StrokeWidthOverridden : 0);
+
+		QByteArray styleKey(reinterpret_cast<const char *>(&style), sizeof(style));
+		auto styleIt = styleIndices.constFind(styleKey);
+		if (styleIt == styleIndices.constEnd())
+		{
+			styleIt = styleIndices.insert(styleKey, quint32(styles.size()));
+			styles << style;
+		}
+
+		LBinaryItem record;
+		memset(&record, 0, sizeof(record));
+		record.type = item->getItemType();
+		record.style = styleIt.value();
+		record.x1 = item->startPos().x();
+		record.y1 = item->startPos().y();
+		record.x2 = item->endPos().x();
+		record.y2 = item->endPos().y();
+
+		if (item->getItemType() == ItemType::Path)
+		{
+			QPoints itemPoints = item->points();
+			record.pointIndex = quint32(points.size());
+			record.pointCount = quint32(itemPoints.size());
+			foreach (auto &point, itemPoints)
+			{
+				LBinaryPoint binaryPoint = { point.x(), point.y() };
+				points << binaryPoint;
+			}
+		}
+		else if (item->getItemType() == ItemType::Text)
+		{
+			QString text = item->text();
+			QString family = item->font().family();
+			record.textOffset = appendString(strings, stringOffsets, text);
+			record.textSize = quint32(text.toUtf8().size());
+			record.fontOffset = appendString(strings, stringOffsets, family);
+			record.fontSize = quint32(family.toUtf8().size());
+			record.fontPointSize = item->font().pointSize();
+		}
+		else if (item->getItemType() == ItemType::Group)
+		{
+			record.pointCount = quint32(item->children().size());
+
+			auto master = masters.constFind(item.data());
+			if (master != masters.constEnd())
+			{
+				record.type = BinaryRecordType::SymbolRecord;
+				record.textOffset = appendString(strings, stringOffsets, master.value());
+				record.textSize = quint32(master.value().toUtf8().size());
+			}
+		}
+		else if (item->getItemType() == ItemType::Instance && item->symbol())
+		{
+			QString id = item->symbol()->id();
+			QString transform = transformString(item->transform());
+			record.textOffset = appendString(strings, stringOffsets, id);
+			record.textSize = quint32(id.toUtf8().size());
+			record.fontOffset = appendString(strings, stringOffsets, transform);
+			record.fontSize = quint32(transform.toUtf8().size());
+		}
+		records << record;
+
+		if (m_progress && (i & 0xfff) == 0xfff)
+		{
+			if (m_progress->isCanceled())
+				return false;
+			m_progress->advance(0x1000);
+		}
+	}
+	appendPadding(strings);
+
+	LBinaryHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BinaryMagic, sizeof(BinaryMagic));
+	header.version = BinaryVersion;
+	header.canvasWidth = canvasSize.width();
+	header.canvasHeight = canvasSize.height();
+	header.itemCount = quint32(records.size());
+	header.itemOffset = sizeof(LBinaryHeader);
+	header.styleCount = quint32(styles.size());
+	header.styleOffset = header.itemOffset + header.itemCount * sizeof(LBinaryItem);
+	header.pointCount = quint32(points.size());
+	header.pointOffset = header.styleOffset + header.styleCount * sizeof(LBinaryStyle);
+	header.stringSize = quint32(strings.size());
+	header.stringOffset = header.pointOffset + header.pointCount * sizeof(LBinaryPoint);
+
+	QSaveFile file(filePath);
+	if (!file.open(QFile::WriteOnly))
+		return false;
+
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char *>(records.constData()), records.size() * sizeof(LBinaryItem));
+	file.write(reinterpret_cast<const char *>(styles.constData()), styles.size() * sizeof(LBinaryStyle));
+	file.write(reinterpret_cast<const char *>(points.constData()), points.size() * sizeof(LBinaryPoint));
+	file.write(strings);
+
+	if (m_progress && m_progress->isCanceled())
+	{
+		file.cancelWriting();
+		return false;
+	}
+
+	return file.commit();
+}
+
+LCanvasItemList LCanvasBinaryFormat::items() const
+{
+	return m_items;
+}
+
+QHash<QString, SPtrLCanvasSymbol> LCanvasBinaryFormat::symbols() const
+{
+	return m_symbols;
+}
+
+QSize LCanvasBinaryFormat::canvasSize() const
+{
+	return m_canvasSize;
+}
+
+bool LCanvasBinaryFormat::isBinaryFile(const QString &filePath)
+{
+	return QFileInfo(filePath).suffix().compare(QString::fromUtf8("lwsb"), Qt::CaseInsensitive) == 0;
+}
+
+bool LCanvasBinaryFormat::convert(const QString &sourcePath, const QString &targetPath,
+								  bool minified, int pathQuantum)
+{
+	LCanvasItemList items;
+	QSize canvasSize;
+	if (isBinaryFile(sourcePath))
+	{
+		LCanvasBinaryFormat format;
+		if (!format.read(sourcePath))
+			return false;
+
+		items = format.items();
+		canvasSize = format.canvasSize();
+	}
+	else
+	{
+		LCanvasReader reader;
+		if (!reader.read(sourcePath))
+			return false;
+
+		items = reader.items();
+		canvasSize = reader.canvasSize();
+	}
+
+	if (isBinaryFile(targetPath))
+	{
+		LCanvasBinaryFormat format;
+		return format.write(targetPath, items, canvasSize);
+	}
+
+	LCanvasWriter writer;
+	writer.setMinified(minified);
+	writer.setPathQuantum(pathQuantum);
+	return writer.write(targetPath, items, canvasSize);
+}
+
+bool LCanvasBinaryFormat::readMapped(const char *data, qint64 size)
+{
+	const LBinaryHeader *header = reinterpret_cast<const LBinaryHeader *>(data);
+	if (memcmp(header->magic, BinaryMagic, sizeof(BinaryMagic)) != 0 || header->version != BinaryVersion)
+		return false;
+
+	if (!validRange(header->itemOffset, header->itemCount, sizeof(LBinaryItem), size) ||
+		!validRange(header->styleOffset, header->styleCount, sizeof(LBinaryStyle), size) ||
+		!validRange(header->pointOffset, header->pointCount, sizeof(LBinaryPoint), size) ||
+		!validRange(header->stringOffset, header->stringSize, 1, size))
+	{
+		return false;
+	}
+
+	const LBinaryItem *records = reinterpret_cast<const LBinaryItem *>(data + header->itemOffset);
+	const LBinaryStyle *styles = reinterpret_cast<const LBinaryStyle *>(data + header->styleOffset);
+	const LBinaryPoint *points = reinterpret_cast<const LBinaryPoint *>(data + header->pointOffset);
+	const char *strings = data + header->stringOffset;
+
+	if (m_progress)
+		m_progress->setTotal(header->itemCount);
+
+	m_canvasSize = QSize(header->canvasWidth, header->canvasHeight);
+	m_items.reserve(int(header->itemCount));
+
+	// open groups and symbol masters with the number of children each still expects
+	struct LOpenGroup
+	{
+		SPtrLCanvasItem group;
+		quint32 remaining;
+		QString symbolId;
+	};
+	QVector<LOpenGroup> groups;
+	for (quint32 i = 0; i < header->itemCount; ++i)
+	{
+		const LBinaryItem &record = records[i];
+		bool group = record.type == ItemType::Group || record.type == BinaryRecordType::SymbolRecord;
+		if (record.style >= header->styleCount ||
+			(group && record.pointCount > header->itemCount - i - 1) ||
+			(!group && quint64(record.pointIndex) + record.pointCount > header->pointCount) ||
+			quint64(record.textOffset) + record.textSize > header->stringSize ||
+			quint64(record.fontOffset) + record.fontSize > header->stringSize)
+		{
+			return false;
+		}
+
+		SPtrLCanvasItem item;
+		QString symbolId;
+		if (record.type == BinaryRecordType::SymbolRecord)
+		{
+			item = SPtrLCanvasItem(new LCanvasGroup());
+			symbolId = QString::fromUtf8(strings + record.textOffset, int(record.textSize));
+		}
+		else
+		{
+			item = readItem(record, styles, points, strings);
+		}
+
+		// masters belong to their symbol, not to the document
+		if (!groups.isEmpty())
+		{
+			if (item && symbolId.isEmpty())
+				groups.last().group->addChild(item);
+			--groups.last().remaining;
+		}
+		else if (item && symbolId.isEmpty())
+		{
+			m_items << item;
+		}
+
+		if (item && group)
+		{
+			LOpenGroup open = { item, record.pointCount, symbolId };
+			groups << open;
+		}
+		while (!groups.isEmpty() && groups.last().remaining == 0)
+		{
+			LOpenGroup open = groups.takeLast();
+			open.group->updateGeometry();
+			if (!open.symbolId.isEmpty())
+				m_symbols.insert(open.symbolId, SPtrLCanvasSymbol(new LCanvasSymbol(open.symbolId, open.group)));
+		}
+
+		if (m_progress && (i & 0xfff) == 0xfff)
+		{
+			if (m_progress->isCanceled())
+				return false;
+			m_progress->advance(0x1000);
+		}
+	}
+
+	return true;
+}
+
+static int styleOverrides(const LBinaryStyle &style)
+{
+	return ((style.flags & BinaryStyleFlag::FillOverridden) ? StyleOverride::FillOverride : 0)
+			| ((style.flags & BinaryStyleFlag::StrokeOverridden) ? StyleOverride::StrokeOverride : 0)
+			| ((style.flags & BinaryStyleFlag::StrokeWidthOverridden) ? StyleOverride::StrokeWidthOverride : 0);
+}
+
+SPtrLCanvasItem LCanvasBinaryFormat::readItem(const LBinaryItem &record, const LBinaryStyle *styles,
+											  const LBinaryPoint *points, const char *strings)
+{
+	if (record.type == ItemType::Instance)
+		return readInstance(record, styles[record.style], strings);
+
+	SPtrLCanvasItem item = LCanvasItem::createItem(ItemType(record.type));
+	if (!item)
+		return SPtrLCanvasItem();
+
+	if (record.type == ItemType::Path)
+	{
+		if (!record.pointCount)
+			return SPtrLCanvasItem();
+
+		const LBinaryPoint *point = points + record.pointIndex;
+		for (quint32 i = 0; i < record.pointCount; ++i, ++point)
+			item->addPoint(QPoint(point->x, point->y));
+	}
+
+	// a group only has the style it overrides
+	const LBinaryStyle &style = styles[record.style];
+	int properties = StyleOverride::FillOverride | StyleOverride::StrokeOverride | StyleOverride::StrokeWidthOverride;
+	if (record.type == ItemType::Group)
+		properties = styleOverrides(style);
+	item->setStyle(properties, (style.flags & BinaryStyleFlag::FillValid) ? QColor::fromRgba(style.fill) : QColor(),
+				   (style.flags & BinaryStyleFlag::StrokeValid) ? QColor::fromRgba(style.stroke) : QColor(),
+				   style.strokeWidth);
+	item->setStartPos(QPoint(record.x1, record.y1));
+	item->setEndPos(QPoint(record.x2, record.y2));
+
+	if (record.type == ItemType::Text)
+	{
+		QFont font(QString::fromUtf8(strings + record.fontOffset, int(record.fontSize)));
+		if (record.fontPointSize > 0)
+			font.setPointSize(record.fontPointSize);
+		item->setText(QString::fromUtf8(strings + record.textOffset, int(record.textSize)));
+		item->setFont(font);
+	}
+
+	item->updateGeometry();
+
+	return item;
+}
+
+// symbols precede every record that places them
+SPtrLCanvasItem LCanvasBinaryFormat::readInstance(const LBinaryItem &record, const LBinaryStyle &style,
+												  const char *strings)
+{
+	SPtrLCanvasSymbol symbol = m_symbols.value(QString::fromUtf8(strings + record.textOffset, int(record.textSize)));
+	if (!symbol)
+		return SPtrLCanvasItem();
+
+	QList<QByteArray> values = QByteArray(strings + record.fontOffset, int(record.fontSize)).split(' ');
+	if (values.size() != 6)
+		return SPtrLCanvasItem();
+
+	LCanvasInstance *instance = new LCanvasInstance(symbol);
+	instance->setTransform(QTransform(values[0].toDouble(), values[1].toDouble(), values[2].toDouble(),
+									  values[3].toDouble(), values[4].toDouble(), values[5].toDouble()));
+	SPtrLCanvasItem item(instance);
+
+	item->setStyle(styleOverrides(style), (style.flags & BinaryStyleFlag::FillValid) ? QColor::fromRgba(style.fill) : QColor(),
+				   (style.flags & BinaryStyleFlag::StrokeValid) ? QColor::fromRgba(style.stroke) : QColor(),
+				   style.strokeWidth);
+
+	item->updateGeometry();
+
+	return item;
+}
+
+} // namespace
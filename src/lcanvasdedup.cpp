@@ -0,0 +1,259 @@
+#include "lcanvasdedup.h"
+#include "lcanvasmemory.h"
+
+namespace lwscode {
+
+LCanvasDeduplicator::LCanvasDeduplicator()
+	: m_nItemCount(0)
+	, m_nSharedCount(0)
+	, m_nInstanceCount(0)
+	, m_nBytesBefore(0)
+	, m_nBytesAfter(0)
+{
+
+}
+
+LCanvasItemList LCanvasDeduplicator::deduplicate(const LCanvasItemList &items)
+{
+	// symbols the document already has keep their ids
+	foreach (auto &symbol, LCanvasSymbol::collect(items))
+		m_symbolIds.insert(symbol->id());
+
+	LCanvasMemoryReport before;
+	before.addItems(items, MemoryScope::DocumentScope);
+	m_nBytesBefore = before.scopeBytes(MemoryScope::DocumentScope);
+
+	LCanvasItemList result = shareItems(items);
+
+	LCanvasMemoryReport after;
+	after.addItems(result, MemoryScope::DocumentScope);
+	m_nBytesAfter = after.scopeBytes(MemoryScope::DocumentScope);
+
+	return result;
+}
+
+int LCanvasDeduplicator::itemCount() const
+{
+	return m_nItemCount;
+}
+
+int LCanvasDeduplicator::sharedCount() const
+{
+	return m_nSharedCount;
+}
+
+int LCanvasDeduplicator::instanceCount() const
+{
+	return m_nInstanceCount;
+}
+
+int LCanvasDeduplicator::shapeCount() const
+{
+	return m_shapes.size() + m_symbols.size();
+}
+
+qint64 LCanvasDeduplicator::bytesBefore() const
+{
+	return m_nBytesBefore;
+}
+
+qint64 LCanvasDeduplicator::bytesAfter() const
+{
+	return m_nBytesAfter;
+}
+
+QString LCanvasDeduplicator::summary() const
+{
+	QLocale locale;
+	return QCoreApplication::translate("LCanvasDeduplicator",
+									   "%1 of %2 items share %3 shapes, %4 instances; %5 instead of %6")
+		.arg(m_nSharedCount + m_nInstanceCount).arg(m_nItemCount).arg(shapeCount()).arg(m_nInstanceCount)
+		.arg(locale.formattedDataSize(m_nBytesAfter)).arg(locale.formattedDataSize(m_nBytesBefore));
+}
+
+// children first, so groups are compared with their children already shared;
+// a group only becomes an instance when its shape repeats
+LCanvasItemList LCanvasDeduplicator::shareItems(const LCanvasItemList &items)
+{
+	LCanvasItemList sharedItems = items;
+	QVector<QPoint> anchors(items.size());
+	QVector<quint64> keys(items.size(), 0);
+	LCanvasItemList normalizedItems;
+	normalizedItems.reserve(items.size());
+	QHash<quint64, SPtrLCanvasItem> masters;
+	QHash<quint64, int> groupCounts;
+
+	for (int i = 0; i < items.size(); ++i)
+	{
+		++m_nItemCount;
+		SPtrLCanvasItem item = items[i];
+		if (item->getItemType() == ItemType::Group)
+		{
+			LCanvasItemList children = shareItems(item->children());
+			if (children != item->children())
+			{
+				// items may still be painted by the load preview, they are
+				// replaced rather than changed
+				SPtrLCanvasItem group = items[i];
+				item = LCanvasItem::createItem(ItemType::Group);
+				foreach (auto &child, children)
+					item->addChild(child);
+				item->setStyle(group->styleOverrides(), group->fillColor(), group->strokeColor(), group->strokeWidth());
+				item->updateGeometry();
+				sharedItems[i] = item;
+			}
+		}
+
+		if (!anchor(item, anchors[i]))
+		{
+			normalizedItems << SPtrLCanvasItem();
+			continue;
+		}
+
+		// the hash of a copy moved to the origin stands for the shape and style
+		SPtrLCanvasItem normalized = item->clone();
+		normalized->moveItem(-anchors[i].x(), -anchors[i].y());
+		normalizedItems << normalized;
+		keys[i] = normalized->contentHash();
+		if (item->getItemType() == ItemType::Group)
+		{
+			if (!masters.contains(keys[i]))
+				masters.insert(keys[i], normalized);
+			if (sameContent(normalized, masters.value(keys[i])))
+				++groupCounts[keys[i]];
+		}
+	}
+
+	for (int i = 0; i < sharedItems.size(); ++i)
+	{
+		quint64 key = keys[i];
+		if (key == 0)
+			continue;
+
+		if (sharedItems[i]->getItemType() == ItemType::Group)
+		{
+			if (groupCounts.value(key) < 2 && !m_symbols.contains(key))
+				continue;
+
+			SPtrLCanvasSymbol &symbol = m_symbols[key];
+			if (!symbol)
+			{
+				SPtrLCanvasItem master = masters.value(key);
+				master->updateGeometry();
+				symbol = SPtrLCanvasSymbol(new LCanvasSymbol(symbolId(), master));
+			}
+
+			// equal hashes only suggest equal groups
+			if (!sameContent(normalizedItems[i], symbol->master()))
+				continue;
+
+			LCanvasInstance *instance = new LCanvasInstance(symbol);
+			instance->setTransform(QTransform::fromTranslate(anchors[i].x(), anchors[i].y()));
+			sharedItems[i] = SPtrLCanvasItem(instance);
+			sharedItems[i]->updateGeometry();
+			++m_nInstanceCount;
+			continue;
+		}
+
+		auto it = m_shapes.constFind(key);
+		if (it == m_shapes.constEnd())
+		{
+			LSharedShape shape = { sharedItems[i], anchors[i], normalizedItems[i] };
+			m_shapes.insert(key, shape);
+			continue;
+		}
+
+		// equal hashes only suggest equal shapes, a collision keeps its own
+		if (!sameContent(normalizedItems[i], it->normalized))
+			continue;
+
+		// a copy of the first one shares its points and path until edited
+		QPoint delta = anchors[i] - it->anchor;
+		SPtrLCanvasItem copy = it->item->clone();
+		copy->moveItem(delta.x(), delta.y());
+		sharedItems[i] = copy;
+		++m_nSharedCount;
+	}
+
+	return sharedItems;
+}
+
+QString LCanvasDeduplicator::symbolId()
+{
+	int number = m_symbolIds.size() + 1;
+	while (m_symbolIds.contains(QString::fromUtf8("symbol%1").arg(number)))
+		++number;
+
+	QString id = QString::fromUtf8("symbol%1").arg(number);
+	m_symbolIds.insert(id);
+	return id;
+}
+
+// what contentHash() covers, compared field by field
+bool LCanvasDeduplicator::sameContent(const SPtrLCanvasItem &item, const SPtrLCanvasItem &other)
+{
+	if (item->getItemType() != other->getItemType() ||
+		item->startPos() != other->startPos() || item->endPos() != other->endPos() ||
+		item->fillColor() != other->fillColor() || item->strokeColor() != other->strokeColor() ||
+		item->strokeWidth() != other->strokeWidth() || item->styleOverrides() != other->styleOverrides())
+	{
+		return false;
+	}
+
+	if (item->points() != other->points() || item->vertices() != other->vertices() ||
+		item->text() != other->text() || item->font() != other->font())
+	{
+		return false;
+	}
+
+	if (item->symbol() != other->symbol() || item->transform() != other->transform())
+		return false;
+
+	LCanvasItemList children = item->children();
+	LCanvasItemList otherChildren = other->children();
+	if (children.size() != otherChildren.size())
+		return false;
+
+	for (int i = 0; i < children.size(); ++i)
+	{
+		if (!sameContent(children[i], otherChildren[i]))
+			return false;
+	}
+
+	return true;
+}
+
+// only items with geometry or text of their own are worth sharing
+bool LCanvasDeduplicator::anchor(const SPtrLCanvasItem &item, QPoint &pos)
+{
+	switch (item->getItemType())
+	{
+	case ItemType::Path:
+	{
+		QPoints points = item->points();
+		if (points.size() <= 1)
+			return false;
+		pos = points.first();
+		return true;
+	}
+	case ItemType::Text:
+	{
+		pos = item->startPos();
+		return true;
+	}
+	case ItemType::Group:
+	{
+		QRect rect = item->boundingRect();
+		if (!rect.isValid())
+			return false;
+		pos = rect.topLeft();
+		return true;
+	}
+	default:
+	{
+		return false;
+	}
+	}
+}
+
+} // namespace
@@ -0,0 +1,121 @@
+#include "lcanvasfiletask.h"
+#include "lcanvasbinary.h"
+#include "lcanvaswriter.h"
+#include "lcanvasdedup.h"
+#include "lcanvastrace.h"
+
+namespace lwscode {
+
+LCanvasFileTask::LCanvasFileTask(FileTaskMode mode, const QString &filePath,
+								 QSharedPointer<LCanvasProgress> progress, QObject *receiver)
+	: m_mode(mode)
+	, m_filePath(filePath)
+	, m_progress(progress)
+	, m_receiver(receiver)
+	, m_bShareGeometry(false)
+{
+
+}
+
+void LCanvasFileTask::setItems(const LCanvasItemList &items)
+{
+	m_items = items;
+}
+
+void LCanvasFileTask::setCanvasSize(const QSize &size)
+{
+	m_canvasSize = size;
+}
+
+void LCanvasFileTask::setPriorityRect(const QRect &rect)
+{
+	m_priorityRect = rect;
+}
+
+void LCanvasFileTask::setShareGeometry(bool share)
+{
+	m_bShareGeometry = share;
+}
+
+void LCanvasFileTask::run()
+{
+	bool success = false;
+	LCanvasItemList items;
+
+	switch (m_mode)
+	{
+	case FileTaskMode::LoadTask:
+	{
+		LCANVAS_TRACE("file", "loadTask");
+		if (LCanvasBinaryFormat::isBinaryFile(m_filePath))
+		{
+			LCanvasBinaryFormat format;
+			format.setProgress(m_progress.data());
+			success = format.read(m_filePath);
+			if (success)
+				items = format.items();
+			break;
+		}
+
+		LCanvasReader reader;
+		reader.setProgress(m_progress.data());
+		if (m_priorityRect.isValid())
+			reader.setHandler(this, m_priorityRect);
+		success = reader.read(m_filePath);
+		if (success)
+			items = reader.items();
+		break;
+	}
+	case FileTaskMode::SaveTask:
+	{
+		LCANVAS_TRACE("file", "saveTask");
+		if (LCanvasBinaryFormat::isBinaryFile(m_filePath))
+		{
+			LCanvasBinaryFormat format;
+			format.setProgress(m_progress.data());
+			success = format.write(m_filePath, m_items, m_canvasSize);
+		}
+		else
+		{
+			LCanvasWriter writer;
+			writer.setProgress(m_progress.data());
+			success = writer.write(m_filePath, m_items, m_canvasSize);
+		}
+		m_items.clear();
+		break;
+	}
+	default:
+	{
+		break;
+	}
+	}
+
+	if (success && m_mode == FileTaskMode::LoadTask && m_bShareGeometry)
+	{
+		LCANVAS_TRACE("file", "shareGeometry");
+		LCanvasDeduplicator deduplicator;
+		items = deduplicator.deduplicate(items);
+		if (m_receiver)
+		{
+			QMetaObject::invokeMethod(m_receiver, "reportSharedGeometry", Qt::QueuedConnection,
+									  Q_ARG(QString, deduplicator.summary()));
+		}
+	}
+
+	if (m_receiver)
+	{
+		QMetaObject::invokeMethod(m_receiver, "finishFileTask", Qt::QueuedConnection,
+								  Q_ARG(bool, success), Q_ARG(LCanvasItemList, items));
+	}
+}
+
+void LCanvasFileTask::readItems(const LCanvasItemList &items)
+{
+	if (m_receiver)
+	{
+		QMetaObject::invokeMethod(m_receiver, "appendLoadedItems", Qt::QueuedConnection,
+								  Q_ARG(LCanvasItemList, items));
+	}
+}
+
+} // namespace
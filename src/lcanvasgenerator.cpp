@@ -0,0 +1,332 @@
+#include "lcanvasgenerator.h"
+#include "lcanvasbinary.h"
+#include "lcanvaswriter.h"
+
+namespace lwscode {
+
+static const char *TypeNames[] = { "path", "line", "rect", "ellipse", "triangle", "hexagon", "text" };
+
+LCanvasGenerator::LCanvasGenerator()
+	: m_nItemCount(1000)
+	, m_nSeed(1)
+	, m_canvasSize(2000, 2000)
+	, m_distribution(GeneratorDistribution::UniformDistribution)
+	, m_nClusterCount(16)
+	, m_fOverlap(1.0)
+	, m_nMinPathPoints(2)
+	, m_nMaxPathPoints(16)
+	, m_nStyleCount(0)
+	, m_nGroupSize(0)
+	, m_nSymbolCount(0)
+{
+	for (auto &weight : m_typeWeights)
+		weight = 1;
+}
+
+void LCanvasGenerator::setItemCount(int count)
+{
+	m_nItemCount = qMax(0, count);
+}
+
+void LCanvasGenerator::setSeed(quint32 seed)
+{
+	m_nSeed = seed;
+}
+
+void LCanvasGenerator::setCanvasSize(const QSize &size)
+{
+	if (size.isValid())
+		m_canvasSize = size;
+}
+
+void LCanvasGenerator::setBounds(const QRect &bounds)
+{
+	m_bounds = bounds;
+}
+
+void LCanvasGenerator::setTypeWeight(ItemType itemType, int weight)
+{
+	if (itemType >= ItemType::Path && itemType <= ItemType::Text)
+		m_typeWeights[itemType] = qMax(0, weight);
+}
+
+bool LCanvasGenerator::setTypeMix(const QString &mix)
+{
+	// "rect=3,path=1": types left out are not generated
+	int weights[ItemType::Text + 1] = {};
+	foreach (auto &entry, mix.split(QLatin1Char(','), Qt::SkipEmptyParts))
+	{
+		QStringList pair = entry.split(QLatin1Char('='));
+		bool ok = pair.size() == 1;
+		int weight = ok ? 1 : pair.value(1).toInt(&ok);
+		if (!ok || weight < 0)
+			return false;
+
+		int type = ItemType::NoneType;
+		for (int i = 0; i <= ItemType::Text; ++i)
+		{
+			if (pair.first().trimmed() == QLatin1String(TypeNames[i]))
+				type = i;
+		}
+		if (type == ItemType::NoneType)
+			return false;
+
+		weights[type] = weight;
+	}
+
+	int total = 0;
+	for (auto weight : weights)
+		total += weight;
+	if (total == 0)
+		return false;
+
+	memcpy(m_typeWeights, weights, sizeof(weights));
+	return true;
+}
+
+void LCanvasGenerator::setDistribution(GeneratorDistribution distribution, int clusterCount)
+{
+	m_distribution = distribution;
+	m_nClusterCount = qMax(1, clusterCount);
+}
+
+void LCanvasGenerator::setOverlap(double overlap)
+{
+	if (overlap > 0)
+		m_fOverlap = overlap;
+}
+
+void LCanvasGenerator::setPathLength(int minPoints, int maxPoints)
+{
+	m_nMinPathPoints = qMax(2, minPoints);
+	m_nMaxPathPoints = qMax(m_nMinPathPoints, maxPoints);
+}
+
+void LCanvasGenerator::setStyleCount(int count)
+{
+	m_nStyleCount = qMax(0, count);
+}
+
+// runs of this many consecutive items are wrapped in a group, 0 or 1 keeps
+// the document flat; with the grid distribution a run is a strip of a row
+void LCanvasGenerator::setGroupSize(int size)
+{
+	m_nGroupSize = qMax(0, size);
+}
+
+// every item, or group with a group size, becomes an instance of one of the
+// first count of them, placed where it was generated; 0 keeps the geometry
+void LCanvasGenerator::setSymbolCount(int count)
+{
+	m_nSymbolCount = qMax(0, count);
+}
+
+QSize LCanvasGenerator::canvasSize() const
+{
+	return m_canvasSize;
+}
+
+LCanvasItemList LCanvasGenerator::generate() const
+{
+	QRandomGenerator generator(m_nSeed);
+	LCanvasItemList items;
+	items.reserve(m_nItemCount);
+
+	int total = 0;
+	for (auto weight : m_typeWeights)
+		total += weight;
+	if (m_nItemCount == 0 || total == 0)
+		return items;
+
+	QRect bounds = m_bounds.isValid() ? m_bounds : QRect(QPoint(0, 0), m_canvasSize);
+
+	// overlap is the mean number of items over any point, which fixes the
+	// mean item area for the given count
+	double area = m_fOverlap * bounds.width() * bounds.height() / m_nItemCount;
+	int side = qBound(2, int(qSqrt(area)), qMax(2, qMin(bounds.width(), bounds.height()) / 2));
+
+	QVector<QPoint> clusters;
+	if (m_distribution == GeneratorDistribution::ClusteredDistribution)
+	{
+		for (int i = 0; i < m_nClusterCount; ++i)
+			clusters << QPoint(generator.bounded(bounds.left(), bounds.right() + 1),
+							   generator.bounded(bounds.top(), bounds.bottom() + 1));
+	}
+
+	QVector<LGeneratorStyle> styles;
+	for (int i = 0; i < m_nStyleCount; ++i)
+		styles << randomStyle(generator);
+
+	for (int i = 0; i < m_nItemCount; ++i)
+	{
+		ItemType type = pickType(generator, total);
+		SPtrLCanvasItem item = LCanvasItem::createItem(type);
+
+		LGeneratorStyle style = pickStyle(generator, styles);
+		item->setFillColor(style.fill);
+		item->setStrokeColor(style.stroke);
+		item->setStrokeWidth(style.width);
+
+		int width = qMax(2, side / 2 + int(generator.bounded(side + 1)));
+		int height = qMax(2, side / 2 + int(generator.bounded(side + 1)));
+		QPoint start = pickPos(generator, i, clusters, side);
+		start.setX(qBound(bounds.left(), start.x(), qMax(bounds.left(), bounds.right() - width)));
+		start.setY(qBound(bounds.top(), start.y(), qMax(bounds.top(), bounds.bottom() - height)));
+		QPoint end(qMin(start.x() + width, bounds.right()), qMin(start.y() + height, bounds.bottom()));
+		item->setStartPos(start);
+		item->setEndPos(end);
+
+		if (type == ItemType::Path)
+		{
+			// a random walk with steps of about a quarter item
+			int count = generator.bounded(m_nMinPathPoints, m_nMaxPathPoints + 1);
+			int step = qMax(1, side / 4);
+			QPoint point = start;
+			for (int j = 0; j < count; ++j)
+			{
+				item->addPoint(point);
+				point = QPoint(qBound(bounds.left(), point.x() + generator.bounded(-step, step + 1), bounds.right()),
+							   qBound(bounds.top(), point.y() + generator.bounded(-step, step + 1), bounds.bottom()));
+			}
+			item->setEndPos(item->points().last());
+		}
+		else if (type == ItemType::Text)
+		{
+			item->setText(QString::fromUtf8("item %1").arg(i));
+		}
+
+		item->updateGeometry();
+		items << item;
+	}
+
+	if (m_nGroupSize > 1)
+	{
+		LCanvasItemList groups;
+		for (int i = 0; i < items.size(); i += m_nGroupSize)
+		{
+			SPtrLCanvasItem group = LCanvasItem::createItem(ItemType::Group);
+			for (int j = i; j < qMin(i + m_nGroupSize, items.size()); ++j)
+				group->addChild(items[j]);
+			group->updateGeometry();
+			groups << group;
+		}
+		items = groups;
+	}
+
+	if (m_nSymbolCount == 0)
+		return items;
+
+	// masters are the first items moved to the origin
+	QVector<SPtrLCanvasSymbol> symbols;
+	for (int i = 0; i < qMin(m_nSymbolCount, items.size()); ++i)
+	{
+		QRect rect = items[i]->boundingRect();
+		LCanvasItemList children = items[i]->getItemType() == ItemType::Group ? items[i]->children()
+																			  : LCanvasItemList() << items[i];
+		SPtrLCanvasItem master = LCanvasItem::createItem(ItemType::Group);
+		foreach (auto &child, children)
+		{
+			SPtrLCanvasItem copy = child->clone();
+			copy->moveItem(-rect.x(), -rect.y());
+			master->addChild(copy);
+		}
+		master->updateGeometry();
+		symbols << SPtrLCanvasSymbol(new LCanvasSymbol(QString::fromUtf8("symbol%1").arg(i + 1), master));
+	}
+
+	LCanvasItemList instances;
+	instances.reserve(items.size());
+	for (int i = 0; i < items.size(); ++i)
+	{
+		QRect rect = items[i]->boundingRect();
+		LCanvasInstance *instance = new LCanvasInstance(symbols[i % symbols.size()]);
+		instance->setTransform(QTransform::fromTranslate(rect.x(), rect.y()));
+		SPtrLCanvasItem item(instance);
+		item->updateGeometry();
+		instances << item;
+	}
+
+	return instances;
+}
+
+bool LCanvasGenerator::write(const QString &filePath) const
+{
+	LCanvasItemList items = generate();
+	if (LCanvasBinaryFormat::isBinaryFile(filePath))
+	{
+		LCanvasBinaryFormat format;
+		return format.write(filePath, items, m_canvasSize);
+	}
+
+	LCanvasWriter writer;
+	return writer.write(filePath, items, m_canvasSize);
+}
+
+ItemType LCanvasGenerator::pickType(QRandomGenerator &generator, int total) const
+{
+	int value = generator.bounded(total);
+	for (int i = 0; i <= ItemType::Text; ++i)
+	{
+		if (value < m_typeWeights[i])
+			return ItemType(i);
+
+		value -= m_typeWeights[i];
+	}
+
+	return ItemType::Rect;
+}
+
+QPoint LCanvasGenerator::pickPos(QRandomGenerator &generator, int index, const QVector<QPoint> &clusters, int side) const
+{
+	QRect bounds = m_bounds.isValid() ? m_bounds : QRect(QPoint(0, 0), m_canvasSize);
+	switch (m_distribution)
+	{
+	case GeneratorDistribution::ClusteredDistribution:
+	{
+		// the sum of three uniform offsets is close enough to a normal spread
+		const QPoint &center = clusters[generator.bounded(clusters.size())];
+		int spread = qMax(side, qMin(bounds.width(), bounds.height()) / (2 * clusters.size()));
+		int dx = 0;
+		int dy = 0;
+		for (int i = 0; i < 3; ++i)
+		{
+			dx += generator.bounded(-spread, spread + 1);
+			dy += generator.bounded(-spread, spread + 1);
+		}
+		return center + QPoint(dx, dy);
+	}
+	case GeneratorDistribution::GridDistribution:
+	{
+		// row-major cells, so document order follows the layout
+		int columns = qMax(1, int(qCeil(qSqrt(double(m_nItemCount) * bounds.width() / bounds.height()))));
+		int rows = qMax(1, (m_nItemCount + columns - 1) / columns);
+		return QPoint(bounds.left() + (index % columns) * bounds.width() / columns,
+					  bounds.top() + (index / columns) * bounds.height() / rows);
+	}
+	default:
+	{
+		return QPoint(generator.bounded(bounds.left(), bounds.right() + 1),
+					  generator.bounded(bounds.top(), bounds.bottom() + 1));
+	}
+	}
+}
+
+LCanvasGenerator::LGeneratorStyle LCanvasGenerator::pickStyle(QRandomGenerator &generator,
+															  const QVector<LGeneratorStyle> &styles) const
+{
+	if (styles.isEmpty())
+		return randomStyle(generator);
+
+	return styles[generator.bounded(styles.size())];
+}
+
+LCanvasGenerator::LGeneratorStyle LCanvasGenerator::randomStyle(QRandomGenerator &generator)
+{
+	LGeneratorStyle style;
+	style.fill = QColor::fromRgb(generator.generate() | 0xff000000);
+	style.stroke = QColor::fromRgb(generator.generate() | 0xff000000);
+	style.width = generator.bounded(1, 5);
+	return style;
+}
+
+} // namespace
@@ -0,0 +1,347 @@
+#include "lcanvasgzip.h"
+
+namespace lwscode {
+
+static const int GzipChunkSize = 256 * 1024;
+// chunks the inflate thread may run ahead of the parser
+static const int GzipQueueDepth = 8;
+
+class LInflateThread : public QThread
+{
+public:
+	explicit LInflateThread(LGzipInflateDevice *device)
+		: m_device(device)
+	{
+
+	}
+
+protected:
+	void run() override
+	{
+		z_stream stream;
+		memset(&stream, 0, sizeof(stream));
+		if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+		{
+			m_device->finish(true);
+			return;
+		}
+
+		QByteArray input(GzipChunkSize, Qt::Uninitialized);
+		bool error = false;
+		bool streamEnd = false;
+		while (!error)
+		{
+			qint64 read = m_device->m_source->read(input.data(), input.size());
+			if (read < 0)
+			{
+				error = true;
+				break;
+			}
+			if (read == 0)
+			{
+				// a stream that stops before its trailer is truncated
+				error = !streamEnd;
+				break;
+			}
+
+			stream.next_in = reinterpret_cast<Bytef *>(input.data());
+			stream.avail_in = uInt(read);
+			bool more = true;
+			while (more && !error)
+			{
+				// concatenated gzip members inflate as one stream
+				if (streamEnd)
+				{
+					if (stream.avail_in == 0)
+						break;
+					inflateReset(&stream);
+					streamEnd = false;
+				}
+
+				QByteArray output(GzipChunkSize, Qt::Uninitialized);
+				stream.next_out = reinterpret_cast<Bytef *>(output.data());
+				stream.avail_out = uInt(output.size());
+
+				int ret = inflate(&stream, Z_NO_FLUSH);
+				if (ret == Z_STREAM_END)
+					streamEnd = true;
+				else if (ret == Z_BUF_ERROR)
+					more = false;
+				else if (ret != Z_OK)
+					error = true;
+
+				// a full output chunk may leave more pending inside zlib
+				if (stream.avail_in == 0 && stream.avail_out > 0)
+					more = false;
+
+				output.truncate(output.size() - int(stream.avail_out));
+				if (!output.isEmpty() && !m_device->pushChunk(output))
+				{
+					inflateEnd(&stream);
+					return;
+				}
+			}
+		}
+
+		inflateEnd(&stream);
+		m_device->finish(error);
+	}
+
+private:
+	LGzipInflateDevice *m_device;
+};
+
+LGzipInflateDevice::LGzipInflateDevice(QIODevice *source)
+	: m_source(source)
+	, m_thread(nullptr)
+	, m_nCurrentPos(0)
+	, m_nInflated(0)
+	, m_bFinished(false)
+	, m_bError(false)
+	, m_bStopping(false)
+{
+
+}
+
+LGzipInflateDevice::~LGzipInflateDevice()
+{
+	close();
+}
+
+bool LGzipInflateDevice::isSequential() const
+{
+	return true;
+}
+
+// sequential devices report no position, but the parser's progress wants the
+// amount of plain text handed out so far
+qint64 LGzipInflateDevice::pos() const
+{
+	return m_nInflated;
+}
+
+bool LGzipInflateDevice::open(OpenMode mode)
+{
+	if ((mode & QIODevice::WriteOnly) || !m_source || !m_source->isReadable())
+		return false;
+
+	m_bFinished = m_bError = m_bStopping = false;
+	m_nInflated = 0;
+	m_thread = new LInflateThread(this);
+	m_thread->start();
+
+	return QIODevice::open(mode);
+}
+
+void LGzipInflateDevice::close()
+{
+	if (m_thread)
+	{
+		{
+			QMutexLocker locker(&m_mutex);
+			m_bStopping = true;
+			m_chunkTaken.wakeAll();
+		}
+		m_thread->wait();
+		delete m_thread;
+		m_thread = nullptr;
+	}
+
+	m_chunks.clear();
+	m_current.clear();
+	m_nCurrentPos = 0;
+
+	QIODevice::close();
+}
+
+bool LGzipInflateDevice::hasError() const
+{
+	QMutexLocker locker(const_cast<QMutex *>(&m_mutex));
+	return m_bError;
+}
+
+bool LGzipInflateDevice::isGzipData(const QByteArray &data)
+{
+	return data.size() >= 2 && uchar(data[0]) == 0x1f && uchar(data[1]) == 0x8b;
+}
+
+// the gzip trailer keeps the plain size modulo 4 GiB, good enough for progress
+qint64 LGzipInflateDevice::uncompressedSize(QFile &file)
+{
+	if (file.size() < 18)
+		return 0;
+
+	uchar trailer[4];
+	qint64 pos = file.pos();
+	if (!file.seek(file.size() - 4) || file.read(reinterpret_cast<char *>(trailer), 4) != 4)
+	{
+		file.seek(pos);
+		return 0;
+	}
+	file.seek(pos);
+
+	return qFromLittleEndian<quint32>(trailer);
+}
+
+qint64 LGzipInflateDevice::readData(char *data, qint64 maxSize)
+{
+	qint64 total = 0;
+	while (total < maxSize)
+	{
+		if (m_nCurrentPos >= m_current.size())
+		{
+			QMutexLocker locker(&m_mutex);
+			while (m_chunks.isEmpty() && !m_bFinished)
+				m_chunkReady.wait(&m_mutex);
+
+			if (m_chunks.isEmpty())
+			{
+				if (m_bError && total == 0)
+					return -1;
+				break;
+			}
+
+			m_current = m_chunks.dequeue();
+			m_nCurrentPos = 0;
+			m_chunkTaken.wakeOne();
+		}
+
+		qint64 size = qMin(maxSize - total, qint64(m_current.size() - m_nCurrentPos));
+		memcpy(data + total, m_current.constData() + m_nCurrentPos, size_t(size));
+		m_nCurrentPos += int(size);
+		total += size;
+	}
+
+	m_nInflated += total;
+	return total;
+}
+
+qint64 LGzipInflateDevice::writeData(const char *, qint64)
+{
+	return -1;
+}
+
+bool LGzipInflateDevice::pushChunk(const QByteArray &chunk)
+{
+	QMutexLocker locker(&m_mutex);
+	while (m_chunks.size() >= GzipQueueDepth && !m_bStopping)
+		m_chunkTaken.wait(&m_mutex);
+
+	if (m_bStopping)
+		return false;
+
+	m_chunks.enqueue(chunk);
+	m_chunkReady.wakeOne();
+	return true;
+}
+
+void LGzipInflateDevice::finish(bool error)
+{
+	QMutexLocker locker(&m_mutex);
+	m_bFinished = true;
+	m_bError = error;
+	m_chunkReady.wakeAll();
+}
+
+LGzipDeflateDevice::LGzipDeflateDevice(QIODevice *target)
+	: m_target(target)
+	, m_bInitialized(false)
+	, m_bError(false)
+{
+	memset(&m_stream, 0, sizeof(m_stream));
+}
+
+LGzipDeflateDevice::~LGzipDeflateDevice()
+{
+	close();
+}
+
+bool LGzipDeflateDevice::open(OpenMode mode)
+{
+	if ((mode & QIODevice::ReadOnly) || !m_target || !m_target->isWritable())
+		return false;
+
+	if (deflateInit2(&m_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return false;
+
+	m_bInitialized = true;
+	m_bError = false;
+	m_output.resize(GzipChunkSize);
+
+	return QIODevice::open(mode);
+}
+
+void LGzipDeflateDevice::close()
+{
+	if (m_bInitialized)
+	{
+		deflateInput(nullptr, 0, Z_FINISH);
+		deflateEnd(&m_stream);
+		m_bInitialized = false;
+	}
+
+	QIODevice::close();
+}
+
+bool LGzipDeflateDevice::hasError() const
+{
+	return m_bError;
+}
+
+bool LGzipDeflateDevice::isGzipSuffix(const QString &filePath)
+{
+	return QFileInfo(filePath).suffix().compare(QString::fromUtf8("svgz"), Qt::CaseInsensitive) == 0;
+}
+
+qint64 LGzipDeflateDevice::readData(char *, qint64)
+{
+	return -1;
+}
+
+qint64 LGzipDeflateDevice::writeData(const char *data, qint64 maxSize)
+{
+	// zlib counts in uInt, so very large writes go through in slices
+	qint64 done = 0;
+	while (done < maxSize)
+	{
+		qint64 size = qMin(maxSize - done, qint64(1) << 30);
+		if (!deflateInput(data + done, size, Z_NO_FLUSH))
+			return -1;
+		done += size;
+	}
+
+	return done;
+}
+
+bool LGzipDeflateDevice::deflateInput(const char *data, qint64 size, int flush)
+{
+	if (m_bError)
+		return false;
+
+	m_stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+	m_stream.avail_in = uInt(size);
+	int ret = Z_OK;
+	do
+	{
+		m_stream.next_out = reinterpret_cast<Bytef *>(m_output.data());
+		m_stream.avail_out = uInt(m_output.size());
+
+		ret = deflate(&m_stream, flush);
+		if (ret == Z_STREAM_ERROR)
+		{
+			m_bError = true;
+			return false;
+		}
+
+		qint64 produced = m_output.size() - qint64(m_stream.avail_out);
+		if (produced > 0 && m_target->write(m_output.constData(), produced) != produced)
+		{
+			m_bError = true;
+			return false;
+		}
+	} while (m_stream.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+
+	return true;
+}
+
+} // namespace
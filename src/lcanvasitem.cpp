@@ -1,7 +1,34 @@
 #include "lcanvasitem.h"
+#include "lcanvaswriter.h"
+#include "lcanvasmemory.h"
+#include "lcanvasstats.h"
 
 namespace lwscode {
 
+// 64-bit FNV-1a, wide enough that a million items don't collide in practice
+static quint64 hashBytes(quint64 hash, const void *data, int size)
+{
+	const uchar *bytes = static_cast<const uchar *>(data);
+	for (int i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= Q_UINT64_C(0x100000001b3);
+	}
+	return hash;
+}
+
+static quint64 hashPoints(quint64 hash, const QPoints &points, const QPoint &offset = QPoint())
+{
+	int count = points.size();
+	hash = hashBytes(hash, &count, sizeof(count));
+	foreach (auto &point, points)
+	{
+		int coords[2] = { point.x() + offset.x(), point.y() + offset.y() };
+		hash = hashBytes(hash, coords, sizeof(coords));
+	}
+	return hash;
+}
+
 // LCanvasItem
 LCanvasItem::LCanvasItem()
 	: m_itemType(ItemType::NoneType)
@@ -10,10 +37,41 @@ LCanvasItem::LCanvasItem()
 	, m_strokeColor(Qt::black)
 	, m_nStrokeWidth(1)
 	, m_bSelected(false)
+	, m_nEpoch(1)
+	, m_nHashEpoch(0)
+	, m_nContentHash(0)
+	, m_nDirtyGeometry(DerivedGeometry::AllGeometry)
 {
 
 }
 
+SPtrLCanvasItem LCanvasItem::createItem(ItemType itemType)
+{
+	switch (itemType)
+	{
+	case ItemType::Path:
+		return SPtrLCanvasItem(new LCanvasPath());
+	case ItemType::Line:
+		return SPtrLCanvasItem(new LCanvasLine());
+	case ItemType::Rect:
+		return SPtrLCanvasItem(new LCanvasRect());
+	case ItemType::Ellipse:
+		return SPtrLCanvasItem(new LCanvasEllipse());
+	case ItemType::Triangle:
+		return SPtrLCanvasItem(new LCanvasTriangle());
+	case ItemType::Hexagon:
+		return SPtrLCanvasItem(new LCanvasHexagon());
+	case ItemType::Text:
+		return SPtrLCanvasItem(new LCanvasText());
+	case ItemType::Group:
+		return SPtrLCanvasItem(new LCanvasGroup());
+	case ItemType::Instance:
+		return SPtrLCanvasItem(new LCanvasInstance());
+	default:
+		return SPtrLCanvasItem();
+	}
+}
+
 ItemType LCanvasItem::getItemType()
 {
 	return m_itemType;
@@ -27,11 +85,13 @@ QPoint LCanvasItem::startPos()
 void LCanvasItem::setStartPos(const QPoint &point)
 {
 	m_startPos = point;
+	markDirty();
 }
 
 void LCanvasItem::moveStartPos(int dx, int dy)
 {
 	m_startPos += QPoint(dx, dy);
+	markDirty();
 }
 
 QPoint LCanvasItem::endPos()
@@ -42,26 +102,57 @@ QPoint LCanvasItem::endPos()
 void LCanvasItem::setEndPos(const QPoint &point)
 {
 	m_endPos = point;
+	markDirty();
 }
 
 void LCanvasItem::moveEndPos(int dx, int dy)
 {
 	m_endPos += QPoint(dx, dy);
+	markDirty();
+}
+
+QColor LCanvasItem::fillColor() const
+{
+	return m_fillColor;
 }
 
 void LCanvasItem::setFillColor(const QColor &color)
 {
 	m_fillColor = color;
+	markDirty(DerivedGeometry::NoGeometry);
+}
+
+QColor LCanvasItem::strokeColor() const
+{
+	return m_strokeColor;
 }
 
 void LCanvasItem::setStrokeColor(const QColor &color)
 {
 	m_strokeColor = color;
+	markDirty(DerivedGeometry::NoGeometry);
+}
+
+int LCanvasItem::strokeWidth() const
+{
+	return m_nStrokeWidth;
 }
 
 void LCanvasItem::setStrokeWidth(int width)
 {
 	m_nStrokeWidth = width;
+	markDirty(DerivedGeometry::BoundsGeometry);
+}
+
+// sets the properties named by the StyleOverride flags, the others stay
+void LCanvasItem::setStyle(int properties, const QColor &fillColor, const QColor &strokeColor, int strokeWidth)
+{
+	if (properties & StyleOverride::FillOverride)
+		setFillColor(fillColor);
+	if (properties & StyleOverride::StrokeOverride)
+		setStrokeColor(strokeColor);
+	if (properties & StyleOverride::StrokeWidthOverride)
+		setStrokeWidth(strokeWidth);
 }
 
 bool LCanvasItem::isSelected()
@@ -76,9 +167,232 @@ void LCanvasItem::setSelected(bool selected)
 
 QRect LCanvasItem::boundingRect()
 {
+	if (isDirty(DerivedGeometry::BoundsGeometry))
+	{
+		setBoundingRect();
+		markClean(DerivedGeometry::BoundsGeometry);
+	}
+
 	return m_boundingRect.isValid() ? m_boundingRect : QRect();
 }
 
+// the bounds without the stroke and the margin around it, the box a resize
+// scales; shapes pad their bounds by the same amount
+QRect LCanvasItem::geometryRect()
+{
+	int d = (m_nStrokeWidth + 1) / 2 + 4;
+	QRect rect = boundingRect();
+	return rect.isValid() ? rect.adjusted(d, d, -d, -d) : QRect();
+}
+
+const QPainterPath &LCanvasItem::path()
+{
+	if (isDirty(DerivedGeometry::PathGeometry))
+	{
+		updatePath();
+		markClean(DerivedGeometry::PathGeometry);
+	}
+
+	return m_path;
+}
+
+// for loaders, which take the cost off the gui thread
+void LCanvasItem::updateGeometry(int geometry)
+{
+	if (geometry & DerivedGeometry::BoundsGeometry)
+		boundingRect();
+	if (geometry & DerivedGeometry::PathGeometry)
+		path();
+	if (geometry & DerivedGeometry::VerticesGeometry)
+		vertices();
+}
+
+// moves the edges named by dir to pos, the opposite edges stay put
+void LCanvasItem::stretchItemTo(StretchItemDir dir, int x, int y)
+{
+	QRect rect = geometryRect();
+	if (!rect.isNull())
+		transformItem(stretchTransform(rect, dir, QPoint(x, y)));
+}
+
+// the smallest extent a stretch leaves an item with
+static const qreal MinStretchSize = 4.0;
+
+QTransform LCanvasItem::stretchTransform(const QRect &rect, StretchItemDir dir, const QPoint &pos)
+{
+	// edges as coordinates, QRect::right() is one short of them
+	qreal left = rect.x();
+	qreal top = rect.y();
+	qreal right = rect.x() + rect.width();
+	qreal bottom = rect.y() + rect.height();
+
+	qreal sx = 1.0, sy = 1.0;
+	qreal ax = left, ay = top;
+	if ((dir & StretchItemDir::ToLeft) && right != left)
+	{
+		ax = right;
+		sx = (right - pos.x()) / (right - left);
+	}
+	else if ((dir & StretchItemDir::ToRight) && right != left)
+	{
+		sx = (pos.x() - left) / (right - left);
+	}
+
+	if ((dir & StretchItemDir::ToTop) && bottom != top)
+	{
+		ay = bottom;
+		sy = (bottom - pos.y()) / (bottom - top);
+	}
+	else if ((dir & StretchItemDir::ToBottom) && bottom != top)
+	{
+		sy = (pos.y() - top) / (bottom - top);
+	}
+
+	// a handle dragged onto or past the opposite edge stops short of it,
+	// integer geometry squeezed to nothing could not be stretched back
+	if (right != left)
+		sx = qMax(sx, qMin(1.0, MinStretchSize / (right - left)));
+	if (bottom != top)
+		sy = qMax(sy, qMin(1.0, MinStretchSize / (bottom - top)));
+
+	QTransform transform;
+	transform.translate(ax, ay);
+	transform.scale(sx, sy);
+	transform.translate(-ax, -ay);
+	return transform;
+}
+
+// a translation keeps bounds and path valid, they are moved along instead
+// of being rebuilt
+void LCanvasItem::markMoved(int dx, int dy)
+{
+	if (!isDirty(DerivedGeometry::BoundsGeometry))
+		m_boundingRect.translate(dx, dy);
+	if (!isDirty(DerivedGeometry::PathGeometry))
+		m_path.translate(dx, dy);
+	markDirty(DerivedGeometry::VerticesGeometry | DerivedGeometry::HitGeometry);
+}
+
+quint64 LCanvasItem::dirtyEpoch() const
+{
+	return m_nEpoch;
+}
+
+// covers everything writeItemToXml emits, so equal hashes mean equal svg blocks;
+// cached until the next mutation bumps the epoch
+quint64 LCanvasItem::contentHash()
+{
+	if (m_nHashEpoch == m_nEpoch)
+		return m_nContentHash;
+
+	int fields[9] = {
+		m_itemType, m_startPos.x(), m_startPos.y(), m_endPos.x(), m_endPos.y(),
+		int(m_fillColor.rgba()), int(m_strokeColor.rgba()), m_nStrokeWidth, font().pointSize()
+	};
+	quint64 hash = Q_UINT64_C(0xcbf29ce484222325);
+	hash = hashBytes(hash, fields, sizeof(fields));
+	hash = hashPoints(hash, pointBlock(), pointOffset());
+	hash = hashPoints(hash, vertices());
+
+	QString string = text();
+	hash = hashBytes(hash, string.constData(), string.size() * int(sizeof(QChar)));
+	string = font().family();
+	hash = hashBytes(hash, string.constData(), string.size() * int(sizeof(QChar)));
+
+	// children only change through their group, which bumps its own epoch
+	foreach (auto &child, children())
+	{
+		quint64 childHash = child->contentHash();
+		hash = hashBytes(hash, &childHash, sizeof(childHash));
+	}
+
+	// a group is written with the style it overrides
+	if (m_itemType == ItemType::Group && styleOverrides() != StyleOverride::NoOverride)
+	{
+		int overrides = styleOverrides();
+		hash = hashBytes(hash, &overrides, sizeof(overrides));
+	}
+
+	// an instance is written as a reference, its symbol's hash stands for the geometry
+	SPtrLCanvasSymbol instanceSymbol = symbol();
+	if (instanceSymbol)
+	{
+		QTransform matrix = transform();
+		qreal values[6] = { matrix.m11(), matrix.m12(), matrix.m21(), matrix.m22(), matrix.dx(), matrix.dy() };
+		quint64 symbolHash = instanceSymbol->contentHash();
+		int overrides = styleOverrides();
+		hash = hashBytes(hash, values, sizeof(values));
+		hash = hashBytes(hash, &symbolHash, sizeof(symbolHash));
+		hash = hashBytes(hash, &overrides, sizeof(overrides));
+		string = instanceSymbol->id();
+		hash = hashBytes(hash, string.constData(), string.size() * int(sizeof(QChar)));
+	}
+
+	m_nContentHash = hash;
+	m_nHashEpoch = m_nEpoch;
+	return hash;
+}
+
+static qint64 objectSize(ItemType itemType)
+{
+	switch (itemType)
+	{
+	case ItemType::Path: { return sizeof(LCanvasPath); }
+	case ItemType::Line: { return sizeof(LCanvasLine); }
+	case ItemType::Rect: { return sizeof(LCanvasRect); }
+	case ItemType::Ellipse: { return sizeof(LCanvasEllipse); }
+	case ItemType::Triangle: { return sizeof(LCanvasTriangle); }
+	case ItemType::Hexagon: { return sizeof(LCanvasHexagon); }
+	case ItemType::Text: { return sizeof(LCanvasText); }
+	case ItemType::Group: { return sizeof(LCanvasGroup); }
+	case ItemType::Instance: { return sizeof(LCanvasInstance); }
+	default: { return sizeof(LCanvasItem); }
+	}
+}
+
+// QFontPrivate is opaque, this is its size on common 64-bit builds
+static const qint64 FontDataSize = 200;
+// QPainterPathPrivate header ahead of its element vector
+static const qint64 PathDataSize = 64;
+
+void LCanvasItem::accountMemory(LCanvasMemoryReport &report) const
+{
+	if (!report.claim(this))
+		return;
+
+	// colors and bounds live inline, they are split out of the object size
+	qint64 styleSize = sizeof(m_fillColor) + sizeof(m_strokeColor) + sizeof(m_nStrokeWidth);
+	qint64 boundsSize = sizeof(m_boundingRect);
+	report.add(m_itemType, MemoryComponent::ObjectMemory, objectSize(m_itemType) - styleSize - boundsSize);
+	report.add(m_itemType, MemoryComponent::BoundsMemory, boundsSize);
+	report.add(m_itemType, MemoryComponent::StyleMemory, styleSize);
+	report.add(m_itemType, MemoryComponent::HandleMemory, LCanvasMemoryReport::handleSize());
+
+	if (m_path.elementCount() > 0 && report.claim(&m_path.elementAt(0)))
+	{
+		report.add(m_itemType, MemoryComponent::PathMemory,
+				   PathDataSize + m_path.elementCount() * qint64(sizeof(QPainterPath::Element)));
+	}
+
+	// copies share their lists until one of them changes
+	QPoints lists[2] = { pointBlock(), vertices() };
+	for (auto &list : lists)
+	{
+		if (!list.isEmpty() && report.claim(&list.constFirst()))
+			report.add(m_itemType, MemoryComponent::PointsMemory, 32 + list.size() * qint64(sizeof(QPoint)));
+	}
+
+	if (m_itemType == ItemType::Text)
+	{
+		QString string = text();
+		if (!string.isEmpty() && report.claim(string.constData()))
+			report.add(m_itemType, MemoryComponent::TextMemory, 32 + string.capacity() * qint64(sizeof(QChar)));
+		report.add(m_itemType, MemoryComponent::StyleMemory, sizeof(QFont) + FontDataSize);
+	}
+
+	report.add(m_itemType, MemoryComponent::RasterMemory, cacheBytes());
+}
+
 // LCanvasPath
 LCanvasPath::LCanvasPath()
 {
@@ -87,17 +401,62 @@ LCanvasPath::LCanvasPath()
 
 void LCanvasPath::addPoint(const QPoint &point)
 {
+	applyPointOffset();
 	m_points.push_back(point);
+
+	// a stroke being drawn grows by one point per mouse move, so built
+	// geometry is extended rather than rebuilt
+	int geometry = DerivedGeometry::AllGeometry;
+	if (!isDirty(DerivedGeometry::PathGeometry))
+	{
+		if (m_points.size() == 1)
+			m_path.moveTo(point);
+		else
+			m_path.lineTo(point);
+		geometry &= ~DerivedGeometry::PathGeometry;
+	}
+	if (!isDirty(DerivedGeometry::BoundsGeometry) && m_points.size() > 1)
+	{
+		int d = (m_nStrokeWidth + 1) / 2 + 4;
+		m_boundingRect |= QRect(point, point).adjusted(-d, -d, d, d);
+		geometry &= ~DerivedGeometry::BoundsGeometry;
+	}
+	markDirty(geometry);
+}
+
+QPoints LCanvasPath::points() const
+{
+	if (m_pointOffset.isNull())
+		return m_points;
+
+	QPoints points;
+	points.reserve(m_points.size());
+	foreach (auto &point, m_points)
+		points << point + m_pointOffset;
+	return points;
 }
 
-void LCanvasPath::movePathTo(const QPoint &point)
+QPoints LCanvasPath::pointBlock() const
 {
-	m_path.moveTo(point);
+	return m_points;
 }
 
-void LCanvasPath::linePathTo(const QPoint &point)
+QPoint LCanvasPath::pointOffset() const
 {
-	m_path.lineTo(point);
+	return m_pointOffset;
+}
+
+// the first change to the shape gives this copy a block of its own
+void LCanvasPath::applyPointOffset()
+{
+	if (m_pointOffset.isNull())
+		return;
+
+	for (int i = 0; i < m_points.size(); ++i)
+		m_points[i] += m_pointOffset;
+	if (!isDirty(DerivedGeometry::PathGeometry))
+		m_path.translate(m_pointOffset);
+	m_pointOffset = QPoint();
 }
 
 // LCanvasLine
@@ -125,6 +484,34 @@ LCanvasTriangle::LCanvasTriangle()
 	m_itemType = ItemType::Triangle;
 }
 
+QPoints LCanvasTriangle::vertices() const
+{
+	if (isDirty(DerivedGeometry::VerticesGeometry))
+	{
+		int left = m_startPos.x();
+		int top = m_startPos.y();
+		int right = m_endPos.x();
+		int bottom = m_endPos.y();
+		m_vertices[0] = QPoint((left + right) / 2, top);
+		m_vertices[1] = QPoint(right, bottom);
+		m_vertices[2] = QPoint(left, bottom);
+		markClean(DerivedGeometry::VerticesGeometry);
+	}
+
+	return m_vertices;
+}
+
+const QPolygon &LCanvasTriangle::polygon()
+{
+	if (isDirty(DerivedGeometry::HitGeometry))
+	{
+		m_polygon = QPolygon(vertices().toVector());
+		markClean(DerivedGeometry::HitGeometry);
+	}
+
+	return m_polygon;
+}
+
 // LCanvasHexagon
 LCanvasHexagon::LCanvasHexagon()
 	: m_vertices(QPoints(6, QPoint()))
@@ -132,6 +519,37 @@ LCanvasHexagon::LCanvasHexagon()
 	m_itemType = ItemType::Hexagon;
 }
 
+QPoints LCanvasHexagon::vertices() const
+{
+	if (isDirty(DerivedGeometry::VerticesGeometry))
+	{
+		int left = m_startPos.x();
+		int top = m_startPos.y();
+		int right = m_endPos.x();
+		int bottom = m_endPos.y();
+		m_vertices[0] = QPoint((left * 3 + right) / 4, top);
+		m_vertices[1] = QPoint((left + right * 3) / 4, top);
+		m_vertices[2] = QPoint(right, (top + bottom) / 2);
+		m_vertices[3] = QPoint((left + right * 3) / 4, bottom);
+		m_vertices[4] = QPoint((left * 3 + right) / 4, bottom);
+		m_vertices[5] = QPoint(left, (top + bottom) / 2);
+		markClean(DerivedGeometry::VerticesGeometry);
+	}
+
+	return m_vertices;
+}
+
+const QPolygon &LCanvasHexagon::polygon()
+{
+	if (isDirty(DerivedGeometry::HitGeometry))
+	{
+		m_polygon = QPolygon(vertices().toVector());
+		markClean(DerivedGeometry::HitGeometry);
+	}
+
+	return m_polygon;
+}
+
 // LCanvasText
 LCanvasText::LCanvasText()
 	: m_nWidth(0)
@@ -145,12 +563,7 @@ LCanvasText::LCanvasText()
 void LCanvasText::setFont(const QFont &font)
 {
 	m_font = font;
-
-	QFontMetrics fontMetrics(m_font);
-	QRect rect = fontMetrics.boundingRect(m_text);
-	m_nWidth = rect.width() < 8 ? 8 : rect.width();
-	m_nHeight = rect.height();
-	m_boundingRect = QRect(m_startPos.x(), m_startPos.y(), m_nWidth, m_nHeight);
+	markDirty();
 }
 
 QFont LCanvasText::font() const
@@ -161,12 +574,7 @@ QFont LCanvasText::font() const
 void LCanvasText::setText(const QString &text)
 {
 	m_text = text;
-
-	QFontMetrics fontMetrics(m_font);
-	QRect rect = fontMetrics.boundingRect(m_text);
-	m_nWidth = rect.width() < 8 ? 8 : rect.width();
-	m_nHeight = rect.height();
-	m_boundingRect = QRect(m_startPos.x(), m_startPos.y(), m_nWidth, m_nHeight);
+	markDirty();
 }
 
 QString LCanvasText::text() const
@@ -174,20 +582,352 @@ QString LCanvasText::text() const
 	return m_text;
 }
 
+// LCanvasGroup
+// below this many children painting them directly is as cheap as the raster
+static const int RasterChildCount = 64;
+// a raster larger than this on either side is not kept, the group paints directly
+static const int MaxRasterSize = 4096;
+
+LCanvasGroup::LCanvasGroup()
+	: m_nStyledEpoch(0)
+	, m_nOverrides(StyleOverride::NoOverride)
+	, m_bCacheEnabled(true)
+	, m_fRasterScale(0.0)
+{
+	m_itemType = ItemType::Group;
+}
+
+void LCanvasGroup::addChild(const SPtrLCanvasItem &item)
+{
+	m_children << item;
+	markDirty();
+}
+
+LCanvasItemList LCanvasGroup::children() const
+{
+	return m_children;
+}
+
+void LCanvasGroup::setCacheEnabled(bool enabled)
+{
+	m_bCacheEnabled = enabled;
+	if (!enabled)
+		m_raster = QImage();
+	markDirty(DerivedGeometry::RasterGeometry);
+}
+
+bool LCanvasGroup::isCacheEnabled() const
+{
+	return m_bCacheEnabled;
+}
+
+int LCanvasGroup::styleOverrides() const
+{
+	return m_nOverrides;
+}
+
+void LCanvasGroup::setFillColor(const QColor &color)
+{
+	m_fillColor = color;
+	m_nOverrides |= StyleOverride::FillOverride;
+	markDirty(DerivedGeometry::RasterGeometry);
+}
+
+void LCanvasGroup::setStrokeColor(const QColor &color)
+{
+	m_strokeColor = color;
+	m_nOverrides |= StyleOverride::StrokeOverride;
+	markDirty(DerivedGeometry::RasterGeometry);
+}
+
+void LCanvasGroup::setStrokeWidth(int width)
+{
+	m_nStrokeWidth = width;
+	m_nOverrides |= StyleOverride::StrokeWidthOverride;
+	markDirty(DerivedGeometry::BoundsGeometry | DerivedGeometry::RasterGeometry);
+}
+
+// the children as they are drawn; copies carrying the overrides are made again
+// after the group changed, moves are applied to them as they are
+const LCanvasItemList &LCanvasGroup::styledChildren()
+{
+	if (m_nOverrides == StyleOverride::NoOverride)
+		return m_children;
+
+	if (m_nStyledEpoch != m_nEpoch)
+	{
+		m_styledChildren.clear();
+		foreach (auto &child, m_children)
+		{
+			SPtrLCanvasItem copy = child->clone();
+			copy->setStyle(m_nOverrides, m_fillColor, m_strokeColor, m_nStrokeWidth);
+			m_styledChildren << copy;
+		}
+		m_nStyledEpoch = m_nEpoch;
+	}
+
+	return m_styledChildren;
+}
+
+qint64 LCanvasGroup::cacheBytes() const
+{
+	return qint64(m_raster.bytesPerLine()) * m_raster.height();
+}
+
+// drawn at the scale it is shown at, so it stays sharp under zoom
+void LCanvasGroup::updateRaster(const QRect &rect, qreal scale)
+{
+	m_fRasterScale = scale;
+	markClean(DerivedGeometry::RasterGeometry);
+
+	QSize size = (QSizeF(rect.size()) * scale).toSize();
+	if (size.isEmpty() || size.width() > MaxRasterSize || size.height() > MaxRasterSize)
+	{
+		m_raster = QImage();
+		return;
+	}
+
+	m_raster = QImage(size, QImage::Format_ARGB32_Premultiplied);
+	m_raster.fill(Qt::transparent);
+
+	QPainter painter(&m_raster);
+	painter.setRenderHint(QPainter::Antialiasing);
+	painter.scale(scale, scale);
+	painter.translate(-rect.topLeft());
+	foreach (auto &child, styledChildren())
+		child->paintItem(painter);
+}
+
+// LCanvasSymbol
+// instances share one raster, past this size on either side they paint the
+// master instead
+static const int MaxSymbolRasterSize = 1024;
+
+LCanvasSymbol::LCanvasSymbol(const QString &id, const SPtrLCanvasItem &master)
+	: m_id(id)
+	, m_master(master)
+	, m_fRasterScale(0.0)
+{
+	// the master is final from here on, what derives from it is taken once
+	m_boundingRect = master->boundingRect();
+	m_nContentHash = master->contentHash();
+}
+
+QString LCanvasSymbol::id() const
+{
+	return m_id;
+}
+
+SPtrLCanvasItem LCanvasSymbol::master() const
+{
+	return m_master;
+}
+
+QRect LCanvasSymbol::boundingRect() const
+{
+	return m_boundingRect;
+}
+
+quint64 LCanvasSymbol::contentHash() const
+{
+	return m_nContentHash;
+}
+
+// instances with the same overrides share one restyled copy of the master
+SPtrLCanvasSymbol LCanvasSymbol::styledSymbol(int overrides, const QColor &fillColor,
+											  const QColor &strokeColor, int strokeWidth)
+{
+	int fields[4] = {
+		overrides,
+		(overrides & StyleOverride::FillOverride) ? int(fillColor.rgba()) : 0,
+		(overrides & StyleOverride::StrokeOverride) ? int(strokeColor.rgba()) : 0,
+		(overrides & StyleOverride::StrokeWidthOverride) ? strokeWidth : 0
+	};
+	quint64 key = hashBytes(Q_UINT64_C(0xcbf29ce484222325), fields, sizeof(fields));
+
+	// loaders build instances on several threads at once
+	QMutexLocker locker(&m_mutex);
+	SPtrLCanvasSymbol &symbol = m_styledSymbols[key];
+	if (!symbol)
+	{
+		SPtrLCanvasItem master = m_master->clone();
+		master->setStyle(overrides, fillColor, strokeColor, strokeWidth);
+		symbol = SPtrLCanvasSymbol(new LCanvasSymbol(m_id, master));
+	}
+
+	return symbol;
+}
+
+LCanvasItemList LCanvasSymbol::masters() const
+{
+	QMutexLocker locker(&m_mutex);
+	LCanvasItemList masters;
+	masters << m_master;
+	foreach (auto &symbol, m_styledSymbols)
+		masters << symbol->m_master;
+	return masters;
+}
+
+qint64 LCanvasSymbol::rasterBytes() const
+{
+	QMutexLocker locker(&m_mutex);
+	qint64 bytes = qint64(m_raster.bytesPerLine()) * m_raster.height();
+	foreach (auto &symbol, m_styledSymbols)
+		bytes += qint64(symbol->m_raster.bytesPerLine()) * symbol->m_raster.height();
+	return bytes;
+}
+
+static void collectSymbols(const LCanvasItemList &items, QSet<QString> &ids, QList<SPtrLCanvasSymbol> &symbols)
+{
+	foreach (auto &item, items)
+	{
+		collectSymbols(item->children(), ids, symbols);
+
+		SPtrLCanvasSymbol symbol = item->symbol();
+		if (symbol && !ids.contains(symbol->id()))
+		{
+			ids.insert(symbol->id());
+			collectSymbols(symbol->master()->children(), ids, symbols);
+			symbols << symbol;
+		}
+	}
+}
+
+// the symbols placed by the items, each once; symbols a master places come
+// ahead of it, so writers can emit them in an order readers resolve
+QList<SPtrLCanvasSymbol> LCanvasSymbol::collect(const LCanvasItemList &items)
+{
+	QSet<QString> ids;
+	QList<SPtrLCanvasSymbol> symbols;
+	collectSymbols(items, ids, symbols);
+	return symbols;
+}
+
+// the raster is drawn at the largest scale any instance was shown at and
+// scaled down for the others
+void LCanvasSymbol::paint(QPainter &painter)
+{
+	if (!m_boundingRect.isValid())
+		return;
+
+	qreal scale = qSqrt(qAbs(painter.worldTransform().determinant()));
+	bool hit = scale <= m_fRasterScale * 1.05 && !m_raster.isNull();
+	if (hit)
+		LCanvasStats::addCacheHit();
+	else
+		LCanvasStats::addCacheMiss();
+
+	if ((hit || updateRaster(scale)) && !m_raster.isNull())
+	{
+		painter.save();
+		painter.setRenderHint(QPainter::SmoothPixmapTransform);
+		painter.drawImage(QRectF(m_boundingRect), m_raster);
+		painter.restore();
+		return;
+	}
+
+	m_master->paintItem(painter);
+}
+
+bool LCanvasSymbol::updateRaster(qreal scale)
+{
+	QSize size = (QSizeF(m_boundingRect.size()) * scale).toSize();
+	if (size.isEmpty() || size.width() > MaxSymbolRasterSize || size.height() > MaxSymbolRasterSize)
+		return false;
+
+	m_raster = QImage(size, QImage::Format_ARGB32_Premultiplied);
+	m_raster.fill(Qt::transparent);
+	m_fRasterScale = scale;
+
+	QPainter painter(&m_raster);
+	painter.setRenderHint(QPainter::Antialiasing);
+	painter.scale(scale, scale);
+	painter.translate(-m_boundingRect.topLeft());
+	m_master->paintItem(painter);
+	return true;
+}
+
+// LCanvasInstance
+LCanvasInstance::LCanvasInstance(const SPtrLCanvasSymbol &symbol)
+	: m_symbol(symbol)
+	, m_nOverrides(StyleOverride::NoOverride)
+{
+	m_itemType = ItemType::Instance;
+}
+
+void LCanvasInstance::setSymbol(const SPtrLCanvasSymbol &symbol)
+{
+	m_symbol = symbol;
+	m_styledSymbol.clear();
+	markDirty();
+}
+
+SPtrLCanvasSymbol LCanvasInstance::symbol() const
+{
+	return m_symbol;
+}
+
+void LCanvasInstance::setTransform(const QTransform &transform)
+{
+	m_transform = transform;
+	markDirty();
+}
+
+QTransform LCanvasInstance::transform() const
+{
+	return m_transform;
+}
+
+int LCanvasInstance::styleOverrides() const
+{
+	return m_nOverrides;
+}
+
+void LCanvasInstance::setFillColor(const QColor &color)
+{
+	m_fillColor = color;
+	m_nOverrides |= StyleOverride::FillOverride;
+	m_styledSymbol.clear();
+	markDirty(DerivedGeometry::NoGeometry);
+}
+
+void LCanvasInstance::setStrokeColor(const QColor &color)
+{
+	m_strokeColor = color;
+	m_nOverrides |= StyleOverride::StrokeOverride;
+	m_styledSymbol.clear();
+	markDirty(DerivedGeometry::NoGeometry);
+}
+
+void LCanvasInstance::setStrokeWidth(int width)
+{
+	m_nStrokeWidth = width;
+	m_nOverrides |= StyleOverride::StrokeWidthOverride;
+	m_styledSymbol.clear();
+	markDirty(DerivedGeometry::BoundsGeometry);
+}
+
+LCanvasSymbol *LCanvasInstance::styledSymbol()
+{
+	if (!m_styledSymbol && m_symbol)
+	{
+		m_styledSymbol = m_nOverrides == StyleOverride::NoOverride ? m_symbol :
+			m_symbol->styledSymbol(m_nOverrides, m_fillColor, m_strokeColor, m_nStrokeWidth);
+	}
+
+	return m_styledSymbol.data();
+}
+
 // paintItem
 void LCanvasPath::paintItem(QPainter &painter)
 {
 	if (m_points.size() <= 1)
 		return;
 
-	QPainterPath path;
-	path.moveTo(m_points[0]);
-	for (int i = 1; i < m_points.size(); ++i)
-		path.lineTo(m_points[i]);
-
 	painter.save();
+	painter.translate(m_pointOffset);
 	painter.setPen(QPen(m_strokeColor, m_nStrokeWidth));
-	painter.drawPath(m_path);
+	painter.drawPath(path());
 	painter.restore();
 }
 
@@ -223,102 +963,158 @@ void LCanvasEllipse::paintItem(QPainter &painter)
 
 void LCanvasTriangle::paintItem(QPainter &painter)
 {
-	int left = m_startPos.x();
-	int top = m_startPos.y();
-	int right = m_endPos.x();
-	int bottom = m_endPos.y();
-	m_vertices[0] = QPoint((left + right) / 2, top);
-	m_vertices[1] = QPoint(right, bottom);
-	m_vertices[2] = QPoint(left, bottom);
-	QPolygon polygon(m_vertices);
-
 	painter.save();
 	painter.setBrush(QBrush(m_fillColor));
 	painter.setPen(QPen(m_strokeColor, m_nStrokeWidth));
-	painter.drawPolygon(polygon);
+	painter.drawPolygon(polygon());
 	painter.restore();
 }
 
 void LCanvasHexagon::paintItem(QPainter &painter)
 {
-	int left = m_startPos.x();
-	int top = m_startPos.y();
-	int right = m_endPos.x();
-	int bottom = m_endPos.y();
-	m_vertices[0] = QPoint((left * 3 + right) / 4, top);
-	m_vertices[1] = QPoint((left + right * 3) / 4, top);
-	m_vertices[2] = QPoint(right, (top + bottom) / 2);
-	m_vertices[3] = QPoint((left + right * 3) / 4, bottom);
-	m_vertices[4] = QPoint((left * 3 + right) / 4, bottom);
-	m_vertices[5] = QPoint(left, (top + bottom) / 2);
-	QPolygon polygon(m_vertices);
-
 	painter.save();
 	painter.setBrush(QBrush(m_fillColor));
 	painter.setPen(QPen(m_strokeColor, m_nStrokeWidth));
-	painter.drawPolygon(polygon);
+	painter.drawPolygon(polygon());
 	painter.restore();
 }
 
 void LCanvasText::paintItem(QPainter &painter)
 {
 	painter.save();
-	painter.setPen(QPen(m_strokeColor, m_nStrokeWidth));
-	painter.setFont(m_font);
-	painter.drawText(m_boundingRect, 0, m_text);
+	painter.setPen(QPen(m_strokeColor, m_nStrokeWidth));
+	painter.setFont(m_font);
+	painter.drawText(boundingRect().adjusted(4, 4, -4, -4), 0, m_text);
+	painter.restore();
+}
+
+void LCanvasGroup::paintItem(QPainter &painter)
+{
+	QRect rect = boundingRect();
+	if (m_bCacheEnabled && m_children.size() >= RasterChildCount && rect.isValid())
+	{
+		// a raster that would be magnified is redrawn, a finer one is kept
+		// until it is twice the size needed
+		qreal scale = qSqrt(qAbs(painter.worldTransform().determinant()));
+		if (isDirty(DerivedGeometry::RasterGeometry) || scale > m_fRasterScale * 1.05 ||
+			scale * 2 < m_fRasterScale)
+		{
+			LCanvasStats::addCacheMiss();
+			updateRaster(rect, scale);
+		}
+		else
+		{
+			LCanvasStats::addCacheHit();
+		}
+
+		if (!m_raster.isNull())
+		{
+			painter.drawImage(QRectF(rect), m_raster);
+			return;
+		}
+	}
+
+	foreach (auto &child, styledChildren())
+		child->paintItem(painter);
+}
+
+void LCanvasInstance::paintItem(QPainter &painter)
+{
+	LCanvasSymbol *symbol = styledSymbol();
+	if (!symbol)
+		return;
+
+	painter.save();
+	painter.setTransform(m_transform, true);
+	symbol->paint(painter);
 	painter.restore();
 }
 
 // moveItem
 void LCanvasPath::moveItem(int dx, int dy)
 {
-	m_path.translate(dx, dy);
+	// pasted copies move without touching the points they share
+	m_pointOffset += QPoint(dx, dy);
+	m_startPos += QPoint(dx, dy);
+	m_endPos += QPoint(dx, dy);
+	if (!isDirty(DerivedGeometry::BoundsGeometry))
+		m_boundingRect.translate(dx, dy);
+	markDirty(DerivedGeometry::VerticesGeometry | DerivedGeometry::HitGeometry);
 }
 
 void LCanvasLine::moveItem(int dx, int dy)
 {
-	moveStartPos(dx, dy);
-	moveEndPos(dx, dy);
+	m_startPos += QPoint(dx, dy);
+	m_endPos += QPoint(dx, dy);
+	markMoved(dx, dy);
 }
 
 void LCanvasRect::moveItem(int dx, int dy)
 {
-	moveStartPos(dx, dy);
-	moveEndPos(dx, dy);
+	m_startPos += QPoint(dx, dy);
+	m_endPos += QPoint(dx, dy);
+	markMoved(dx, dy);
 }
 
 void LCanvasEllipse::moveItem(int dx, int dy)
 {
-	moveStartPos(dx, dy);
-	moveEndPos(dx, dy);
+	m_startPos += QPoint(dx, dy);
+	m_endPos += QPoint(dx, dy);
+	markMoved(dx, dy);
 }
 
 void LCanvasTriangle::moveItem(int dx, int dy)
 {
-	moveStartPos(dx, dy);
-	moveEndPos(dx, dy);
+	m_startPos += QPoint(dx, dy);
+	m_endPos += QPoint(dx, dy);
+	markMoved(dx, dy);
 }
 
 void LCanvasHexagon::moveItem(int dx, int dy)
 {
-	moveStartPos(dx, dy);
-	moveEndPos(dx, dy);
+	m_startPos += QPoint(dx, dy);
+	m_endPos += QPoint(dx, dy);
+	markMoved(dx, dy);
 }
 
 void LCanvasText::moveItem(int dx, int dy)
 {
-	moveStartPos(dx, dy);
-	setBoundingRect();
+	m_startPos += QPoint(dx, dy);
+	markMoved(dx, dy);
+}
+
+void LCanvasGroup::moveItem(int dx, int dy)
+{
+	// the raster is drawn relative to the bounds and moves with them
+	bool styled = m_nStyledEpoch == m_nEpoch;
+	foreach (auto &child, m_children)
+		child->moveItem(dx, dy);
+	markMoved(dx, dy);
+
+	if (styled)
+	{
+		foreach (auto &copy, m_styledChildren)
+			copy->moveItem(dx, dy);
+		m_nStyledEpoch = m_nEpoch;
+	}
+}
+
+void LCanvasInstance::moveItem(int dx, int dy)
+{
+	m_transform *= QTransform::fromTranslate(dx, dy);
+	markMoved(dx, dy);
 }
 
 // scaleItem
 void LCanvasPath::scaleItem(double sx, double sy)
 {
+	applyPointOffset();
 	for (int i = 0; i < m_points.size(); i++)
 	{
 		m_points[i].rx() *= sx;
 		m_points[i].ry() *= sy;
 	}
+	markDirty();
 }
 
 void LCanvasLine::scaleItem(double sx, double sy)
@@ -327,6 +1123,7 @@ void LCanvasLine::scaleItem(double sx, double sy)
 	m_startPos.ry() *= sy;
 	m_endPos.rx() *= sx;
 	m_endPos.ry() *= sy;
+	markDirty();
 }
 
 void LCanvasRect::scaleItem(double sx, double sy)
@@ -335,6 +1132,7 @@ void LCanvasRect::scaleItem(double sx, double sy)
 	m_startPos.ry() *= sy;
 	m_endPos.rx() *= sx;
 	m_endPos.ry() *= sy;
+	markDirty();
 }
 
 void LCanvasEllipse::scaleItem(double sx, double sy)
@@ -343,6 +1141,7 @@ void LCanvasEllipse::scaleItem(double sx, double sy)
 	m_startPos.ry() *= sy;
 	m_endPos.rx() *= sx;
 	m_endPos.ry() *= sy;
+	markDirty();
 }
 
 void LCanvasTriangle::scaleItem(double sx, double sy)
@@ -351,6 +1150,7 @@ void LCanvasTriangle::scaleItem(double sx, double sy)
 	m_startPos.ry() *= sy;
 	m_endPos.rx() *= sx;
 	m_endPos.ry() *= sy;
+	markDirty();
 }
 
 void LCanvasHexagon::scaleItem(double sx, double sy)
@@ -359,182 +1159,114 @@ void LCanvasHexagon::scaleItem(double sx, double sy)
 	m_startPos.ry() *= sy;
 	m_endPos.rx() *= sx;
 	m_endPos.ry() *= sy;
+	markDirty();
 }
 
 void LCanvasText::scaleItem(double sx, double sy)
 {
 	m_startPos.rx() *= sx;
 	m_startPos.ry() *= sy;
+	markDirty();
 }
 
-// stretchItemTo
-void LCanvasPath::stretchItemTo(StretchItemDir dir, int x, int y)
+void LCanvasGroup::scaleItem(double sx, double sy)
 {
-	int sx = 1, sy = 1;
-	int dx = 0, dy = 0;
-
-	if (dir & StretchItemDir::ToTop)
-	{
-
-	}
-	else if (dir & StretchItemDir::ToBottom)
-	{
-
-	}
-
-	if (dir & StretchItemDir::ToTop)
-	{
-
-	}
-	else if (dir & StretchItemDir::ToBottom)
-	{
-
-	}
+	foreach (auto &child, m_children)
+		child->scaleItem(sx, sy);
+	markDirty();
 }
 
-void LCanvasLine::stretchItemTo(StretchItemDir dir, int x, int y)
+void LCanvasInstance::scaleItem(double sx, double sy)
 {
-	int sx = 1, sy = 1;
-	int dx = 0, dy = 0;
-
-	if (dir & StretchItemDir::ToTop)
-	{
-
-	}
-	else if (dir & StretchItemDir::ToBottom)
-	{
-
-	}
-
-	if (dir & StretchItemDir::ToTop)
-	{
-
-	}
-	else if (dir & StretchItemDir::ToBottom)
-	{
-
-	}
+	m_transform *= QTransform::fromScale(sx, sy);
+	markDirty();
 }
 
-void LCanvasRect::stretchItemTo(StretchItemDir dir, int x, int y)
+// transformItem
+void LCanvasPath::transformItem(const QTransform &transform)
 {
-	int sx = 1, sy = 1;
-
-	if (dir & StretchItemDir::ToTop)
-	{
-
-	}
-	else if (dir & StretchItemDir::ToBottom)
-	{
-
-	}
-
-	if (dir & StretchItemDir::ToTop)
-	{
-
-	}
-	else if (dir & StretchItemDir::ToBottom)
-	{
-
-	}
+	applyPointOffset();
+	for (int i = 0; i < m_points.size(); ++i)
+		m_points[i] = transform.map(m_points[i]);
+	m_startPos = transform.map(m_startPos);
+	m_endPos = transform.map(m_endPos);
+	markDirty();
 }
 
-void LCanvasEllipse::stretchItemTo(StretchItemDir dir, int x, int y)
+void LCanvasLine::transformItem(const QTransform &transform)
 {
-	int sx = 1, sy = 1;
-
-	if (dir & StretchItemDir::ToTop)
-	{
-
-	}
-	else if (dir & StretchItemDir::ToBottom)
-	{
-
-	}
-
-	if (dir & StretchItemDir::ToTop)
-	{
-
-	}
-	else if (dir & StretchItemDir::ToBottom)
-	{
-
-	}
+	m_startPos = transform.map(m_startPos);
+	m_endPos = transform.map(m_endPos);
+	markDirty();
 }
 
-void LCanvasTriangle::stretchItemTo(StretchItemDir dir, int x, int y)
+void LCanvasRect::transformItem(const QTransform &transform)
 {
-	int sx = 1, sy = 1;
-
-	if (dir & StretchItemDir::ToTop)
-	{
-
-	}
-	else if (dir & StretchItemDir::ToBottom)
-	{
-
-	}
-
-	if (dir & StretchItemDir::ToTop)
-	{
-
-	}
-	else if (dir & StretchItemDir::ToBottom)
-	{
-
-	}
+	// a mirrored box is stored the right way round, the writer expects it
+	QPoint startPos = transform.map(m_startPos);
+	QPoint endPos = transform.map(m_endPos);
+	m_startPos = QPoint(qMin(startPos.x(), endPos.x()), qMin(startPos.y(), endPos.y()));
+	m_endPos = QPoint(qMax(startPos.x(), endPos.x()), qMax(startPos.y(), endPos.y()));
+	markDirty();
 }
 
-void LCanvasHexagon::stretchItemTo(StretchItemDir dir, int x, int y)
+void LCanvasEllipse::transformItem(const QTransform &transform)
 {
-	int sx = 1, sy = 1;
-
-	if (dir & StretchItemDir::ToTop)
-	{
-
-	}
-	else if (dir & StretchItemDir::ToBottom)
-	{
-
-	}
-
-	if (dir & StretchItemDir::ToTop)
-	{
-
-	}
-	else if (dir & StretchItemDir::ToBottom)
-	{
-
-	}
+	QPoint startPos = transform.map(m_startPos);
+	QPoint endPos = transform.map(m_endPos);
+	m_startPos = QPoint(qMin(startPos.x(), endPos.x()), qMin(startPos.y(), endPos.y()));
+	m_endPos = QPoint(qMax(startPos.x(), endPos.x()), qMax(startPos.y(), endPos.y()));
+	markDirty();
 }
 
-void LCanvasText::stretchItemTo(StretchItemDir dir, int x, int y)
+void LCanvasTriangle::transformItem(const QTransform &transform)
 {
-	int sx = 1, sy = 1;
-
-	if (dir & StretchItemDir::ToTop)
-	{
-
-	}
-	else if (dir & StretchItemDir::ToBottom)
-	{
+	m_startPos = transform.map(m_startPos);
+	m_endPos = transform.map(m_endPos);
+	markDirty();
+}
 
-	}
+void LCanvasHexagon::transformItem(const QTransform &transform)
+{
+	m_startPos = transform.map(m_startPos);
+	m_endPos = transform.map(m_endPos);
+	markDirty();
+}
 
-	if (dir & StretchItemDir::ToTop)
-	{
+void LCanvasText::transformItem(const QTransform &transform)
+{
+	// text keeps its font size and only follows its anchor
+	m_startPos = transform.map(m_startPos);
+	markDirty();
+}
 
-	}
-	else if (dir & StretchItemDir::ToBottom)
-	{
+void LCanvasGroup::transformItem(const QTransform &transform)
+{
+	foreach (auto &child, m_children)
+		child->transformItem(transform);
+	markDirty();
+}
 
-	}
+void LCanvasInstance::transformItem(const QTransform &transform)
+{
+	// the master stays as it is, only the placement changes
+	m_transform *= transform;
+	markDirty();
 }
 
 // updatePath
 void LCanvasPath::updatePath()
 {
-
+	// in block coordinates, painting applies the offset; read through at()
+	// so a shared block is not detached
+	m_path.clear();
+	for (int i = 0; i < m_points.size(); ++i)
+	{
+		if (i == 0)
+			m_path.moveTo(m_points.at(i));
+		else
+			m_path.lineTo(m_points.at(i));
+	}
 }
 
 void LCanvasLine::updatePath()
@@ -558,35 +1290,14 @@ void LCanvasEllipse::updatePath()
 
 void LCanvasTriangle::updatePath()
 {
-	int left = m_startPos.x();
-	int top = m_startPos.y();
-	int right = m_endPos.x();
-	int bottom = m_endPos.y();
-	m_vertices[0] = QPoint((left + right) / 2, top);
-	m_vertices[1] = QPoint(right, bottom);
-	m_vertices[2] = QPoint(left, bottom);
-	QPolygon polygon(m_vertices);
-
 	m_path.clear();
-	m_path.addPolygon(polygon);
+	m_path.addPolygon(polygon());
 }
 
 void LCanvasHexagon::updatePath()
 {
-	int left = m_startPos.x();
-	int top = m_startPos.y();
-	int right = m_endPos.x();
-	int bottom = m_endPos.y();
-	m_vertices[0] = QPoint((left * 3 + right) / 4, top);
-	m_vertices[1] = QPoint((left + right * 3) / 4, top);
-	m_vertices[2] = QPoint(right, (top + bottom) / 2);
-	m_vertices[3] = QPoint((left + right * 3) / 4, bottom);
-	m_vertices[4] = QPoint((left * 3 + right) / 4, bottom);
-	m_vertices[5] = QPoint(left, (top + bottom) / 2);
-	QPolygon polygon(m_vertices);
-
 	m_path.clear();
-	m_path.addPolygon(polygon);
+	m_path.addPolygon(polygon());
 }
 
 void LCanvasText::updatePath()
@@ -595,22 +1306,41 @@ void LCanvasText::updatePath()
 	m_path.addText(m_startPos, m_font, m_text);
 }
 
+void LCanvasGroup::updatePath()
+{
+	// children paint and hit-test with their own paths
+	m_path.clear();
+}
+
+void LCanvasInstance::updatePath()
+{
+	m_path.clear();
+}
+
 // setBoundingRect
 void LCanvasPath::setBoundingRect()
 {
-//	int left = m_points[0].x();
-//	int top = m_points[0].y();
-//	int right = m_points[0].x();
-//	int bottom = m_points[0].y();
-//	for (int i = 1; i < m_points.size(); ++i)
-//	{
-//		left = qMin(left, m_points[i].x());
-//		top = qMin(top, m_points[i].y());
-//		right = qMax(right, m_points[i].x());
-//		bottom = qMax(bottom, m_points[i].y());
-//	}
-//	m_boundingRect = QRect(QPoint(left, top), QPoint(right, bottom)).normalized();
-	m_boundingRect = m_path.boundingRect().toRect();
+	// taken from the points, the path itself is only built for painting
+	if (m_points.isEmpty())
+	{
+		m_boundingRect = QRect();
+		return;
+	}
+
+	const QPoint &first = m_points.at(0);
+	int left = first.x();
+	int top = first.y();
+	int right = first.x();
+	int bottom = first.y();
+	for (int i = 1; i < m_points.size(); ++i)
+	{
+		const QPoint &point = m_points.at(i);
+		left = qMin(left, point.x());
+		top = qMin(top, point.y());
+		right = qMax(right, point.x());
+		bottom = qMax(bottom, point.y());
+	}
+	m_boundingRect = QRect(QPoint(left, top), QPoint(right, bottom)).normalized().translated(m_pointOffset);
 	int d = (m_nStrokeWidth + 1) / 2 + 4;
 	m_boundingRect.adjust(-d, -d, d, d);
 }
@@ -672,48 +1402,91 @@ void LCanvasHexagon::setBoundingRect()
 
 void LCanvasText::setBoundingRect()
 {
+	QFontMetrics fontMetrics(m_font);
+	QRect rect = fontMetrics.boundingRect(m_text);
+	m_nWidth = rect.width() < 8 ? 8 : rect.width();
+	m_nHeight = rect.height();
+
 	m_boundingRect = QRect(m_startPos.x(), m_startPos.y(), m_nWidth, m_nHeight).normalized();
 	int d = 4;
 	m_boundingRect.adjust(-d, -d, d, d);
 }
 
+void LCanvasGroup::setBoundingRect()
+{
+	m_boundingRect = QRect();
+	foreach (auto &child, styledChildren())
+		m_boundingRect |= child->boundingRect();
+}
+
+void LCanvasInstance::setBoundingRect()
+{
+	LCanvasSymbol *symbol = styledSymbol();
+	m_boundingRect = symbol ? m_transform.mapRect(symbol->boundingRect()) : QRect();
+}
+
+// geometryRect
+QRect LCanvasText::geometryRect()
+{
+	QRect rect = boundingRect();
+	return rect.isValid() ? rect.adjusted(4, 4, -4, -4) : QRect();
+}
+
+QRect LCanvasGroup::geometryRect()
+{
+	QRect rect;
+	foreach (auto &child, m_children)
+		rect |= child->geometryRect();
+	return rect;
+}
+
+QRect LCanvasInstance::geometryRect()
+{
+	return m_symbol ? m_transform.mapRect(m_symbol->master()->geometryRect()) : QRect();
+}
+
 // containsPos
 bool LCanvasPath::containsPos(const QPoint &pos)
 {
 	int d = (m_nStrokeWidth + 1) / 2 + 2;
 	QRectF posRect(pos.x() - d, pos.y() - d, d * 2, d * 2);
-	return m_path.intersects(posRect);
+	return path().intersects(posRect.translated(-m_pointOffset));
 }
 
 bool LCanvasLine::containsPos(const QPoint &pos)
 {
-	QPainterPath path;
-	path.moveTo(m_startPos);
-	path.lineTo(m_endPos);
-
 	int d = (m_nStrokeWidth + 1) / 2 + 2;
 	QRectF posRect(pos.x() - d, pos.y() - d, d * 2, d * 2);
-	return path.intersects(posRect);
+	return path().intersects(posRect);
 }
 
 bool LCanvasRect::containsPos(const QPoint &point)
 {
-	QRect rect = m_boundingRect.adjusted(4, 4, -4, -4);
+	QRect rect = boundingRect().adjusted(4, 4, -4, -4);
 	return rect.contains(point);
 }
 
-bool LCanvasEllipse::containsPos(const QPoint &point)
+void LCanvasEllipse::updateHitGeometry()
 {
 	m_nWidth = abs(m_endPos.x() - m_startPos.x()) / 2;
 	m_nHeight = abs(m_endPos.y() - m_startPos.y()) / 2;
-	QPoint centerPoint = QPoint((m_startPos.x() + m_endPos.x())/2,(m_startPos.y() + m_endPos.y())/2);
-	return pow(point.x() - centerPoint.x(), 2) / pow(m_nWidth, 2) + pow(point.y() - centerPoint.y(), 2) / pow(m_nHeight, 2) <= 1;
+	m_centerPos = QPoint((m_startPos.x() + m_endPos.x()) / 2, (m_startPos.y() + m_endPos.y()) / 2);
+}
+
+bool LCanvasEllipse::containsPos(const QPoint &point)
+{
+	if (isDirty(DerivedGeometry::HitGeometry))
+	{
+		updateHitGeometry();
+		markClean(DerivedGeometry::HitGeometry);
+	}
+
+	return pow(point.x() - m_centerPos.x(), 2) / pow(m_nWidth, 2) + pow(point.y() - m_centerPos.y(), 2) / pow(m_nHeight, 2) <= 1;
 }
 
 bool LCanvasTriangle::containsPos(const QPoint &point)
 {
-	QPolygon polygon(m_vertices);
-	if (polygon.containsPoint(point, Qt::WindingFill))
+	if (polygon().containsPoint(point, Qt::WindingFill))
 		return true;
 
 	return false;
@@ -721,8 +1494,7 @@ bool LCanvasTriangle::containsPos(const QPoint &point)
 
 bool LCanvasHexagon::containsPos(const QPoint &point)
 {
-	QPolygon polygon(m_vertices);
-	if (polygon.containsPoint(point, Qt::WindingFill))
+	if (polygon().containsPoint(point, Qt::WindingFill))
 		return true;
 
 	return false;
@@ -730,12 +1502,117 @@ bool LCanvasHexagon::containsPos(const QPoint &point)
 
 bool LCanvasText::containsPos(const QPoint &point)
 {
-	if (m_boundingRect.isValid())
-		return m_boundingRect.contains(point);
+	QRect rect = boundingRect();
+	if (rect.isValid())
+		return rect.contains(point);
 
 	return false;
 }
 
+bool LCanvasGroup::containsPos(const QPoint &point)
+{
+	// most points miss the group as a whole, its children are not visited
+	if (!boundingRect().contains(point))
+		return false;
+
+	const LCanvasItemList &children = styledChildren();
+	for (int i = children.size() - 1; i >= 0; --i)
+	{
+		if (children[i]->containsPos(point))
+			return true;
+	}
+
+	return false;
+}
+
+bool LCanvasInstance::containsPos(const QPoint &point)
+{
+	LCanvasSymbol *symbol = styledSymbol();
+	if (!symbol || !boundingRect().contains(point))
+		return false;
+
+	// the master is hit-tested in symbol coordinates
+	bool invertible = false;
+	QTransform inverse = m_transform.inverted(&invertible);
+	return invertible && symbol->master()->containsPos(inverse.map(point));
+}
+
+// paintPickShape
+// covers what containsPos answers true for, in the painter's brush color;
+// the pick buffer draws it without antialiasing
+void LCanvasPath::paintPickShape(QPainter &painter)
+{
+	// intersects() also counts the area the path encloses
+	int d = (m_nStrokeWidth + 1) / 2 + 2;
+	painter.save();
+	painter.translate(m_pointOffset);
+	painter.setPen(QPen(painter.brush().color(), d * 2, Qt::SolidLine, Qt::SquareCap, Qt::MiterJoin));
+	painter.drawPath(path());
+	painter.restore();
+}
+
+void LCanvasLine::paintPickShape(QPainter &painter)
+{
+	int d = (m_nStrokeWidth + 1) / 2 + 2;
+	painter.save();
+	painter.setPen(QPen(painter.brush().color(), d * 2, Qt::SolidLine, Qt::SquareCap, Qt::MiterJoin));
+	painter.drawPath(path());
+	painter.restore();
+}
+
+void LCanvasRect::paintPickShape(QPainter &painter)
+{
+	QRect rect = boundingRect().adjusted(4, 4, -4, -4);
+	if (rect.isValid())
+		painter.fillRect(rect, painter.brush());
+}
+
+void LCanvasEllipse::paintPickShape(QPainter &painter)
+{
+	if (isDirty(DerivedGeometry::HitGeometry))
+	{
+		updateHitGeometry();
+		markClean(DerivedGeometry::HitGeometry);
+	}
+
+	painter.drawEllipse(QPointF(m_centerPos), m_nWidth, m_nHeight);
+}
+
+void LCanvasTriangle::paintPickShape(QPainter &painter)
+{
+	painter.drawPolygon(polygon(), Qt::WindingFill);
+}
+
+void LCanvasHexagon::paintPickShape(QPainter &painter)
+{
+	painter.drawPolygon(polygon(), Qt::WindingFill);
+}
+
+void LCanvasText::paintPickShape(QPainter &painter)
+{
+	QRect rect = boundingRect();
+	if (rect.isValid())
+		painter.fillRect(rect, painter.brush());
+}
+
+void LCanvasGroup::paintPickShape(QPainter &painter)
+{
+	foreach (auto &child, styledChildren())
+		child->paintPickShape(painter);
+}
+
+void LCanvasInstance::paintPickShape(QPainter &painter)
+{
+	LCanvasSymbol *symbol = styledSymbol();
+	if (!symbol)
+		return;
+
+	painter.save();
+	painter.setTransform(m_transform, true);
+	symbol->master()->paintPickShape(painter);
+	painter.restore();
+}
+
 // clone
 SPtrLCanvasItem LCanvasPath::clone()
 {
@@ -772,100 +1649,142 @@ SPtrLCanvasItem LCanvasText::clone()
 	return SPtrLCanvasItem(new LCanvasText(*this));
 }
 
-// writeItemToXml
-void LCanvasPath::writeItemToXml(QXmlStreamWriter &writer)
+SPtrLCanvasItem LCanvasGroup::clone()
+{
+	// the copy gets children of its own, moving it must not move the original
+	LCanvasGroup *group = new LCanvasGroup(*this);
+	for (int i = 0; i < group->m_children.size(); ++i)
+		group->m_children[i] = m_children[i]->clone();
+	group->m_styledChildren.clear();
+	group->m_nStyledEpoch = 0;
+	return SPtrLCanvasItem(group);
+}
+
+SPtrLCanvasItem LCanvasInstance::clone()
 {
-	QString pointPath = QString("M%1 %2").arg(m_points[0].x()).arg(m_points[0].y());
-	for (int i = 1; i < m_points.size(); i++)
-		pointPath += QString(" L%1 %2").arg(m_points[i].x()).arg(m_points[i].y());
+	// the symbol is shared, the copy is just another placement of it
+	return SPtrLCanvasItem(new LCanvasInstance(*this));
+}
 
-	writer.writeStartElement(QString::fromUtf8("path"));
-	writer.writeAttribute(QString::fromUtf8("d"), pointPath);
-	writer.writeAttribute(QString::fromUtf8("fill"), QString::fromUtf8("none"));
-	writer.writeAttribute(QString::fromUtf8("stroke"), m_strokeColor.name());
+// writeItemToXml
+void LCanvasPath::writeItemToXml(LSvgStreamWriter &writer)
+{
+	writer.writeStartElement("path");
+	writer.writePathAttribute(SvgAttr::D, points());
+	writer.writeAttribute(SvgAttr::Fill, "none");
+	writer.writeAttribute(SvgAttr::Stroke, m_strokeColor);
 	writer.writeEndElement();
 }
 
-void LCanvasLine::writeItemToXml(QXmlStreamWriter &writer)
+void LCanvasLine::writeItemToXml(LSvgStreamWriter &writer)
 {
-	writer.writeStartElement(QString::fromUtf8("line"));
-	writer.writeAttribute(QString::fromUtf8("x1"), QString::number(m_startPos.x()));
-	writer.writeAttribute(QString::fromUtf8("y1"), QString::number(m_startPos.y()));
-	writer.writeAttribute(QString::fromUtf8("x2"), QString::number(m_endPos.x()));
-	writer.writeAttribute(QString::fromUtf8("y2"), QString::number(m_endPos.y()));
-	writer.writeAttribute(QString::fromUtf8("stroke"), m_strokeColor.name());
-	writer.writeAttribute(QString::fromUtf8("stroke-width"), QString::number(m_nStrokeWidth));
+	writer.writeStartElement("line");
+	writer.writeAttribute(SvgAttr::X1, m_startPos.x());
+	writer.writeAttribute(SvgAttr::Y1, m_startPos.y());
+	writer.writeAttribute(SvgAttr::X2, m_endPos.x());
+	writer.writeAttribute(SvgAttr::Y2, m_endPos.y());
+	writer.writeAttribute(SvgAttr::Stroke, m_strokeColor);
+	writer.writeAttribute(SvgAttr::StrokeWidth, m_nStrokeWidth);
 	writer.writeEndElement();
 }
 
-void LCanvasRect::writeItemToXml(QXmlStreamWriter &writer)
+void LCanvasRect::writeItemToXml(LSvgStreamWriter &writer)
 {
-	writer.writeStartElement(QString::fromUtf8("rect"));
-	writer.writeAttribute(QString::fromUtf8("x"), QString::number(m_startPos.x()));
-	writer.writeAttribute(QString::fromUtf8("y"), QString::number(m_startPos.y()));
-	writer.writeAttribute(QString::fromUtf8("width"), QString::number(qAbs(m_endPos.x() - m_startPos.x())));
-	writer.writeAttribute(QString::fromUtf8("height"), QString::number(qAbs(m_endPos.y() - m_startPos.y())));
-	writer.writeAttribute(QString::fromUtf8("fill"), m_fillColor.name());
-	writer.writeAttribute(QString::fromUtf8("stroke"), m_strokeColor.name());
-	writer.writeAttribute(QString::fromUtf8("stroke-width"), QString::number(m_nStrokeWidth));
+	writer.writeStartElement("rect");
+	writer.writeAttribute(SvgAttr::X, m_startPos.x());
+	writer.writeAttribute(SvgAttr::Y, m_startPos.y());
+	writer.writeAttribute(SvgAttr::Width, qAbs(m_endPos.x() - m_startPos.x()));
+	writer.writeAttribute(SvgAttr::Height, qAbs(m_endPos.y() - m_startPos.y()));
+	writer.writeAttribute(SvgAttr::Fill, m_fillColor);
+	writer.writeAttribute(SvgAttr::Stroke, m_strokeColor);
+	writer.writeAttribute(SvgAttr::StrokeWidth, m_nStrokeWidth);
 	writer.writeEndElement();
 }
 
-void LCanvasEllipse::writeItemToXml(QXmlStreamWriter& xmlWriter)
+void LCanvasEllipse::writeItemToXml(LSvgStreamWriter &writer)
 {
-	xmlWriter.writeStartElement(QString::fromUtf8("ellipse"));
-	xmlWriter.writeAttribute(QString::fromUtf8("cx"), QString::number((m_startPos.x() + m_endPos.x()) / 2));
-	xmlWriter.writeAttribute(QString::fromUtf8("cy"), QString::number((m_startPos.y() + m_endPos.y()) / 2));
-	xmlWriter.writeAttribute(QString::fromUtf8("rx"), QString::number(qAbs(m_endPos.x() - m_startPos.x()) / 2));
-	xmlWriter.writeAttribute(QString::fromUtf8("ry"), QString::number(qAbs(m_endPos.y() - m_startPos.y()) / 2));
-	xmlWriter.writeAttribute(QString::fromUtf8("fill"), m_fillColor.name());
-	xmlWriter.writeAttribute(QString::fromUtf8("stroke"), m_strokeColor.name());
-	xmlWriter.writeAttribute(QString::fromUtf8("stroke-width"), QString::number(m_nStrokeWidth));
-	xmlWriter.writeEndElement();
+	writer.writeStartElement("ellipse");
+	writer.writeAttribute(SvgAttr::Cx, (m_startPos.x() + m_endPos.x()) / 2);
+	writer.writeAttribute(SvgAttr::Cy, (m_startPos.y() + m_endPos.y()) / 2);
+	writer.writeAttribute(SvgAttr::Rx, qAbs(m_endPos.x() - m_startPos.x()) / 2);
+	writer.writeAttribute(SvgAttr::Ry, qAbs(m_endPos.y() - m_startPos.y()) / 2);
+	writer.writeAttribute(SvgAttr::Fill, m_fillColor);
+	writer.writeAttribute(SvgAttr::Stroke, m_strokeColor);
+	writer.writeAttribute(SvgAttr::StrokeWidth, m_nStrokeWidth);
+	writer.writeEndElement();
 }
 
-void LCanvasTriangle::writeItemToXml(QXmlStreamWriter &writer)
+void LCanvasTriangle::writeItemToXml(LSvgStreamWriter &writer)
 {
-	QString points;
-	for (int i = 0; i < m_vertices.size(); ++i)
-	{
-		if (i) points += " ";
-		points += QString("%1,%2").arg(m_vertices[i].x()).arg(m_vertices[i].y());
-	}
+	writer.writeStartElement("polygon");
+	writer.writePointsAttribute(SvgAttr::Points, vertices());
+	writer.writeAttribute(SvgAttr::Fill, m_fillColor);
+	writer.writeAttribute(SvgAttr::Stroke, m_strokeColor);
+	writer.writeAttribute(SvgAttr::StrokeWidth, m_nStrokeWidth);
+	writer.writeEndElement();
+}
 
-	writer.writeStartElement(QString::fromUtf8("polygon"));
-	writer.writeAttribute(QString::fromUtf8("points"), points);
-	writer.writeAttribute(QString::fromUtf8("fill"), m_fillColor.name());
-	writer.writeAttribute(QString::fromUtf8("stroke"), m_strokeColor.name());
-	writer.writeAttribute(QString::fromUtf8("stroke-width"), QString::number(m_nStrokeWidth));
+void LCanvasHexagon::writeItemToXml(LSvgStreamWriter &writer)
+{
+	writer.writeStartElement("polygon");
+	writer.writePointsAttribute(SvgAttr::Points, vertices());
+	writer.writeAttribute(SvgAttr::Fill, m_fillColor);
+	writer.writeAttribute(SvgAttr::Stroke, m_strokeColor);
+	writer.writeAttribute(SvgAttr::StrokeWidth, m_nStrokeWidth);
 	writer.writeEndElement();
 }
 
-void LCanvasHexagon::writeItemToXml(QXmlStreamWriter &writer)
+void LCanvasText::writeItemToXml(LSvgStreamWriter &writer)
 {
-	QString points;
-	for (int i = 0; i < m_vertices.size(); ++i)
-	{
-		if (i) points += " ";
-		points += QString("%1,%2").arg(m_vertices[i].x()).arg(m_vertices[i].y());
-	}
+	writer.writeStartElement("text");
+	writer.writeAttribute(SvgAttr::FontFamily, m_font.family());
+	writer.writeAttribute(SvgAttr::FontSize, m_font.pointSize());
+	writer.writeAttribute(SvgAttr::X, m_startPos.x());
+	writer.writeAttribute(SvgAttr::Y, m_startPos.y());
+	writer.writeCharacters(m_text);
+	writer.writeEndElement();
+}
 
-	writer.writeStartElement(QString::fromUtf8("polygon"));
-	writer.writeAttribute(QString::fromUtf8("points"), points);
-	writer.writeAttribute(QString::fromUtf8("fill"), m_fillColor.name());
-	writer.writeAttribute(QString::fromUtf8("stroke"), m_strokeColor.name());
-	writer.writeAttribute(QString::fromUtf8("stroke-width"), QString::number(m_nStrokeWidth));
+void LCanvasGroup::writeItemToXml(LSvgStreamWriter &writer)
+{
+	writer.writeStartElement("g");
+	if (m_nOverrides & StyleOverride::FillOverride)
+		writer.writeAttribute(SvgAttr::Fill, m_fillColor);
+	if (m_nOverrides & StyleOverride::StrokeOverride)
+		writer.writeAttribute(SvgAttr::Stroke, m_strokeColor);
+	if (m_nOverrides & StyleOverride::StrokeWidthOverride)
+		writer.writeAttribute(SvgAttr::StrokeWidth, m_nStrokeWidth);
+	foreach (auto &child, m_children)
+		child->writeItemToXml(writer);
 	writer.writeEndElement();
 }
 
-void LCanvasText::writeItemToXml(QXmlStreamWriter &writer)
+void LCanvasInstance::writeItemToXml(LSvgStreamWriter &writer)
 {
-	writer.writeStartElement(QString::fromUtf8("text"));
-	writer.writeAttribute(QString::fromUtf8("font-family"), m_font.family());
-	writer.writeAttribute(QString::fromUtf8("font-size"), QString::number(m_font.pointSize()));
-	writer.writeAttribute(QString::fromUtf8("x"), QString::number(m_startPos.x()));
-	writer.writeAttribute(QString::fromUtf8("y"), QString::number(m_startPos.y()));
-	writer.writeCharacters(m_text);
+	if (!m_symbol)
+		return;
+
+	writer.writeStartElement("use");
+	writer.writeAttribute(SvgAttr::Href, QString::fromUtf8("#") + m_symbol->id());
+
+	// whole-pixel offsets read back exactly from x and y
+	if (m_transform.type() <= QTransform::TxTranslate &&
+		m_transform.dx() == qRound(m_transform.dx()) && m_transform.dy() == qRound(m_transform.dy()))
+	{
+		writer.writeAttribute(SvgAttr::X, qRound(m_transform.dx()));
+		writer.writeAttribute(SvgAttr::Y, qRound(m_transform.dy()));
+	}
+	else
+	{
+		writer.writeAttribute(SvgAttr::Transform, m_transform);
+	}
+
+	if (m_nOverrides & StyleOverride::FillOverride)
+		writer.writeAttribute(SvgAttr::Fill, m_fillColor);
+	if (m_nOverrides & StyleOverride::StrokeOverride)
+		writer.writeAttribute(SvgAttr::Stroke, m_strokeColor);
+	if (m_nOverrides & StyleOverride::StrokeWidthOverride)
+		writer.writeAttribute(SvgAttr::StrokeWidth, m_nStrokeWidth);
 	writer.writeEndElement();
 }
 
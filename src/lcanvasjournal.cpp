@@ -0,0 +1,611 @@
+#include "lcanvasjournal.h"
+#include "lcanvasbinary.h"
+#include "lcanvastrace.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace lwscode {
+
+static const char JournalMagic[4] = { 'L', 'W', 'S', 'J' };
+static const quint32 JournalVersion = 3;
+
+// compaction bounds the replay time after a crash and the disk the log takes
+static const int CompactRecordCount = 4096;
+static const qint64 CompactFileSize = 4 << 20;
+
+static QDataStream &operator<<(QDataStream &stream, const SPtrLCanvasItem &item)
+{
+	stream << qint32(item->getItemType()) << item->fillColor() << item->strokeColor()
+		   << qint32(item->strokeWidth()) << item->startPos() << item->endPos()
+		   << item->points() << item->text() << item->font();
+
+	// groups carry their children inline
+	if (item->getItemType() == ItemType::Group)
+	{
+		LCanvasItemList children = item->children();
+		stream << qint32(item->styleOverrides()) << qint32(children.size());
+		foreach (auto &child, children)
+			stream << child;
+	}
+
+	// instances carry their symbol's master, replay shares it again by id
+	if (item->getItemType() == ItemType::Instance)
+	{
+		SPtrLCanvasSymbol symbol = item->symbol();
+		stream << symbol->id() << item->transform() << qint32(item->styleOverrides()) << symbol->master();
+	}
+	return stream;
+}
+
+typedef QHash<QString, SPtrLCanvasSymbol> LSymbolTable;
+
+static SPtrLCanvasItem readItem(QDataStream &stream, LSymbolTable &symbols)
+{
+	qint32 type = 0;
+	QColor fillColor;
+	QColor strokeColor;
+	qint32 strokeWidth = 0;
+	QPoint startPos;
+	QPoint endPos;
+	QPoints points;
+	QString text;
+	QFont font;
+	stream >> type >> fillColor >> strokeColor >> strokeWidth >> startPos >> endPos
+		   >> points >> text >> font;
+
+	SPtrLCanvasItem item = LCanvasItem::createItem(ItemType(type));
+	if (!item || stream.status() != QDataStream::Ok)
+		return SPtrLCanvasItem();
+
+	foreach (auto &point, points)
+		item->addPoint(point);
+
+	if (item->getItemType() == ItemType::Text)
+	{
+		item->setFont(font);
+		item->setText(text);
+	}
+
+	if (item->getItemType() == ItemType::Instance)
+	{
+		QString id;
+		QTransform transform;
+		qint32 overrides = 0;
+		stream >> id >> transform >> overrides;
+		SPtrLCanvasItem master = readItem(stream, symbols);
+		if (!master)
+			return SPtrLCanvasItem();
+
+		// an id can name another master later in the log, once the symbol that
+		// had it is gone, so the master carried inline decides
+		SPtrLCanvasSymbol &symbol = symbols[id];
+		if (!symbol || symbol->contentHash() != master->contentHash())
+			symbol = SPtrLCanvasSymbol(new LCanvasSymbol(id, master));
+
+		LCanvasInstance *instance = static_cast<LCanvasInstance *>(item.data());
+		instance->setSymbol(symbol);
+		instance->setTransform(transform);
+		item->setStyle(overrides, fillColor, strokeColor, strokeWidth);
+		item->updateGeometry();
+		return item;
+	}
+
+	// a group only has the style it overrides
+	if (item->getItemType() != ItemType::Group)
+		item->setStyle(StyleOverride::FillOverride | StyleOverride::StrokeOverride | StyleOverride::StrokeWidthOverride,
+					   fillColor, strokeColor, strokeWidth);
+	item->setStartPos(startPos);
+	item->setEndPos(endPos);
+
+	if (item->getItemType() == ItemType::Group)
+	{
+		qint32 overrides = 0;
+		qint32 count = 0;
+		stream >> overrides >> count;
+		item->setStyle(overrides, fillColor, strokeColor, strokeWidth);
+		for (int i = 0; i < count; ++i)
+		{
+			SPtrLCanvasItem child = readItem(stream, symbols);
+			if (!child)
+				return SPtrLCanvasItem();
+			item->addChild(child);
+		}
+	}
+	item->updateGeometry();
+
+	return item;
+}
+
+// false when any index is outside the items, the record then names items
+// the log does not have
+static bool readIndices(QDataStream &stream, int size, QVector<int> &result)
+{
+	QVector<qint32> indices;
+	stream >> indices;
+
+	result.clear();
+	result.reserve(indices.size());
+	foreach (qint32 index, indices)
+	{
+		if (index < 0 || index >= size)
+			return false;
+		result << index;
+	}
+
+	return stream.status() == QDataStream::Ok;
+}
+
+static QByteArray journalHeader()
+{
+	QByteArray header(JournalMagic, sizeof(JournalMagic));
+	quint32 version = qToLittleEndian(JournalVersion);
+	header.append(reinterpret_cast<const char *>(&version), sizeof(version));
+	return header;
+}
+
+static QByteArray frameRecord(const QByteArray &record)
+{
+	quint32 size = qToLittleEndian(quint32(record.size()));
+	QByteArray frame(reinterpret_cast<const char *>(&size), sizeof(size));
+	frame += record;
+	return frame;
+}
+
+LCanvasJournal::LCanvasJournal()
+	: m_nSnapshot(0)
+	, m_nRecords(0)
+{
+
+}
+
+LCanvasJournal::~LCanvasJournal()
+{
+	m_file.close();
+}
+
+bool LCanvasJournal::open()
+{
+	QString dir = autosaveDir();
+	if (dir.isEmpty() || !QDir().mkpath(dir))
+		return false;
+
+	QString name = QString::fromUtf8("%1-%2").arg(QDateTime::currentMSecsSinceEpoch())
+			.arg(QCoreApplication::applicationPid());
+	m_filePath = QDir(dir).filePath(name + QString::fromUtf8(".journal"));
+
+	m_lock.reset(new QLockFile(m_filePath + QString::fromUtf8(".lock")));
+	if (!m_lock->tryLock(0))
+	{
+		m_lock.reset();
+		return false;
+	}
+
+	return compact(LCanvasItemList(), QSize());
+}
+
+void LCanvasJournal::discard()
+{
+	if (m_filePath.isEmpty())
+		return;
+
+	m_file.close();
+	QFile::remove(m_filePath);
+	if (!m_snapshotPath.isEmpty())
+		QFile::remove(m_snapshotPath);
+
+	m_lock.reset();
+	m_filePath.clear();
+	m_snapshotPath.clear();
+}
+
+bool LCanvasJournal::isOpen() const
+{
+	return m_file.isOpen();
+}
+
+void LCanvasJournal::setDocumentPath(const QString &filePath)
+{
+	m_documentPath = filePath;
+
+	QByteArray record;
+	QDataStream stream(&record, QIODevice::WriteOnly);
+	stream.setVersion(QDataStream::Qt_5_6);
+	stream << quint8(JournalOp::DocumentPathOp) << filePath;
+	appendRecord(record);
+}
+
+void LCanvasJournal::addItems(int index, const LCanvasItemList &items)
+{
+	QByteArray record;
+	QDataStream stream(&record, QIODevice::WriteOnly);
+	stream.setVersion(QDataStream::Qt_5_6);
+	stream << quint8(JournalOp::AddItemsOp) << qint32(index) << qint32(items.size());
+	foreach (auto &item, items)
+		stream << item;
+	appendRecord(record);
+}
+
+void LCanvasJournal::removeItems(const QVector<int> &indices)
+{
+	QByteArray record;
+	QDataStream stream(&record, QIODevice::WriteOnly);
+	stream.setVersion(QDataStream::Qt_5_6);
+	stream << quint8(JournalOp::RemoveItemsOp) << indices;
+	appendRecord(record);
+}
+
+void LCanvasJournal::moveItems(const QVector<int> &indices, int dx, int dy)
+{
+	QByteArray record;
+	QDataStream stream(&record, QIODevice::WriteOnly);
+	stream.setVersion(QDataStream::Qt_5_6);
+	stream << quint8(JournalOp::MoveItemsOp) << indices << qint32(dx) << qint32(dy);
+	appendRecord(record);
+}
+
+void LCanvasJournal::setItemGeometry(int index, const QPoint &startPos, const QPoint &endPos)
+{
+	QByteArray record;
+	QDataStream stream(&record, QIODevice::WriteOnly);
+	stream.setVersion(QDataStream::Qt_5_6);
+	stream << quint8(JournalOp::SetGeometryOp) << qint32(index) << startPos << endPos;
+	appendRecord(record);
+}
+
+void LCanvasJournal::transformItems(const QVector<int> &indices, const QTransform &transform)
+{
+	QByteArray record;
+	QDataStream stream(&record, QIODevice::WriteOnly);
+	stream.setVersion(QDataStream::Qt_5_6);
+	stream << quint8(JournalOp::TransformItemsOp) << indices << transform;
+	appendRecord(record);
+}
+
+void LCanvasJournal::setItemFillColor(const QVector<int> &indices, const QColor &color)
+{
+	setItemStyle(indices, StyleOverride::FillOverride, color, 0);
+}
+
+void LCanvasJournal::setItemStrokeColor(const QVector<int> &indices, const QColor &color)
+{
+	setItemStyle(indices, StyleOverride::StrokeOverride, color, 0);
+}
+
+void LCanvasJournal::setItemStrokeWidth(const QVector<int> &indices, int width)
+{
+	setItemStyle(indices, StyleOverride::StrokeWidthOverride, QColor(), width);
+}
+
+void LCanvasJournal::reorderItem(int from, int to)
+{
+	QByteArray record;
+	QDataStream stream(&record, QIODevice::WriteOnly);
+	stream.setVersion(QDataStream::Qt_5_6);
+	stream << quint8(JournalOp::ReorderItemOp) << qint32(from) << qint32(to);
+	appendRecord(record);
+}
+
+void LCanvasJournal::clearItems()
+{
+	QByteArray record;
+	QDataStream stream(&record, QIODevice::WriteOnly);
+	stream.setVersion(QDataStream::Qt_5_6);
+	stream << quint8(JournalOp::ClearItemsOp);
+	appendRecord(record);
+}
+
+bool LCanvasJournal::needsCompaction() const
+{
+	return m_file.isOpen() && (m_nRecords >= CompactRecordCount || m_file.size() >= CompactFileSize);
+}
+
+bool LCanvasJournal::compact(const LCanvasItemList &items, const QSize &canvasSize)
+{
+	LCANVAS_TRACE_ARG("journal", "compact", items.size());
+
+	if (m_filePath.isEmpty())
+		return false;
+
+	// a new snapshot goes next to the old one, and the log switches over to it
+	// with an atomic replace, so a crash in between leaves a consistent pair
+	QString snapshotPath;
+	if (!items.isEmpty())
+	{
+		snapshotPath = m_filePath + QString::fromUtf8(".%1.lwsb").arg(m_nSnapshot + 1);
+		LCanvasBinaryFormat format;
+		if (!format.write(snapshotPath, items, canvasSize))
+			return false;
+	}
+
+	QByteArray record;
+	QDataStream stream(&record, QIODevice::WriteOnly);
+	stream.setVersion(QDataStream::Qt_5_6);
+	stream << quint8(JournalOp::SnapshotOp) << QFileInfo(snapshotPath).fileName();
+
+	QByteArray pathRecord;
+	QDataStream pathStream(&pathRecord, QIODevice::WriteOnly);
+	pathStream.setVersion(QDataStream::Qt_5_6);
+	pathStream << quint8(JournalOp::DocumentPathOp) << m_documentPath;
+
+	m_file.close();
+	QSaveFile file(m_filePath);
+	if (!file.open(QFile::WriteOnly))
+		return false;
+
+	file.write(journalHeader());
+	file.write(frameRecord(record));
+	file.write(frameRecord(pathRecord));
+	if (!file.commit())
+	{
+		if (!snapshotPath.isEmpty())
+			QFile::remove(snapshotPath);
+		return false;
+	}
+
+	if (!m_snapshotPath.isEmpty())
+		QFile::remove(m_snapshotPath);
+	m_snapshotPath = snapshotPath;
+	++m_nSnapshot;
+	m_nRecords = 0;
+
+	m_file.setFileName(m_filePath);
+	return m_file.open(QFile::WriteOnly | QFile::Append);
+}
+
+QString LCanvasJournal::findOrphan()
+{
+	QDir dir(autosaveDir());
+	QFileInfoList journals = dir.entryInfoList(QStringList() << QString::fromUtf8("*.journal"),
+											   QDir::Files, QDir::Time);
+	foreach (auto &journal, journals)
+	{
+		// a live editor holds the lock, a crashed one left a stale lock behind
+		QLockFile lock(journal.filePath() + QString::fromUtf8(".lock"));
+		if (lock.tryLock(0))
+			return journal.filePath();
+	}
+
+	return QString();
+}
+
+// false only when nothing can be recovered: the log or its snapshot does not
+// read; a bad record later on ends the replay with the edits before it
+bool LCanvasJournal::replay(const QString &journalPath, LCanvasItemList &items,
+							QSize &canvasSize, QString &documentPath)
+{
+	LCANVAS_TRACE("journal", "replay");
+
+	QFile file(journalPath);
+	if (!file.open(QFile::ReadOnly))
+		return false;
+
+	QByteArray data = file.readAll();
+	file.close();
+
+	QByteArray header = journalHeader();
+	if (!data.startsWith(header))
+		return false;
+
+	items.clear();
+	LSymbolTable symbols;
+	int pos = header.size();
+	bool valid = true;
+	while (valid && data.size() - pos >= int(sizeof(quint32)))
+	{
+		quint32 size = qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(data.constData() + pos));
+		pos += sizeof(quint32);
+
+		// a torn record at the tail is the edit that was in flight when the editor died
+		if (size > quint32(data.size() - pos))
+			break;
+
+		QByteArray record = QByteArray::fromRawData(data.constData() + pos, int(size));
+		pos += int(size);
+
+		QDataStream stream(record);
+		stream.setVersion(QDataStream::Qt_5_6);
+		quint8 op = 0;
+		stream >> op;
+
+		// every record is read whole before it is applied; the first one that
+		// does not read or does not fit the items ends the replay, and what
+		// came before it is kept
+		switch (op)
+		{
+		case JournalOp::SnapshotOp:
+		{
+			QString snapshotName;
+			stream >> snapshotName;
+			items.clear();
+			if (!snapshotName.isEmpty())
+			{
+				// the snapshot starts the log, without it nothing can be recovered
+				LCanvasBinaryFormat format;
+				if (!format.read(QFileInfo(journalPath).dir().filePath(snapshotName)))
+					return false;
+				items = format.items();
+				symbols = format.symbols();
+				canvasSize = format.canvasSize();
+			}
+			break;
+		}
+		case JournalOp::AddItemsOp:
+		{
+			qint32 index = 0;
+			qint32 count = 0;
+			stream >> index >> count;
+			LCanvasItemList added;
+			for (int i = 0; i < count && valid; ++i)
+			{
+				SPtrLCanvasItem item = readItem(stream, symbols);
+				valid = !item.isNull();
+				added << item;
+			}
+			if (!valid || index < 0 || index > items.size())
+			{
+				valid = false;
+				break;
+			}
+			foreach (auto &item, added)
+				items.insert(index++, item);
+			break;
+		}
+		case JournalOp::RemoveItemsOp:
+		{
+			QVector<int> indices;
+			valid = readIndices(stream, items.size(), indices);
+			if (!valid)
+				break;
+			std::sort(indices.begin(), indices.end(), std::greater<int>());
+			indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+			foreach (int index, indices)
+				items.removeAt(index);
+			break;
+		}
+		case JournalOp::MoveItemsOp:
+		{
+			QVector<int> indices;
+			qint32 dx = 0;
+			qint32 dy = 0;
+			valid = readIndices(stream, items.size(), indices);
+			stream >> dx >> dy;
+			valid = valid && stream.status() == QDataStream::Ok;
+			if (!valid)
+				break;
+			foreach (int index, indices)
+				items[index]->moveItem(dx, dy);
+			break;
+		}
+		case JournalOp::SetGeometryOp:
+		{
+			qint32 index = -1;
+			QPoint startPos;
+			QPoint endPos;
+			stream >> index >> startPos >> endPos;
+			valid = stream.status() == QDataStream::Ok && index >= 0 && index < items.size();
+			if (!valid)
+				break;
+			items[index]->setStartPos(startPos);
+			items[index]->setEndPos(endPos);
+			break;
+		}
+		case JournalOp::TransformItemsOp:
+		{
+			QVector<int> indices;
+			QTransform transform;
+			valid = readIndices(stream, items.size(), indices);
+			stream >> transform;
+			valid = valid && stream.status() == QDataStream::Ok;
+			if (!valid)
+				break;
+			foreach (int index, indices)
+				items[index]->transformItem(transform);
+			break;
+		}
+		case JournalOp::SetStyleOp:
+		{
+			QVector<int> indices;
+			qint32 property = StyleOverride::NoOverride;
+			QColor color;
+			qint32 width = 0;
+			valid = readIndices(stream, items.size(), indices);
+			stream >> property;
+			if (property == StyleOverride::StrokeWidthOverride)
+				stream >> width;
+			else
+				stream >> color;
+			valid = valid && stream.status() == QDataStream::Ok;
+			if (!valid)
+				break;
+			foreach (int index, indices)
+			{
+				if (property == StyleOverride::FillOverride)
+					items[index]->setFillColor(color);
+				else if (property == StyleOverride::StrokeOverride)
+					items[index]->setStrokeColor(color);
+				else if (property == StyleOverride::StrokeWidthOverride)
+					items[index]->setStrokeWidth(width);
+			}
+			break;
+		}
+		case JournalOp::ReorderItemOp:
+		{
+			qint32 from = -1;
+			qint32 to = -1;
+			stream >> from >> to;
+			valid = stream.status() == QDataStream::Ok && from >= 0 && from < items.size()
+					&& to >= 0 && to < items.size();
+			if (!valid)
+				break;
+			items.move(from, to);
+			break;
+		}
+		case JournalOp::ClearItemsOp:
+		{
+			items.clear();
+			break;
+		}
+		case JournalOp::DocumentPathOp:
+		{
+			stream >> documentPath;
+			break;
+		}
+		default:
+		{
+			valid = false;
+			break;
+		}
+		}
+	}
+
+	return true;
+}
+
+void LCanvasJournal::remove(const QString &journalPath)
+{
+	QFileInfo info(journalPath);
+	QStringList snapshots = info.dir().entryList(QStringList() << info.fileName() + QString::fromUtf8(".*.lwsb"),
+												 QDir::Files);
+	foreach (auto &snapshot, snapshots)
+		QFile::remove(info.dir().filePath(snapshot));
+
+	QFile::remove(journalPath);
+	QFile::remove(journalPath + QString::fromUtf8(".lock"));
+}
+
+// one property per record, replay leaves the others as the items have them
+void LCanvasJournal::setItemStyle(const QVector<int> &indices, int property, const QColor &color, int width)
+{
+	QByteArray record;
+	QDataStream stream(&record, QIODevice::WriteOnly);
+	stream.setVersion(QDataStream::Qt_5_6);
+	stream << quint8(JournalOp::SetStyleOp) << indices << qint32(property);
+	if (property == StyleOverride::StrokeWidthOverride)
+		stream << qint32(width);
+	else
+		stream << color;
+	appendRecord(record);
+}
+
+void LCanvasJournal::appendRecord(const QByteArray &record)
+{
+	if (!m_file.isOpen())
+		return;
+
+	// flushed per record so that the log survives the process, not the machine
+	m_file.write(frameRecord(record));
+	m_file.flush();
+	++m_nRecords;
+}
+
+QString LCanvasJournal::autosaveDir()
+{
+	QString dir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
+	if (dir.isEmpty())
+		return QString();
+
+	return QDir(dir).filePath(QString::fromUtf8("autosave"));
+}
+
+} // namespace
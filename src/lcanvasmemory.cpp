@@ -0,0 +1,280 @@
+#include "lcanvasmemory.h"
+
+namespace lwscode {
+
+LCanvasMemoryReport::LCanvasMemoryReport()
+	: m_scope(MemoryScope::DocumentScope)
+{
+	memset(m_bytes, 0, sizeof(m_bytes));
+	memset(m_nItems, 0, sizeof(m_nItems));
+}
+
+void LCanvasMemoryReport::addItems(const LCanvasItemList &items, MemoryScope scope)
+{
+	m_scope = scope;
+	foreach (auto &item, items)
+	{
+		int type = item->getItemType();
+		if (type < 0 || type >= TypeCount)
+			continue;
+
+		// pasted copies may still alias items already counted
+		if (m_claimed.contains(item.data()))
+			continue;
+
+		++m_nItems[scope][type];
+		item->accountMemory(*this);
+
+		// children are counted under their own types
+		addItems(item->children(), scope);
+
+		// a symbol's masters and raster go to the first instance met
+		SPtrLCanvasSymbol symbol = item->symbol();
+		if (symbol && claim(symbol.data()))
+		{
+			add(ItemType::Instance, MemoryComponent::ObjectMemory, sizeof(LCanvasSymbol));
+			add(ItemType::Instance, MemoryComponent::HandleMemory, handleSize());
+			add(ItemType::Instance, MemoryComponent::RasterMemory, symbol->rasterBytes());
+			addItems(symbol->masters(), scope);
+		}
+	}
+}
+
+void LCanvasMemoryReport::addList(const QString &name, const LCanvasItemList &items)
+{
+	m_lists << qMakePair(name, 32 + items.size() * listSlotSize());
+}
+
+void LCanvasMemoryReport::add(ItemType itemType, MemoryComponent component, qint64 bytes)
+{
+	if (itemType < 0 || itemType >= TypeCount)
+		return;
+
+	m_bytes[m_scope][itemType][component] += bytes;
+}
+
+bool LCanvasMemoryReport::claim(const void *data)
+{
+	if (m_claimed.contains(data))
+		return false;
+
+	m_claimed.insert(data);
+	return true;
+}
+
+int LCanvasMemoryReport::itemCount(ItemType itemType, MemoryScope scope) const
+{
+	return m_nItems[scope][itemType];
+}
+
+qint64 LCanvasMemoryReport::bytes(ItemType itemType, MemoryScope scope, MemoryComponent component) const
+{
+	return m_bytes[scope][itemType][component];
+}
+
+qint64 LCanvasMemoryReport::typeBytes(ItemType itemType, MemoryScope scope) const
+{
+	qint64 total = 0;
+	for (int component = 0; component < ComponentCount; ++component)
+		total += m_bytes[scope][itemType][component];
+	return total;
+}
+
+qint64 LCanvasMemoryReport::scopeBytes(MemoryScope scope) const
+{
+	qint64 total = 0;
+	for (int type = 0; type < TypeCount; ++type)
+		total += typeBytes(ItemType(type), scope);
+	return total;
+}
+
+QList<QPair<QString, qint64> > LCanvasMemoryReport::lists() const
+{
+	return m_lists;
+}
+
+qint64 LCanvasMemoryReport::totalBytes() const
+{
+	qint64 total = 0;
+	for (int scope = 0; scope < ScopeCount; ++scope)
+		total += scopeBytes(MemoryScope(scope));
+	foreach (auto &list, m_lists)
+		total += list.second;
+	return total;
+}
+
+QString LCanvasMemoryReport::toText() const
+{
+	QString text;
+	QTextStream stream(&text);
+	stream << "scope,type,items";
+	for (int component = 0; component < ComponentCount; ++component)
+		stream << "," << componentName(MemoryComponent(component)).toLower();
+	stream << ",total\n";
+
+	for (int scope = 0; scope < ScopeCount; ++scope)
+	{
+		for (int type = 0; type < TypeCount; ++type)
+		{
+			if (m_nItems[scope][type] == 0)
+				continue;
+
+			stream << scopeName(MemoryScope(scope)).toLower() << "," << typeName(ItemType(type)).toLower()
+				   << "," << m_nItems[scope][type];
+			for (int component = 0; component < ComponentCount; ++component)
+				stream << "," << m_bytes[scope][type][component];
+			stream << "," << typeBytes(ItemType(type), MemoryScope(scope)) << "\n";
+		}
+	}
+
+	foreach (auto &list, m_lists)
+		stream << "# list " << list.first << " " << list.second << "\n";
+	stream << "# total " << totalBytes() << "\n";
+	stream.flush();
+
+	return text;
+}
+
+QString LCanvasMemoryReport::typeName(ItemType itemType)
+{
+	switch (itemType)
+	{
+	case ItemType::Path: { return QString::fromUtf8("Path"); }
+	case ItemType::Line: { return QString::fromUtf8("Line"); }
+	case ItemType::Rect: { return QString::fromUtf8("Rect"); }
+	case ItemType::Ellipse: { return QString::fromUtf8("Ellipse"); }
+	case ItemType::Triangle: { return QString::fromUtf8("Triangle"); }
+	case ItemType::Hexagon: { return QString::fromUtf8("Hexagon"); }
+	case ItemType::Text: { return QString::fromUtf8("Text"); }
+	case ItemType::Group: { return QString::fromUtf8("Group"); }
+	case ItemType::Instance: { return QString::fromUtf8("Instance"); }
+	default: { return QString(); }
+	}
+}
+
+QString LCanvasMemoryReport::componentName(MemoryComponent component)
+{
+	switch (component)
+	{
+	case MemoryComponent::ObjectMemory: { return QString::fromUtf8("Object"); }
+	case MemoryComponent::BoundsMemory: { return QString::fromUtf8("Bounds"); }
+	case MemoryComponent::StyleMemory: { return QString::fromUtf8("Style"); }
+	case MemoryComponent::PathMemory: { return QString::fromUtf8("Path"); }
+	case MemoryComponent::PointsMemory: { return QString::fromUtf8("Points"); }
+	case MemoryComponent::TextMemory: { return QString::fromUtf8("Text"); }
+	case MemoryComponent::RasterMemory: { return QString::fromUtf8("Raster"); }
+	case MemoryComponent::HandleMemory: { return QString::fromUtf8("Handle"); }
+	default: { return QString(); }
+	}
+}
+
+QString LCanvasMemoryReport::scopeName(MemoryScope scope)
+{
+	switch (scope)
+	{
+	case MemoryScope::DocumentScope: { return QString::fromUtf8("Document"); }
+	case MemoryScope::ClipboardScope: { return QString::fromUtf8("Clipboard"); }
+	default: { return QString(); }
+	}
+}
+
+qint64 LCanvasMemoryReport::listSlotSize()
+{
+	// Qt 5 lists keep large types in separately allocated nodes
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+	return sizeof(SPtrLCanvasItem);
+#else
+	return sizeof(void *) + sizeof(SPtrLCanvasItem);
+#endif
+}
+
+qint64 LCanvasMemoryReport::handleSize()
+{
+	// the shared pointer's control block, two counts and a deleter
+	return 2 * sizeof(int) + 2 * sizeof(void *);
+}
+
+LCanvasMemoryPanel::LCanvasMemoryPanel(QWidget *parent)
+	: QDialog(parent)
+{
+	setWindowTitle(tr("Memory Usage"));
+	resize(720, 400);
+
+	QVBoxLayout *mainLayout = new QVBoxLayout(this);
+
+	m_tree = new QTreeWidget(this);
+	QStringList headers;
+	headers << tr("Type") << tr("Items");
+	for (int component = 0; component < ComponentCount; ++component)
+		headers << LCanvasMemoryReport::componentName(MemoryComponent(component));
+	headers << tr("Total");
+	m_tree->setHeaderLabels(headers);
+	m_tree->setRootIsDecorated(true);
+	mainLayout->addWidget(m_tree);
+
+	QHBoxLayout *buttonLayout = new QHBoxLayout();
+	m_totalLabel = new QLabel(this);
+	buttonLayout->addWidget(m_totalLabel);
+	buttonLayout->addStretch();
+	QPushButton *refreshButton = new QPushButton(tr("Refresh"), this);
+	connect(refreshButton, SIGNAL(clicked()), this, SIGNAL(refreshRequested()));
+	buttonLayout->addWidget(refreshButton);
+	QPushButton *closeButton = new QPushButton(tr("Close"), this);
+	connect(closeButton, SIGNAL(clicked()), this, SLOT(close()));
+	buttonLayout->addWidget(closeButton);
+	mainLayout->addLayout(buttonLayout);
+}
+
+void LCanvasMemoryPanel::setReport(const LCanvasMemoryReport &report)
+{
+	m_tree->clear();
+
+	QLocale locale;
+	int columns = ComponentCount + 3;
+	for (int scope = 0; scope < ScopeCount; ++scope)
+	{
+		QTreeWidgetItem *scopeItem = new QTreeWidgetItem(m_tree);
+		scopeItem->setText(0, LCanvasMemoryReport::scopeName(MemoryScope(scope)));
+		scopeItem->setText(columns - 1, locale.formattedDataSize(report.scopeBytes(MemoryScope(scope))));
+
+		int scopeItems = 0;
+		for (int type = ItemType::Path; type <= ItemType::Instance; ++type)
+		{
+			int count = report.itemCount(ItemType(type), MemoryScope(scope));
+			if (count == 0)
+				continue;
+
+			scopeItems += count;
+			QTreeWidgetItem *typeItem = new QTreeWidgetItem(scopeItem);
+			typeItem->setText(0, LCanvasMemoryReport::typeName(ItemType(type)));
+			typeItem->setText(1, QString::number(count));
+			for (int component = 0; component < ComponentCount; ++component)
+			{
+				qint64 bytes = report.bytes(ItemType(type), MemoryScope(scope), MemoryComponent(component));
+				typeItem->setText(component + 2, locale.formattedDataSize(bytes));
+			}
+			typeItem->setText(columns - 1, locale.formattedDataSize(report.typeBytes(ItemType(type), MemoryScope(scope))));
+		}
+		scopeItem->setText(1, QString::number(scopeItems));
+	}
+
+	QTreeWidgetItem *listsItem = new QTreeWidgetItem(m_tree);
+	listsItem->setText(0, tr("Lists"));
+	qint64 listsBytes = 0;
+	foreach (auto &list, report.lists())
+	{
+		QTreeWidgetItem *listItem = new QTreeWidgetItem(listsItem);
+		listItem->setText(0, list.first);
+		listItem->setText(columns - 1, locale.formattedDataSize(list.second));
+		listsBytes += list.second;
+	}
+	listsItem->setText(columns - 1, locale.formattedDataSize(listsBytes));
+
+	m_tree->expandAll();
+	for (int column = 0; column < columns; ++column)
+		m_tree->resizeColumnToContents(column);
+
+	m_totalLabel->setText(tr("Total: %1").arg(locale.formattedDataSize(report.totalBytes())));
+}
+
+} // namespace
@@ -0,0 +1,207 @@
+#include "lcanvaspick.h"
+#include "lcanvasstats.h"
+#include "lcanvastrace.h"
+
+namespace lwscode {
+
+// ids are stored in the 24 color bits of each pixel
+static const quint32 MaxPickId = 0xffffff;
+// past this many rects in one sync a full redraw is cheaper than the region
+static const int MaxDirtyRects = 256;
+
+LCanvasPickBuffer::LCanvasPickBuffer()
+	: m_nDirtyRects(0)
+	, m_bAllDirty(true)
+	, m_bOverflow(false)
+	, m_nStamp(0)
+{
+	m_items << QWeakPointer<LCanvasItem>();
+}
+
+bool LCanvasPickBuffer::isValid() const
+{
+	return !m_image.isNull() && !m_bOverflow;
+}
+
+// forgets every item, for when the view drops its items all at once
+void LCanvasPickBuffer::reset()
+{
+	m_records.clear();
+	m_items.resize(1);
+	m_freeIds.clear();
+	m_bOverflow = false;
+	invalidateAll();
+}
+
+void LCanvasPickBuffer::sync(const LCanvasItemList &items, const QSize &size)
+{
+	LCANVAS_TRACE_ARG("pick", "sync", items.size());
+	// ids are handed out again from scratch, the document may fit now
+	if (m_bOverflow)
+		reset();
+
+	if (m_image.size() != size)
+	{
+		m_image = size.isEmpty() ? QImage() : QImage(size, QImage::Format_RGB32);
+		invalidateAll();
+	}
+
+	// an item is redrawn where it was and where it is when its epoch or bounds
+	// changed, or when an item that used to be above it is now below
+	++m_nStamp;
+	int lastOrder = -1;
+	for (int i = 0; i < items.size(); ++i)
+	{
+		const SPtrLCanvasItem &item = items.at(i);
+		QRect bounds = item->boundingRect().adjusted(-1, -1, 1, 1);
+		auto it = m_records.find(item.data());
+		if (it != m_records.end() && it.value().item.isNull())
+		{
+			// the item this was recorded for is gone and another took its address
+			invalidate(it.value().bounds);
+			releaseId(it.value().id);
+			m_records.erase(it);
+			it = m_records.end();
+		}
+
+		if (it == m_records.end())
+		{
+			LPickRecord record = { item.toWeakRef(), allocateId(item), i, item->dirtyEpoch(), bounds, m_nStamp };
+			m_records.insert(item.data(), record);
+			invalidate(bounds);
+			continue;
+		}
+
+		LPickRecord &record = it.value();
+		bool reordered = record.order < lastOrder;
+		lastOrder = qMax(lastOrder, record.order);
+		if (reordered || record.epoch != item->dirtyEpoch() || record.bounds != bounds)
+		{
+			invalidate(record.bounds);
+			invalidate(bounds);
+		}
+		record.order = i;
+		record.epoch = item->dirtyEpoch();
+		record.bounds = bounds;
+		record.stamp = m_nStamp;
+	}
+
+	for (auto it = m_records.begin(); it != m_records.end();)
+	{
+		if (it.value().stamp == m_nStamp)
+		{
+			++it;
+			continue;
+		}
+
+		invalidate(it.value().bounds);
+		releaseId(it.value().id);
+		it = m_records.erase(it);
+	}
+}
+
+// only the dirty area is redrawn, and only when a pick falls into it; items
+// are the list the buffer was last synced with
+SPtrLCanvasItem LCanvasPickBuffer::pick(const LCanvasItemList &items, const QPoint &pos)
+{
+	if (!isValid() || !m_image.rect().contains(pos))
+		return SPtrLCanvasItem();
+
+	if (m_bAllDirty || m_dirty.contains(pos))
+	{
+		LCanvasStats::addCacheMiss();
+		render(items);
+	}
+	else
+	{
+		LCanvasStats::addCacheHit();
+	}
+
+	quint32 id = reinterpret_cast<const QRgb *>(m_image.constScanLine(pos.y()))[pos.x()] & MaxPickId;
+	return int(id) < m_items.size() ? m_items.at(int(id)).toStrongRef() : SPtrLCanvasItem();
+}
+
+void LCanvasPickBuffer::render(const LCanvasItemList &items)
+{
+	LCANVAS_TRACE_ARG("pick", "render", items.size());
+	QRegion region = m_bAllDirty ? QRegion(m_image.rect()) : m_dirty.intersected(m_image.rect());
+	m_dirty = QRegion();
+	m_nDirtyRects = 0;
+	m_bAllDirty = false;
+	if (region.isEmpty())
+		return;
+
+	QPainter painter(&m_image);
+	painter.setClipRegion(region);
+	painter.fillRect(region.boundingRect(), QColor(Qt::black));
+
+	// a pixel is covered when its center is, as containsPos tests whole points
+	painter.translate(0.5, 0.5);
+	painter.setPen(Qt::NoPen);
+	QRect regionRect = region.boundingRect();
+	foreach (auto &item, items)
+	{
+		auto it = m_records.constFind(item.data());
+		if (it == m_records.constEnd())
+			continue;
+
+		const LPickRecord &record = it.value();
+		if (!regionRect.intersects(record.bounds) || !region.intersects(record.bounds))
+			continue;
+
+		painter.setBrush(QColor(QRgb(0xff000000 | record.id)));
+		item->paintPickShape(painter);
+	}
+}
+
+void LCanvasPickBuffer::invalidate(const QRect &rect)
+{
+	if (m_bAllDirty || !rect.isValid())
+		return;
+
+	if (++m_nDirtyRects > MaxDirtyRects)
+	{
+		invalidateAll();
+		return;
+	}
+
+	m_dirty += rect;
+}
+
+void LCanvasPickBuffer::invalidateAll()
+{
+	m_dirty = QRegion();
+	m_nDirtyRects = 0;
+	m_bAllDirty = true;
+}
+
+quint32 LCanvasPickBuffer::allocateId(const SPtrLCanvasItem &item)
+{
+	if (!m_freeIds.isEmpty())
+	{
+		quint32 id = m_freeIds.takeLast();
+		m_items[int(id)] = item.toWeakRef();
+		return id;
+	}
+
+	// more items than colors, the view falls back to testing them one by one
+	if (quint32(m_items.size()) > MaxPickId)
+	{
+		m_bOverflow = true;
+		return 0;
+	}
+
+	m_items << item.toWeakRef();
+	return quint32(m_items.size() - 1);
+}
+
+void LCanvasPickBuffer::releaseId(quint32 id)
+{
+	if (id == 0)
+		return;
+
+	m_items[int(id)].clear();
+	m_freeIds << id;
+}
+
+} // namespace
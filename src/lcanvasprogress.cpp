@@ -0,0 +1,43 @@
+#include "lcanvasprogress.h"
+
+namespace lwscode {
+
+LCanvasProgress::LCanvasProgress()
+	: m_canceled(0)
+	, m_done(0)
+	, m_total(0)
+{
+
+}
+
+void LCanvasProgress::cancel()
+{
+	m_canceled.storeRelaxed(1);
+}
+
+bool LCanvasProgress::isCanceled() const
+{
+	return m_canceled.loadRelaxed() != 0;
+}
+
+void LCanvasProgress::setTotal(qint64 total)
+{
+	m_total.storeRelaxed(total);
+	m_done.storeRelaxed(0);
+}
+
+void LCanvasProgress::advance(qint64 amount)
+{
+	m_done.fetchAndAddRelaxed(amount);
+}
+
+int LCanvasProgress::percent() const
+{
+	qint64 total = m_total.loadRelaxed();
+	if (total <= 0)
+		return 0;
+
+	return int(qBound<qint64>(0, m_done.loadRelaxed() * 100 / total, 100));
+}
+
+} // namespace
@@ -0,0 +1,1791 @@
+#include "lcanvasreader.h"
+#include "lcanvasgzip.h"
+#include "lcanvastrace.h"
+
+namespace lwscode {
+
+// the scanning helpers run over UTF-8 bytes from the mapped reader and over
+// UTF-16 code units from the stream reader alike
+
+template <typename Char>
+static bool isSpace(Char ch)
+{
+	return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+template <typename Char>
+static bool isDigit(Char ch)
+{
+	return ch >= '0' && ch <= '9';
+}
+
+template <typename Char>
+static int hexValue(Char ch)
+{
+	if (ch >= '0' && ch <= '9')
+		return ch - '0';
+	if (ch >= 'a' && ch <= 'f')
+		return ch - 'a' + 10;
+	if (ch >= 'A' && ch <= 'F')
+		return ch - 'A' + 10;
+	return -1;
+}
+
+template <typename Char>
+static bool readNumber(const Char *&pos, const Char *end, int &value)
+{
+	while (pos < end && !isDigit(*pos) && *pos != '-' && *pos != '+' && *pos != '.')
+		++pos;
+
+	if (pos >= end)
+		return false;
+
+	bool negative = false;
+	if (*pos == '-' || *pos == '+')
+	{
+		negative = (*pos == '-');
+		++pos;
+	}
+
+	qint64 integer = 0;
+	while (pos < end && isDigit(*pos))
+		integer = integer * 10 + (*pos++ - '0');
+
+	if (pos < end && *pos == '.')
+	{
+		++pos;
+		if (pos < end && *pos >= '5' && *pos <= '9')
+			++integer;
+		while (pos < end && isDigit(*pos))
+			++pos;
+	}
+
+	value = negative ? -int(integer) : int(integer);
+	return true;
+}
+
+template <typename Char>
+static int readNumbers(const Char *pos, const Char *end, int *values, int count)
+{
+	int i = 0;
+	while (i < count && readNumber(pos, end, values[i]))
+		++i;
+
+	return i;
+}
+
+static int readNumbers(const LByteView &view, int *values, int count)
+{
+	return readNumbers(view.data(), view.data() + view.size(), values, count);
+}
+
+template <typename Char>
+static bool isAlpha(Char ch)
+{
+	return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
+}
+
+// transforms keep their fractions, coordinates are rounded by readNumber
+template <typename Char>
+static bool readReal(const Char *&pos, const Char *end, qreal &value)
+{
+	while (pos < end && (isSpace(*pos) || *pos == ','))
+		++pos;
+
+	if (pos >= end || !(isDigit(*pos) || *pos == '-' || *pos == '+' || *pos == '.'))
+		return false;
+
+	char text[32];
+	int size = 0;
+	while (pos < end && size < int(sizeof(text)) - 1 &&
+		   (isDigit(*pos) || *pos == '.' || *pos == 'e' || *pos == 'E' ||
+			((*pos == '-' || *pos == '+') && (size == 0 || text[size - 1] == 'e' || text[size - 1] == 'E'))))
+	{
+		text[size++] = char(*pos++);
+	}
+	text[size] = 0;
+
+	bool ok = false;
+	value = QByteArray::fromRawData(text, size).toDouble(&ok);
+	return ok;
+}
+
+// an svg transform list: matrix, translate, scale and rotate about the origin,
+// the rightmost applied first
+template <typename Char>
+static QTransform readTransform(const Char *pos, const Char *end)
+{
+	QTransform result;
+	while (pos < end)
+	{
+		while (pos < end && !isAlpha(*pos))
+			++pos;
+
+		const Char *nameBegin = pos;
+		while (pos < end && isAlpha(*pos))
+			++pos;
+		int nameSize = int(pos - nameBegin);
+
+		while (pos < end && *pos != '(')
+			++pos;
+		if (pos >= end)
+			break;
+		++pos;
+
+		qreal values[6] = { 0, 0, 0, 0, 0, 0 };
+		int count = 0;
+		while (count < 6 && readReal(pos, end, values[count]))
+			++count;
+
+		while (pos < end && *pos != ')')
+			++pos;
+		if (pos < end)
+			++pos;
+
+		char name[10] = { 0 };
+		for (int i = 0; i < nameSize && i < int(sizeof(name)) - 1; ++i)
+			name[i] = char(nameBegin[i]);
+
+		QTransform transform;
+		if (strcmp(name, "matrix") == 0 && count == 6)
+			transform.setMatrix(values[0], values[1], 0, values[2], values[3], 0, values[4], values[5], 1);
+		else if (strcmp(name, "translate") == 0 && count >= 1)
+			transform.translate(values[0], count > 1 ? values[1] : 0);
+		else if (strcmp(name, "scale") == 0 && count >= 1)
+			transform.scale(values[0], count > 1 ? values[1] : values[0]);
+		else if (strcmp(name, "rotate") == 0 && count == 1)
+			transform.rotate(values[0]);
+
+		result = transform * result;
+	}
+
+	return result;
+}
+
+// reads the polyline subset of svg path data: absolute and relative moveto,
+// lineto, horizontal and vertical lineto and closepath, with implicit repeats;
+// bare number pairs without a command are taken as absolute points
+template <typename Char>
+static bool readPathData(const Char *pos, const Char *end, QPoints &points)
+{
+	char command = 0;
+	QPoint current;
+	QPoint subpathStart;
+	while (pos < end)
+	{
+		Char ch = *pos;
+		if (isSpace(ch) || ch == ',')
+		{
+			++pos;
+			continue;
+		}
+
+		if (isAlpha(ch))
+		{
+			command = char(ch);
+			++pos;
+			if ((ch == 'Z' || ch == 'z') && !points.isEmpty())
+			{
+				current = subpathStart;
+				if (points.last() != current)
+					points << current;
+			}
+			continue;
+		}
+
+		if (!isDigit(ch) && ch != '-' && ch != '+' && ch != '.')
+		{
+			++pos;
+			continue;
+		}
+
+		int x = 0;
+		int y = 0;
+		QPoint point;
+		switch (command)
+		{
+		case 0:
+		case 'M':
+		case 'm':
+		case 'L':
+		case 'l':
+		{
+			if (!readNumber(pos, end, x) || !readNumber(pos, end, y))
+				return !points.isEmpty();
+
+			bool relative = (command == 'm' || command == 'l');
+			point = relative ? current + QPoint(x, y) : QPoint(x, y);
+			if (command == 'M' || command == 'm')
+			{
+				subpathStart = point;
+				command = (command == 'M') ? 'L' : 'l';
+			}
+			break;
+		}
+		case 'H':
+		case 'h':
+		{
+			if (!readNumber(pos, end, x))
+				return !points.isEmpty();
+
+			point = QPoint(command == 'h' ? current.x() + x : x, current.y());
+			break;
+		}
+		case 'V':
+		case 'v':
+		{
+			if (!readNumber(pos, end, y))
+				return !points.isEmpty();
+
+			point = QPoint(current.x(), command == 'v' ? current.y() + y : y);
+			break;
+		}
+		default:
+		{
+			// curves are outside the subset, keep what was read so far
+			return !points.isEmpty();
+		}
+		}
+
+		points << point;
+		current = point;
+	}
+
+	return !points.isEmpty();
+}
+
+struct LSvgName
+{
+	const char *name;
+	int id;
+};
+
+// perfect hashes over length, first and last character; the tables were
+// generated for exactly the names below, a hit still compares the name
+static const LSvgName SvgTagTable[16] = {
+	{ nullptr, SvgTag::TagNone }, { "g", SvgTag::TagGroup },
+	{ "rect", SvgTag::TagRect }, { "use", SvgTag::TagUse },
+	{ "text", SvgTag::TagText }, { "defs", SvgTag::TagDefs },
+	{ nullptr, SvgTag::TagNone }, { "ellipse", SvgTag::TagEllipse },
+	{ nullptr, SvgTag::TagNone }, { "polygon", SvgTag::TagPolygon },
+	{ nullptr, SvgTag::TagNone }, { "line", SvgTag::TagLine },
+	{ "path", SvgTag::TagPath }, { "symbol", SvgTag::TagSymbol },
+	{ nullptr, SvgTag::TagNone }, { "svg", SvgTag::TagSvg },
+};
+
+static const LSvgName SvgAttributeTable[64] = {
+	{ nullptr, SvgAttribute::AttrNone }, { nullptr, SvgAttribute::AttrNone },
+	{ nullptr, SvgAttribute::AttrNone }, { "transform", SvgAttribute::AttrTransform },
+	{ "rx", SvgAttribute::AttrRx }, { "font-size", SvgAttribute::AttrFontSize },
+	{ "height", SvgAttribute::AttrHeight }, { nullptr, SvgAttribute::AttrNone },
+	{ nullptr, SvgAttribute::AttrNone }, { "x", SvgAttribute::AttrX },
+	{ nullptr, SvgAttribute::AttrNone }, { nullptr, SvgAttribute::AttrNone },
+	{ nullptr, SvgAttribute::AttrNone }, { nullptr, SvgAttribute::AttrNone },
+	{ nullptr, SvgAttribute::AttrNone }, { "stroke", SvgAttribute::AttrStroke },
+	{ nullptr, SvgAttribute::AttrNone }, { "subset", SvgAttribute::AttrSubset },
+	{ "fill", SvgAttribute::AttrFill }, { "cy", SvgAttribute::AttrCy },
+	{ nullptr, SvgAttribute::AttrNone }, { nullptr, SvgAttribute::AttrNone },
+	{ "x2", SvgAttribute::AttrX2 }, { "y2", SvgAttribute::AttrY2 },
+	{ nullptr, SvgAttribute::AttrNone }, { nullptr, SvgAttribute::AttrNone },
+	{ nullptr, SvgAttribute::AttrNone }, { nullptr, SvgAttribute::AttrNone },
+	{ nullptr, SvgAttribute::AttrNone }, { "d", SvgAttribute::AttrD },
+	{ nullptr, SvgAttribute::AttrNone }, { "font-family", SvgAttribute::AttrFontFamily },
+	{ "href", SvgAttribute::AttrHref }, { nullptr, SvgAttribute::AttrNone },
+	{ "ry", SvgAttribute::AttrRy }, { "id", SvgAttribute::AttrId },
+	{ nullptr, SvgAttribute::AttrNone }, { nullptr, SvgAttribute::AttrNone },
+	{ nullptr, SvgAttribute::AttrNone }, { nullptr, SvgAttribute::AttrNone },
+	{ "y", SvgAttribute::AttrY }, { nullptr, SvgAttribute::AttrNone },
+	{ nullptr, SvgAttribute::AttrNone }, { nullptr, SvgAttribute::AttrNone },
+	{ "width", SvgAttribute::AttrWidth }, { nullptr, SvgAttribute::AttrNone },
+	{ nullptr, SvgAttribute::AttrNone }, { "stroke-width", SvgAttribute::AttrStrokeWidth },
+	{ "points", SvgAttribute::AttrPoints }, { nullptr, SvgAttribute::AttrNone },
+	{ nullptr, SvgAttribute::AttrNone }, { nullptr, SvgAttribute::AttrNone },
+	{ nullptr, SvgAttribute::AttrNone }, { "cx", SvgAttribute::AttrCx },
+	{ nullptr, SvgAttribute::AttrNone }, { nullptr, SvgAttribute::AttrNone },
+	{ "x1", SvgAttribute::AttrX1 }, { "y1", SvgAttribute::AttrY1 },
+	{ nullptr, SvgAttribute::AttrNone }, { nullptr, SvgAttribute::AttrNone },
+	{ nullptr, SvgAttribute::AttrNone }, { nullptr, SvgAttribute::AttrNone },
+	{ nullptr, SvgAttribute::AttrNone }, { nullptr, SvgAttribute::AttrNone },
+};
+
+// QXmlStreamReader hands out QStringRef in Qt 5 and QStringView in Qt 6
+template <typename String>
+static QStringView toStringView(const String &string)
+{
+	return QStringView(string.data(), string.size());
+}
+
+// names are ascii, a byte compares as unsigned like a utf-16 code unit
+static uint codeUnit(char ch)
+{
+	return uchar(ch);
+}
+
+template <typename Char>
+static uint codeUnit(Char ch)
+{
+	return uint(ch);
+}
+
+template <typename Char>
+static bool equalsLatin1(const Char *name, int size, const char *latin1)
+{
+	int i = 0;
+	for (; i < size; ++i)
+	{
+		if (!latin1[i] || codeUnit(name[i]) != uchar(latin1[i]))
+			return false;
+	}
+
+	return latin1[i] == 0;
+}
+
+static bool equalsLatin1(QStringView view, const char *latin1)
+{
+	return equalsLatin1(view.utf16(), int(view.size()), latin1);
+}
+
+template <typename Char>
+static SvgTag tagId(const Char *name, int size)
+{
+	if (size <= 0)
+		return SvgTag::TagNone;
+
+	int hash = (size + int(codeUnit(name[0])) + int(codeUnit(name[size - 1])) * 15) & 15;
+	const LSvgName &entry = SvgTagTable[hash];
+	return (entry.name && equalsLatin1(name, size, entry.name)) ? SvgTag(entry.id) : SvgTag::TagNone;
+}
+
+static SvgTag tagId(QStringView name)
+{
+	return tagId(name.utf16(), int(name.size()));
+}
+
+template <typename Char>
+static SvgAttribute attributeId(const Char *name, int size)
+{
+	if (size <= 0)
+		return SvgAttribute::AttrNone;
+
+	int hash = (size + int(codeUnit(name[0])) + int(codeUnit(name[size - 1])) * 30) & 63;
+	const LSvgName &entry = SvgAttributeTable[hash];
+	return (entry.name && equalsLatin1(name, size, entry.name)) ? SvgAttribute(entry.id) : SvgAttribute::AttrNone;
+}
+
+static SvgAttribute attributeId(QStringView name)
+{
+	return attributeId(name.utf16(), int(name.size()));
+}
+
+static void readAttributes(const QXmlStreamAttributes &xmlAttributes, LSvgAttributes &attributes)
+{
+	for (int i = 0; i < SvgAttribute::AttrCount; ++i)
+		attributes.values[i] = QStringView();
+
+	for (int i = 0; i < xmlAttributes.size(); ++i)
+	{
+		const QXmlStreamAttribute &attribute = xmlAttributes.at(i);
+		SvgAttribute id = attributeId(toStringView(attribute.name()));
+		if (id != SvgAttribute::AttrNone)
+			attributes.values[id] = toStringView(attribute.value());
+	}
+}
+
+static int toInt(QStringView view)
+{
+	const auto *pos = view.utf16();
+	int value = 0;
+	if (!readNumber(pos, pos + view.size(), value))
+		return 0;
+
+	return value;
+}
+
+static QColor toColor(QStringView view)
+{
+	if (view.size() == 7 && view[0] == QLatin1Char('#'))
+	{
+		int rgb[6];
+		for (int i = 0; i < 6; ++i)
+		{
+			rgb[i] = hexValue(view[i + 1].unicode());
+			if (rgb[i] < 0)
+				return QColor();
+		}
+
+		return QColor(rgb[0] * 16 + rgb[1], rgb[2] * 16 + rgb[3], rgb[4] * 16 + rgb[5]);
+	}
+
+	if (view.isEmpty())
+		return QColor();
+
+	return QColor(view.toString());
+}
+
+// references are local, "#id"
+static QString symbolId(const QString &href)
+{
+	return href.startsWith(QLatin1Char('#')) ? href.mid(1) : href;
+}
+
+// only the style a use or group element sets overrides the style of what it
+// places; the rest is left to the shapes themselves
+static void readStyleOverrides(const LSvgMappedReader &reader, const SPtrLCanvasItem &item)
+{
+	if (!reader.attribute(SvgAttribute::AttrFill).isEmpty())
+		item->setFillColor(reader.attribute(SvgAttribute::AttrFill).toColor());
+	if (!reader.attribute(SvgAttribute::AttrStroke).isEmpty())
+		item->setStrokeColor(reader.attribute(SvgAttribute::AttrStroke).toColor());
+	if (!reader.attribute(SvgAttribute::AttrStrokeWidth).isEmpty())
+		item->setStrokeWidth(reader.attribute(SvgAttribute::AttrStrokeWidth).toInt());
+}
+
+static void readStyleOverrides(const LSvgAttributes &attributes, const SPtrLCanvasItem &item)
+{
+	const QStringView *values = attributes.values;
+	if (!values[SvgAttribute::AttrFill].isEmpty())
+		item->setFillColor(toColor(values[SvgAttribute::AttrFill]));
+	if (!values[SvgAttribute::AttrStroke].isEmpty())
+		item->setStrokeColor(toColor(values[SvgAttribute::AttrStroke]));
+	if (!values[SvgAttribute::AttrStrokeWidth].isEmpty())
+		item->setStrokeWidth(toInt(values[SvgAttribute::AttrStrokeWidth]));
+}
+
+// the tags that stand for an item of their own
+static bool isItemTag(SvgTag tag)
+{
+	switch (tag)
+	{
+	case SvgTag::TagPath:
+	case SvgTag::TagLine:
+	case SvgTag::TagRect:
+	case SvgTag::TagPolygon:
+	case SvgTag::TagEllipse:
+	case SvgTag::TagText:
+	case SvgTag::TagGroup:
+	case SvgTag::TagUse:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static const char *findPattern(const char *pos, const char *end, const char *pattern, int length)
+{
+	while (pos < end)
+	{
+		const char *hit = static_cast<const char *>(memchr(pos, pattern[0], end - pos));
+		if (!hit || end - hit < length)
+			return nullptr;
+
+		if (memcmp(hit, pattern, length) == 0)
+			return hit;
+
+		pos = hit + 1;
+	}
+
+	return nullptr;
+}
+
+// advances pos past the next tag and returns its '<', or nullptr at the end;
+// depthDelta is 1 for a start tag, 0 for an empty element and -1 for an end tag
+static const char *nextTag(const char *&pos, const char *end, int &depthDelta)
+{
+	while (pos < end)
+	{
+		const char *lt = static_cast<const char *>(memchr(pos, '<', end - pos));
+		if (!lt || lt + 1 >= end)
+			break;
+
+		pos = lt + 1;
+		if (*pos == '/')
+		{
+			depthDelta = -1;
+			return lt;
+		}
+
+		if (*pos == '!' && end - pos >= 3 && pos[1] == '-' && pos[2] == '-')
+		{
+			const char *hit = findPattern(pos, end, "-->", 3);
+			pos = hit ? hit + 3 : end;
+			continue;
+		}
+
+		if (*pos == '?' || *pos == '!')
+			continue;
+
+		char quote = 0;
+		while (pos < end)
+		{
+			if (quote)
+			{
+				if (*pos == quote)
+					quote = 0;
+			}
+			else if (*pos == '"' || *pos == '\'')
+			{
+				quote = *pos;
+			}
+			else if (*pos == '>')
+			{
+				break;
+			}
+			++pos;
+		}
+
+		depthDelta = (pos < end && pos[-1] == '/') ? 0 : 1;
+		return lt;
+	}
+
+	pos = end;
+	return nullptr;
+}
+
+static bool isUtf8Document(const char *data, qint64 size)
+{
+	if (size >= 2 && (uchar(data[0]) == 0xFE || uchar(data[0]) == 0xFF))
+		return false;
+
+	if (size < 5 || memcmp(data, "<?xml", 5) != 0)
+		return true;
+
+	const char *end = static_cast<const char *>(memchr(data, '>', size));
+	if (!end)
+		return true;
+
+	QByteArray prolog = QByteArray::fromRawData(data, int(end - data));
+	int idx = prolog.indexOf("encoding=");
+	if (idx < 0)
+		return true;
+
+	QByteArray encoding = prolog.mid(idx + 10, 5).toLower();
+	return encoding == "utf-8" || encoding.startsWith("utf8");
+}
+
+// LByteView
+LByteView::LByteView()
+	: m_data(nullptr)
+	, m_nSize(0)
+{
+
+}
+
+LByteView::LByteView(const char *data, int size)
+	: m_data(data)
+	, m_nSize(size)
+{
+
+}
+
+bool LByteView::equals(const char *literal) const
+{
+	int length = int(strlen(literal));
+	return length == m_nSize && memcmp(m_data, literal, length) == 0;
+}
+
+bool LByteView::contains(const char *literal) const
+{
+	return findPattern(m_data, m_data + m_nSize, literal, int(strlen(literal))) != nullptr;
+}
+
+int LByteView::toInt() const
+{
+	const char *pos = m_data;
+	int value = 0;
+	if (!readNumber(pos, m_data + m_nSize, value))
+		return 0;
+
+	return value;
+}
+
+QColor LByteView::toColor() const
+{
+	if (m_nSize == 7 && m_data[0] == '#')
+	{
+		int rgb[6];
+		for (int i = 0; i < 6; ++i)
+		{
+			rgb[i] = hexValue(m_data[i + 1]);
+			if (rgb[i] < 0)
+				return QColor();
+		}
+
+		return QColor(rgb[0] * 16 + rgb[1], rgb[2] * 16 + rgb[3], rgb[4] * 16 + rgb[5]);
+	}
+
+	if (isEmpty())
+		return QColor();
+
+	return QColor(QString::fromLatin1(m_data, m_nSize));
+}
+
+QString LByteView::toString() const
+{
+	if (isEmpty())
+		return QString();
+
+	if (!memchr(m_data, '&', m_nSize))
+		return QString::fromUtf8(m_data, m_nSize);
+
+	QByteArray decoded;
+	decoded.reserve(m_nSize);
+	const char *pos = m_data;
+	const char *end = m_data + m_nSize;
+	while (pos < end)
+	{
+		if (*pos != '&')
+		{
+			decoded += *pos++;
+			continue;
+		}
+
+		const char *semicolon = static_cast<const char *>(memchr(pos, ';', end - pos));
+		if (!semicolon)
+		{
+			decoded += *pos++;
+			continue;
+		}
+
+		LByteView entity(pos + 1, int(semicolon - pos - 1));
+		if (entity.equals("lt"))
+			decoded += '<';
+		else if (entity.equals("gt"))
+			decoded += '>';
+		else if (entity.equals("amp"))
+			decoded += '&';
+		else if (entity.equals("quot"))
+			decoded += '"';
+		else if (entity.equals("apos"))
+			decoded += '\'';
+		else if (entity.size() > 1 && entity.data()[0] == '#')
+		{
+			bool ok = false;
+			char32_t code = entity.data()[1] == 'x'
+					? QByteArray(entity.data() + 2, entity.size() - 2).toUInt(&ok, 16)
+					: QByteArray(entity.data() + 1, entity.size() - 1).toUInt(&ok, 10);
+			if (ok)
+				decoded += QString::fromUcs4(&code, 1).toUtf8();
+		}
+		pos = semicolon + 1;
+	}
+
+	return QString::fromUtf8(decoded);
+}
+
+// LSvgMappedReader
+LSvgMappedReader::LSvgMappedReader(const char *data, qint64 size)
+	: m_begin(data)
+	, m_end(data + size)
+	, m_pos(data)
+	, m_elementBegin(data)
+	, m_tag(SvgTag::TagNone)
+	, m_bEmptyElement(false)
+{
+
+}
+
+bool LSvgMappedReader::atEnd() const
+{
+	return m_pos >= m_end;
+}
+
+bool LSvgMappedReader::readNextStartElement()
+{
+	while (m_pos < m_end)
+	{
+		const char *lt = static_cast<const char *>(memchr(m_pos, '<', m_end - m_pos));
+		if (!lt || lt + 1 >= m_end)
+		{
+			m_pos = m_end;
+			break;
+		}
+
+		m_elementBegin = lt;
+		m_pos = lt + 1;
+		if (*m_pos == '/')
+		{
+			skipPast(">", 1);
+			continue;
+		}
+
+		if (*m_pos == '?')
+		{
+			skipPast("?>", 2);
+			continue;
+		}
+
+		if (*m_pos == '!')
+		{
+			if (m_end - m_pos >= 3 && m_pos[1] == '-' && m_pos[2] == '-')
+				skipPast("-->", 3);
+			else if (m_end - m_pos >= 8 && memcmp(m_pos, "![CDATA[", 8) == 0)
+				skipPast("]]>", 3);
+			else
+				skipPast(">", 1);
+			continue;
+		}
+
+		const char *nameBegin = m_pos;
+		while (m_pos < m_end && !isSpace(*m_pos) && *m_pos != '/' && *m_pos != '>')
+		{
+			if (*m_pos == ':')
+				nameBegin = m_pos + 1;
+			++m_pos;
+		}
+		m_name = LByteView(nameBegin, int(m_pos - nameBegin));
+		m_tag = tagId(m_name.data(), m_name.size());
+
+		// the attributes are taken in the same pass that finds the end of the
+		// tag; like the stream reader, only the local part of a name counts
+		for (int i = 0; i < SvgAttribute::AttrCount; ++i)
+			m_attributes[i] = LByteView();
+
+		const char *attrBegin = m_pos;
+		while (m_pos < m_end && *m_pos != '>')
+		{
+			if (isSpace(*m_pos) || *m_pos == '/')
+			{
+				++m_pos;
+				continue;
+			}
+
+			const char *attrName = m_pos;
+			while (m_pos < m_end && *m_pos != '=' && *m_pos != '>' && !isSpace(*m_pos))
+			{
+				if (*m_pos == ':')
+					attrName = m_pos + 1;
+				++m_pos;
+			}
+			const char *attrNameEnd = m_pos;
+
+			while (m_pos < m_end && isSpace(*m_pos))
+				++m_pos;
+			if (m_pos >= m_end || *m_pos != '=')
+				continue;
+			++m_pos;
+			while (m_pos < m_end && isSpace(*m_pos))
+				++m_pos;
+			if (m_pos >= m_end || (*m_pos != '"' && *m_pos != '\''))
+				continue;
+
+			char quote = *m_pos++;
+			const char *valueEnd = static_cast<const char *>(memchr(m_pos, quote, m_end - m_pos));
+			if (!valueEnd)
+			{
+				m_pos = m_end;
+				break;
+			}
+
+			SvgAttribute id = attributeId(attrName, int(attrNameEnd - attrName));
+			if (id != SvgAttribute::AttrNone)
+				m_attributes[id] = LByteView(m_pos, int(valueEnd - m_pos));
+			m_pos = valueEnd + 1;
+		}
+
+		m_bEmptyElement = m_pos > attrBegin && m_pos[-1] == '/';
+		if (m_pos < m_end)
+			++m_pos;
+
+		return true;
+	}
+
+	return false;
+}
+
+LByteView LSvgMappedReader::name() const
+{
+	return m_name;
+}
+
+LByteView LSvgMappedReader::readElementText()
+{
+	if (m_bEmptyElement)
+		return LByteView();
+
+	const char *textBegin = m_pos;
+	const char *lt = static_cast<const char *>(memchr(m_pos, '<', m_end - m_pos));
+	m_pos = lt ? lt : m_end;
+
+	return LByteView(textBegin, int(m_pos - textBegin));
+}
+
+// the markup between the current start tag and its end tag, nested elements
+// included; the reader continues after the end tag
+LByteView LSvgMappedReader::readElementContent()
+{
+	if (m_bEmptyElement)
+		return LByteView();
+
+	const char *contentBegin = m_pos;
+	const char *tag = nullptr;
+	int depth = 1;
+	int depthDelta = 0;
+	while ((tag = nextTag(m_pos, m_end, depthDelta)))
+	{
+		depth += depthDelta;
+		if (depth == 0)
+			break;
+	}
+
+	if (!tag)
+		return LByteView(contentBegin, int(m_end - contentBegin));
+
+	skipPast(">", 1);
+	return LByteView(contentBegin, int(tag - contentBegin));
+}
+
+void LSvgMappedReader::skipPast(const char *pattern, int length)
+{
+	const char *hit = findPattern(m_pos, m_end, pattern, length);
+	m_pos = hit ? hit + length : m_end;
+}
+
+// LCanvasReadTask
+static const qint64 ParallelPartitionSize = 4 * 1024 * 1024;
+static const qint64 ProgressiveReadSize = 1024 * 1024;
+static const int ProgressiveBatchSize = 4096;
+
+class LCanvasReadTask : public QRunnable
+{
+public:
+	LCanvasReadTask(LCanvasReader *reader, const char *begin, const char *end)
+		: m_reader(reader)
+		, m_begin(begin)
+		, m_end(end)
+	{
+
+	}
+
+	void run() override
+	{
+		m_reader->readRange(m_begin, m_end);
+	}
+
+private:
+	LCanvasReader *m_reader;
+	const char *m_begin;
+	const char *m_end;
+};
+
+class LCanvasElementReadTask : public QRunnable
+{
+public:
+	LCanvasElementReadTask(LCanvasReader *reader, const char * const *elements, const int *indices,
+						   int count, const char *end, SPtrLCanvasItem *items)
+		: m_reader(reader)
+		, m_elements(elements)
+		, m_indices(indices)
+		, m_nCount(count)
+		, m_end(end)
+		, m_items(items)
+	{
+
+	}
+
+	void run() override
+	{
+		m_reader->readElements(m_elements, m_indices, m_nCount, m_end, m_items);
+	}
+
+private:
+	LCanvasReader *m_reader;
+	const char * const *m_elements;
+	const int *m_indices;
+	int m_nCount;
+	const char *m_end;
+	SPtrLCanvasItem *m_items;
+};
+
+// LCanvasReader
+LCanvasReader::LCanvasReader()
+	: m_progress(nullptr)
+	, m_handler(nullptr)
+	, m_bDeferText(false)
+{
+
+}
+
+void LCanvasReader::setProgress(LCanvasProgress *progress)
+{
+	m_progress = progress;
+}
+
+void LCanvasReader::setHandler(LCanvasReadHandler *handler, const QRect &priorityRect)
+{
+	m_handler = handler;
+	m_priorityRect = priorityRect;
+}
+
+bool LCanvasReader::read(const QString &filePath)
+{
+	LCANVAS_TRACE("load", "read");
+
+	m_items.clear();
+
+	if (filePath.isEmpty())
+		return false;
+
+	QFile file(filePath);
+	if (!file.open(QFile::ReadOnly))
+		return false;
+
+	// compressed documents are inflated on a helper thread while the stream parser runs
+	if (LGzipInflateDevice::isGzipData(file.peek(2)))
+	{
+		if (m_progress)
+			m_progress->setTotal(LGzipInflateDevice::uncompressedSize(file));
+
+		LGzipInflateDevice device(&file);
+		bool result = device.open(QIODevice::ReadOnly) && readStream(&device) && !device.hasError();
+		device.close();
+		file.close();
+
+		return result && !(m_progress && m_progress->isCanceled());
+	}
+
+	if (m_progress)
+		m_progress->setTotal(file.size());
+
+	bool result = false;
+	uchar *data = file.size() > 0 ? file.map(0, file.size()) : nullptr;
+	if (data && isUtf8Document(reinterpret_cast<const char *>(data), file.size()))
+	{
+		result = readMapped(reinterpret_cast<const char *>(data), file.size());
+	}
+	else
+	{
+		result = readStream(&file);
+	}
+
+	if (data)
+		file.unmap(data);
+
+	file.close();
+
+	if (m_progress && m_progress->isCanceled())
+		return false;
+
+	return result;
+}
+
+LCanvasItemList LCanvasReader::items() const
+{
+	return m_items;
+}
+
+QSize LCanvasReader::canvasSize() const
+{
+	return m_canvasSize;
+}
+
+bool LCanvasReader::readMapped(const char *data, qint64 size)
+{
+	LCANVAS_TRACE("load", "readMapped");
+
+	LSvgMappedReader reader(data, size);
+
+	while (reader.readNextStartElement())
+	{
+		if (reader.tag() == SvgTag::TagSvg)
+			break;
+	}
+
+	if (reader.tag() != SvgTag::TagSvg || !reader.attribute(SvgAttribute::AttrSubset).equals("lwscode"))
+		return false;
+
+	m_canvasSize = QSize(reader.attribute(SvgAttribute::AttrWidth).toInt(), reader.attribute(SvgAttribute::AttrHeight).toInt());
+
+	const char *begin = reader.position();
+	const char *end = data + size;
+
+	// the documents written here define their symbols first; reading them
+	// ahead lets instances in any partition resolve against them
+	LSvgMappedReader defsReader(begin, end - begin);
+	if (defsReader.readNextStartElement() && defsReader.tag() == SvgTag::TagDefs)
+	{
+		readDefinitions(defsReader.readElementContent());
+		begin = defsReader.position();
+	}
+
+	if (m_handler && end - begin >= ProgressiveReadSize)
+	{
+		QVector<const char *> elements;
+		if (scanElements(begin, end, elements))
+			return readProgressive(elements, end);
+	}
+
+	int partitions = qMin(QThread::idealThreadCount(), int((end - begin) / ParallelPartitionSize));
+	if (partitions <= 1)
+	{
+		readRange(begin, end);
+		return true;
+	}
+
+	QVector<const char *> bounds = partitionElements(begin, end, partitions);
+	QVector<LCanvasReader> readers(bounds.size() - 1);
+
+	QThreadPool pool;
+	for (int i = 0; i < readers.size(); ++i)
+	{
+		readers[i].m_progress = m_progress;
+		readers[i].m_bDeferText = true;
+		readers[i].m_symbols = m_symbols;
+		pool.start(new LCanvasReadTask(&readers[i], bounds[i], bounds[i + 1]));
+	}
+	pool.waitForDone();
+
+	if (m_progress && m_progress->isCanceled())
+		return false;
+
+	int count = 0;
+	foreach (auto &partReader, readers)
+		count += partReader.m_items.size();
+	m_items.reserve(count);
+
+	// text layout goes through the font database, so text items and the groups
+	// holding any are built here, one at a time on the thread running the read
+	// rather than concurrently on the partition workers
+	for (int i = 0; i < readers.size(); ++i)
+	{
+		LCanvasReader &partReader = readers[i];
+		foreach (auto &deferred, partReader.m_deferredTexts)
+		{
+			LSvgMappedReader textReader(deferred.second, end - deferred.second);
+			textReader.readNextStartElement();
+			partReader.m_items[deferred.first] = readItem(textReader);
+		}
+		m_items += partReader.m_items;
+	}
+
+	return true;
+}
+
+void LCanvasReader::readRange(const char *begin, const char *end)
+{
+	LCANVAS_TRACE_ARG("load", "readRange", end - begin);
+
+	LSvgMappedReader reader(begin, end - begin);
+	const char *reported = begin;
+	int count = 0;
+
+	while (reader.readNextStartElement())
+	{
+		if (m_progress && (++count & 0xff) == 0)
+		{
+			if (m_progress->isCanceled())
+				return;
+
+			m_progress->advance(reader.position() - reported);
+			reported = reader.position();
+		}
+
+		// later definitions are skipped whole, only leading ones are read
+		SvgTag tag = reader.tag();
+		if (tag == SvgTag::TagDefs)
+		{
+			reader.readElementContent();
+			continue;
+		}
+
+		if (!isItemTag(tag))
+			continue;
+
+		if (tag == SvgTag::TagText && m_bDeferText)
+		{
+			m_deferredTexts << qMakePair(m_items.size(), reader.elementBegin());
+			m_items << SPtrLCanvasItem();
+			continue;
+		}
+
+		if (tag == SvgTag::TagGroup && m_bDeferText)
+		{
+			const char *elementBegin = reader.elementBegin();
+			LByteView content = reader.readElementContent();
+			if (content.contains("<text"))
+			{
+				m_deferredTexts << qMakePair(m_items.size(), elementBegin);
+				m_items << SPtrLCanvasItem();
+			}
+			else
+			{
+				m_items << readGroup(reader, content);
+			}
+			continue;
+		}
+
+		SPtrLCanvasItem item = readItem(reader);
+		if (item)
+			m_items << item;
+	}
+
+	if (m_progress)
+		m_progress->advance(end - reported);
+}
+
+QVector<const char *> LCanvasReader::partitionElements(const char *begin, const char *end, int partitions)
+{
+	LCANVAS_TRACE("load", "partitionElements");
+
+	QVector<const char *> bounds;
+	bounds << begin;
+
+	qint64 step = (end - begin) / partitions;
+	const char *target = begin + step;
+	const char *pos = begin;
+	const char *tag = nullptr;
+	int depth = 0;
+	int depthDelta = 0;
+	while (bounds.size() < partitions && (tag = nextTag(pos, end, depthDelta)))
+	{
+		if (depthDelta >= 0 && depth == 0 && tag >= target)
+		{
+			bounds << tag;
+			target = tag + step;
+		}
+
+		depth += depthDelta;
+		if (depth < 0)
+			break;
+	}
+	bounds << end;
+
+	return bounds;
+}
+
+bool LCanvasReader::scanElements(const char *begin, const char *end, QVector<const char *> &elements)
+{
+	LCANVAS_TRACE("load", "scanElements");
+
+	// children of groups are read with their group
+	const char *pos = begin;
+	const char *tag = nullptr;
+	int depth = 0;
+	int depthDelta = 0;
+	while ((tag = nextTag(pos, end, depthDelta)))
+	{
+		if (depthDelta >= 0 && depth == 0)
+			elements << tag;
+
+		depth += depthDelta;
+		if (depth < 0)
+			break;
+	}
+
+	return true;
+}
+
+bool LCanvasReader::readProgressive(const QVector<const char *> &elements, const char *end)
+{
+	LCANVAS_TRACE("load", "readProgressive");
+
+	if (m_progress)
+		m_progress->setTotal(elements.size());
+
+	QVector<SPtrLCanvasItem> items(elements.size());
+	QVector<int> deferred;
+	LCanvasItemList batch;
+	for (int i = 0; i < elements.size(); ++i)
+	{
+		LSvgMappedReader reader(elements[i], end - elements[i]);
+		reader.readNextStartElement();
+
+		if (!isItemTag(reader.tag()))
+			continue;
+
+		QRect bounds = elementBounds(reader);
+		if (bounds.isValid() && !bounds.intersects(m_priorityRect))
+		{
+			deferred << i;
+			continue;
+		}
+
+		items[i] = readItem(reader);
+		if (items[i])
+			batch << items[i];
+	}
+
+	if (m_progress)
+		m_progress->advance(elements.size() - deferred.size());
+
+	if (!batch.isEmpty())
+		m_handler->readItems(batch);
+
+	int partitions = qBound(1, QThread::idealThreadCount(), deferred.size() / ProgressiveBatchSize + 1);
+	int chunk = (deferred.size() + partitions - 1) / partitions;
+	QVector<LCanvasReader> readers(partitions);
+
+	QThreadPool pool;
+	for (int i = 0; i < partitions && i * chunk < deferred.size(); ++i)
+	{
+		readers[i].m_progress = m_progress;
+		readers[i].m_handler = m_handler;
+		readers[i].m_bDeferText = true;
+		readers[i].m_symbols = m_symbols;
+		pool.start(new LCanvasElementReadTask(&readers[i], elements.constData(),
+											  deferred.constData() + i * chunk,
+											  qMin(chunk, deferred.size() - i * chunk),
+											  end, items.data()));
+	}
+	pool.waitForDone();
+
+	if (m_progress && m_progress->isCanceled())
+		return false;
+
+	// text is built one at a time after the workers, as in readMapped
+	batch.clear();
+	foreach (auto &partReader, readers)
+	{
+		foreach (auto &deferredText, partReader.m_deferredTexts)
+		{
+			LSvgMappedReader textReader(deferredText.second, end - deferredText.second);
+			textReader.readNextStartElement();
+			items[deferredText.first] = readItem(textReader);
+			batch << items[deferredText.first];
+		}
+	}
+
+	if (!batch.isEmpty())
+		m_handler->readItems(batch);
+
+	m_items.reserve(elements.size());
+	foreach (auto &item, items)
+	{
+		if (item)
+			m_items << item;
+	}
+
+	return true;
+}
+
+void LCanvasReader::readElements(const char * const *elements, const int *indices, int count,
+								 const char *end, SPtrLCanvasItem *items)
+{
+	LCANVAS_TRACE_ARG("load", "readElements", count);
+
+	LCanvasItemList batch;
+	for (int i = 0; i < count; ++i)
+	{
+		int index = indices[i];
+		LSvgMappedReader reader(elements[index], end - elements[index]);
+		reader.readNextStartElement();
+
+		SvgTag tag = reader.tag();
+		if (tag == SvgTag::TagText && m_bDeferText)
+		{
+			m_deferredTexts << qMakePair(index, elements[index]);
+			continue;
+		}
+
+		if (tag == SvgTag::TagGroup && m_bDeferText)
+		{
+			LByteView content = reader.readElementContent();
+			if (content.contains("<text"))
+			{
+				m_deferredTexts << qMakePair(index, elements[index]);
+				continue;
+			}
+			items[index] = readGroup(reader, content);
+		}
+		else
+		{
+			items[index] = readItem(reader);
+		}
+
+		if (items[index])
+			batch << items[index];
+
+		if (batch.size() >= ProgressiveBatchSize)
+		{
+			if (m_progress)
+			{
+				if (m_progress->isCanceled())
+					return;
+
+				m_progress->advance(ProgressiveBatchSize);
+			}
+
+			m_handler->readItems(batch);
+			batch.clear();
+		}
+	}
+
+	if (m_progress)
+		m_progress->advance(batch.size());
+
+	if (!batch.isEmpty())
+		m_handler->readItems(batch);
+}
+
+QRect LCanvasReader::elementBounds(LSvgMappedReader &reader)
+{
+	QRect bounds;
+	switch (reader.tag())
+	{
+	case SvgTag::TagPath:
+	case SvgTag::TagPolygon:
+	{
+		QPoints points;
+		if (reader.tag() == SvgTag::TagPath)
+		{
+			LByteView data = reader.attribute(SvgAttribute::AttrD);
+			readPathData(data.data(), data.data() + data.size(), points);
+		}
+		else
+		{
+			LByteView data = reader.attribute(SvgAttribute::AttrPoints);
+			const char *pos = data.data();
+			const char *end = pos + data.size();
+			int x = 0, y = 0;
+			while (readNumber(pos, end, x) && readNumber(pos, end, y))
+				points << QPoint(x, y);
+		}
+
+		if (points.isEmpty())
+			return QRect();
+
+		bounds = QPolygon(points.toVector()).boundingRect();
+		break;
+	}
+	case SvgTag::TagLine:
+	{
+		bounds = QRect(QPoint(reader.attribute(SvgAttribute::AttrX1).toInt(), reader.attribute(SvgAttribute::AttrY1).toInt()),
+					   QPoint(reader.attribute(SvgAttribute::AttrX2).toInt(), reader.attribute(SvgAttribute::AttrY2).toInt())).normalized();
+		break;
+	}
+	case SvgTag::TagRect:
+	{
+		bounds = QRect(reader.attribute(SvgAttribute::AttrX).toInt(), reader.attribute(SvgAttribute::AttrY).toInt(),
+					   reader.attribute(SvgAttribute::AttrWidth).toInt(), reader.attribute(SvgAttribute::AttrHeight).toInt()).normalized();
+		break;
+	}
+	case SvgTag::TagEllipse:
+	{
+		int rx = reader.attribute(SvgAttribute::AttrRx).toInt();
+		int ry = reader.attribute(SvgAttribute::AttrRy).toInt();
+		bounds = QRect(reader.attribute(SvgAttribute::AttrCx).toInt() - rx, reader.attribute(SvgAttribute::AttrCy).toInt() - ry,
+					   rx * 2, ry * 2);
+		break;
+	}
+	default:
+	{
+		// text extents need font metrics and group and instance extents
+		// their children, treat them as visible
+		return QRect();
+	}
+	}
+
+	int d = (reader.attribute(SvgAttribute::AttrStrokeWidth).toInt() + 1) / 2 + 4;
+	return bounds.adjusted(-d, -d, d, d);
+}
+
+bool LCanvasReader::readStream(QIODevice *device)
+{
+	LCANVAS_TRACE("load", "readStream");
+
+	QXmlStreamReader reader(device);
+	LSvgAttributes attributes;
+
+	while (!reader.atEnd() && !(reader.isStartElement() && tagId(toStringView(reader.name())) == SvgTag::TagSvg))
+	{
+		reader.readNext();
+	}
+
+	// the attributes are read from a temporary; a copy held across readNext()
+	// would make the reader detach its own list on every element
+	readAttributes(reader.attributes(), attributes);
+	if (!equalsLatin1(attributes.values[SvgAttribute::AttrSubset], "lwscode"))
+		return false;
+
+	m_canvasSize = QSize(toInt(attributes.values[SvgAttribute::AttrWidth]),
+						 toInt(attributes.values[SvgAttribute::AttrHeight]));
+
+	// groups and symbols still open, innermost last; items go to the innermost
+	// one, a symbol's id is kept next to it
+	LCanvasItemList groups;
+	QStringList groupIds;
+	qint64 reported = 0;
+	int count = 0;
+	while (!reader.atEnd())
+	{
+		if (m_progress && (++count & 0xff) == 0)
+		{
+			if (m_progress->isCanceled())
+				return false;
+
+			m_progress->advance(device->pos() - reported);
+			reported = device->pos();
+		}
+
+		if (reader.isStartElement())
+		{
+			SvgTag tag = tagId(toStringView(reader.name()));
+			if (tag == SvgTag::TagGroup || tag == SvgTag::TagSymbol)
+			{
+				readAttributes(reader.attributes(), attributes);
+
+				QString id;
+				SPtrLCanvasItem group(new LCanvasGroup());
+				if (tag == SvgTag::TagSymbol)
+					id = attributes.values[SvgAttribute::AttrId].toString();
+				else
+					readStyleOverrides(attributes, group);
+				groups << group;
+				groupIds << id;
+			}
+			else if (tag != SvgTag::TagNone && tag != SvgTag::TagSvg && tag != SvgTag::TagDefs)
+			{
+				readAttributes(reader.attributes(), attributes);
+
+				SPtrLCanvasItem item = readItemFromXml(tag, attributes, reader);
+				if (item && !groups.isEmpty())
+					groups.last()->addChild(item);
+				else if (item)
+					appendItem(item);
+			}
+		}
+		else if (reader.isEndElement() && !groups.isEmpty())
+		{
+			SvgTag tag = tagId(toStringView(reader.name()));
+			if (tag == SvgTag::TagGroup || tag == SvgTag::TagSymbol)
+			{
+				SPtrLCanvasItem group = groups.takeLast();
+				QString id = groupIds.takeLast();
+				if (tag == SvgTag::TagSymbol)
+				{
+					group->updateGeometry();
+					if (!id.isEmpty())
+						m_symbols.insert(id, SPtrLCanvasSymbol(new LCanvasSymbol(id, group)));
+				}
+				else if (!groups.isEmpty())
+				{
+					groups.last()->addChild(group);
+				}
+				else
+				{
+					appendItem(group);
+				}
+			}
+		}
+		reader.readNext();
+	}
+
+	// a malformed document fails rather than loading up to the error
+	return !reader.hasError();
+}
+
+SPtrLCanvasItem LCanvasReader::readItem(LSvgMappedReader &reader)
+{
+	SPtrLCanvasItem item;
+	switch (reader.tag())
+	{
+	case SvgTag::TagPath:
+	{
+		LByteView path = reader.attribute(SvgAttribute::AttrD);
+		QPoints points;
+		if (!readPathData(path.data(), path.data() + path.size(), points))
+			return SPtrLCanvasItem();
+
+		item = SPtrLCanvasItem(new LCanvasPath());
+		item->setStrokeColor(reader.attribute(SvgAttribute::AttrStroke).toColor());
+		item->setStrokeWidth(reader.attribute(SvgAttribute::AttrStrokeWidth).toInt());
+		item->setStartPos(points.first());
+		item->setEndPos(points.last());
+		for (int i = 0; i < points.size(); ++i)
+			item->addPoint(points[i]);
+		break;
+	}
+	case SvgTag::TagLine:
+	{
+		item = SPtrLCanvasItem(new LCanvasLine());
+		item->setStrokeColor(reader.attribute(SvgAttribute::AttrStroke).toColor());
+		item->setStrokeWidth(reader.attribute(SvgAttribute::AttrStrokeWidth).toInt());
+
+		item->setStartPos(QPoint(reader.attribute(SvgAttribute::AttrX1).toInt(), reader.attribute(SvgAttribute::AttrY1).toInt()));
+		item->setEndPos(QPoint(reader.attribute(SvgAttribute::AttrX2).toInt(), reader.attribute(SvgAttribute::AttrY2).toInt()));
+		break;
+	}
+	case SvgTag::TagRect:
+	{
+		item = SPtrLCanvasItem(new LCanvasRect());
+		item->setFillColor(reader.attribute(SvgAttribute::AttrFill).toColor());
+		item->setStrokeColor(reader.attribute(SvgAttribute::AttrStroke).toColor());
+		item->setStrokeWidth(reader.attribute(SvgAttribute::AttrStrokeWidth).toInt());
+
+		int x = reader.attribute(SvgAttribute::AttrX).toInt();
+		int y = reader.attribute(SvgAttribute::AttrY).toInt();
+		int width = reader.attribute(SvgAttribute::AttrWidth).toInt();
+		int height = reader.attribute(SvgAttribute::AttrHeight).toInt();
+		item->setStartPos(QPoint(x, y));
+		item->setEndPos(QPoint(x + width, y + height));
+		break;
+	}
+	case SvgTag::TagEllipse:
+	{
+		item = SPtrLCanvasItem(new LCanvasEllipse());
+		item->setFillColor(reader.attribute(SvgAttribute::AttrFill).toColor());
+		item->setStrokeColor(reader.attribute(SvgAttribute::AttrStroke).toColor());
+		item->setStrokeWidth(reader.attribute(SvgAttribute::AttrStrokeWidth).toInt());
+
+		int cx = reader.attribute(SvgAttribute::AttrCx).toInt();
+		int cy = reader.attribute(SvgAttribute::AttrCy).toInt();
+		int rx = reader.attribute(SvgAttribute::AttrRx).toInt();
+		int ry = reader.attribute(SvgAttribute::AttrRy).toInt();
+		item->setStartPos(QPoint(cx - rx, cy - ry));
+		item->setEndPos(QPoint(cx + rx, cy + ry));
+		break;
+	}
+	case SvgTag::TagPolygon:
+	{
+		// triangles and hexagons differ only in their vertex count
+		int points[13];
+		int count = readNumbers(reader.attribute(SvgAttribute::AttrPoints), points, 13);
+		if (count == 6)
+		{
+			item = SPtrLCanvasItem(new LCanvasTriangle());
+			item->setStartPos(QPoint(points[4], points[1]));
+			item->setEndPos(QPoint(points[2], points[3]));
+		}
+		else if (count == 12)
+		{
+			item = SPtrLCanvasItem(new LCanvasHexagon());
+			item->setStartPos(QPoint(points[10], points[1]));
+			item->setEndPos(QPoint(points[4], points[7]));
+		}
+		else
+		{
+			return SPtrLCanvasItem();
+		}
+
+		item->setFillColor(reader.attribute(SvgAttribute::AttrFill).toColor());
+		item->setStrokeColor(reader.attribute(SvgAttribute::AttrStroke).toColor());
+		item->setStrokeWidth(reader.attribute(SvgAttribute::AttrStrokeWidth).toInt());
+		break;
+	}
+	case SvgTag::TagText:
+	{
+		item = SPtrLCanvasItem(new LCanvasText());
+		item->setFillColor(reader.attribute(SvgAttribute::AttrFill).toColor());
+
+		QFont font;
+		LByteView family = reader.attribute(SvgAttribute::AttrFontFamily);
+		if (!family.isEmpty())
+			font.setFamily(family.toString());
+		int fontSize = reader.attribute(SvgAttribute::AttrFontSize).toInt();
+		if (fontSize > 0)
+			font.setPointSize(fontSize);
+		item->setFont(font);
+
+		item->setStartPos(QPoint(reader.attribute(SvgAttribute::AttrX).toInt(), reader.attribute(SvgAttribute::AttrY).toInt()));
+		item->setText(reader.readElementText().toString());
+		break;
+	}
+	case SvgTag::TagGroup:
+	{
+		item = readGroup(reader, reader.readElementContent());
+		break;
+	}
+	case SvgTag::TagUse:
+	{
+		SPtrLCanvasSymbol symbol = m_symbols.value(symbolId(reader.attribute(SvgAttribute::AttrHref).toString()));
+		if (!symbol)
+			return SPtrLCanvasItem();
+
+		// x and y translate inside the transform, as in svg
+		LByteView transform = reader.attribute(SvgAttribute::AttrTransform);
+		LCanvasInstance *instance = new LCanvasInstance(symbol);
+		instance->setTransform(QTransform::fromTranslate(reader.attribute(SvgAttribute::AttrX).toInt(), reader.attribute(SvgAttribute::AttrY).toInt()) *
+							   readTransform(transform.data(), transform.data() + transform.size()));
+		item = SPtrLCanvasItem(instance);
+		readStyleOverrides(reader, item);
+		break;
+	}
+	default:
+	{
+		break;
+	}
+	}
+
+	// bounds are taken here, on the loader thread, rather than on first paint
+	if (item)
+		item->updateGeometry();
+
+	return item;
+}
+
+// symbols in a definitions block become masters for the instances read later
+void LCanvasReader::readDefinitions(const LByteView &content)
+{
+	LSvgMappedReader reader(content.data(), content.size());
+	while (reader.readNextStartElement())
+	{
+		if (reader.tag() != SvgTag::TagSymbol)
+			continue;
+
+		QString id = reader.attribute(SvgAttribute::AttrId).toString();
+		SPtrLCanvasItem master = readGroup(reader, reader.readElementContent());
+		if (!id.isEmpty())
+			m_symbols.insert(id, SPtrLCanvasSymbol(new LCanvasSymbol(id, master)));
+	}
+}
+
+// the children are read from the group's own markup, nested groups recurse;
+// the style is read from the group element the reader stands on
+SPtrLCanvasItem LCanvasReader::readGroup(const LSvgMappedReader &reader, const LByteView &content)
+{
+	SPtrLCanvasItem group(new LCanvasGroup());
+	LSvgMappedReader contentReader(content.data(), content.size());
+	while (contentReader.readNextStartElement())
+	{
+		if (!isItemTag(contentReader.tag()))
+			continue;
+
+		SPtrLCanvasItem item = readItem(contentReader);
+		if (item)
+			group->addChild(item);
+	}
+
+	readStyleOverrides(reader, group);
+	group->updateGeometry();
+	return group;
+}
+
+SPtrLCanvasItem LCanvasReader::readItemFromXml(SvgTag tag, const LSvgAttributes &attributes, QXmlStreamReader &reader)
+{
+	const QStringView *values = attributes.values;
+	SPtrLCanvasItem item;
+	switch (tag)
+	{
+	case SvgTag::TagPath:
+	{
+		QPoints points;
+		QStringView path = values[SvgAttribute::AttrD];
+		if (!readPathData(path.utf16(), path.utf16() + path.size(), points))
+			return SPtrLCanvasItem();
+
+		item = SPtrLCanvasItem(new LCanvasPath());
+		item->setStrokeColor(toColor(values[SvgAttribute::AttrStroke]));
+		item->setStrokeWidth(toInt(values[SvgAttribute::AttrStrokeWidth]));
+		item->setStartPos(points.first());
+		item->setEndPos(points.last());
+		for (int i = 0; i < points.size(); ++i)
+			item->addPoint(points[i]);
+		break;
+	}
+	case SvgTag::TagLine:
+	{
+		item = SPtrLCanvasItem(new LCanvasLine());
+		item->setStrokeColor(toColor(values[SvgAttribute::AttrStroke]));
+		item->setStrokeWidth(toInt(values[SvgAttribute::AttrStrokeWidth]));
+
+		item->setStartPos(QPoint(toInt(values[SvgAttribute::AttrX1]), toInt(values[SvgAttribute::AttrY1])));
+		item->setEndPos(QPoint(toInt(values[SvgAttribute::AttrX2]), toInt(values[SvgAttribute::AttrY2])));
+		break;
+	}
+	case SvgTag::TagRect:
+	{
+		item = SPtrLCanvasItem(new LCanvasRect());
+		item->setFillColor(toColor(values[SvgAttribute::AttrFill]));
+		item->setStrokeColor(toColor(values[SvgAttribute::AttrStroke]));
+		item->setStrokeWidth(toInt(values[SvgAttribute::AttrStrokeWidth]));
+
+		int x = toInt(values[SvgAttribute::AttrX]);
+		int y = toInt(values[SvgAttribute::AttrY]);
+		int width = toInt(values[SvgAttribute::AttrWidth]);
+		int height = toInt(values[SvgAttribute::AttrHeight]);
+		item->setStartPos(QPoint(x, y));
+		item->setEndPos(QPoint(x + width, y + height));
+		break;
+	}
+	case SvgTag::TagEllipse:
+	{
+		item = SPtrLCanvasItem(new LCanvasEllipse());
+		item->setFillColor(toColor(values[SvgAttribute::AttrFill]));
+		item->setStrokeColor(toColor(values[SvgAttribute::AttrStroke]));
+		item->setStrokeWidth(toInt(values[SvgAttribute::AttrStrokeWidth]));
+
+		int cx = toInt(values[SvgAttribute::AttrCx]);
+		int cy = toInt(values[SvgAttribute::AttrCy]);
+		int rx = toInt(values[SvgAttribute::AttrRx]);
+		int ry = toInt(values[SvgAttribute::AttrRy]);
+		item->setStartPos(QPoint(cx - rx, cy - ry));
+		item->setEndPos(QPoint(cx + rx, cy + ry));
+		break;
+	}
+	case SvgTag::TagPolygon:
+	{
+		// triangles and hexagons differ only in their vertex count
+		int points[13];
+		QStringView polygon = values[SvgAttribute::AttrPoints];
+		int count = readNumbers(polygon.utf16(), polygon.utf16() + polygon.size(), points, 13);
+		if (count == 6)
+		{
+			item = SPtrLCanvasItem(new LCanvasTriangle());
+			item->setStartPos(QPoint(points[4], points[1]));
+			item->setEndPos(QPoint(points[2], points[3]));
+		}
+		else if (count == 12)
+		{
+			item = SPtrLCanvasItem(new LCanvasHexagon());
+			item->setStartPos(QPoint(points[10], points[1]));
+			item->setEndPos(QPoint(points[4], points[7]));
+		}
+		else
+		{
+			return SPtrLCanvasItem();
+		}
+
+		item->setFillColor(toColor(values[SvgAttribute::AttrFill]));
+		item->setStrokeColor(toColor(values[SvgAttribute::AttrStroke]));
+		item->setStrokeWidth(toInt(values[SvgAttribute::AttrStrokeWidth]));
+		break;
+	}
+	case SvgTag::TagText:
+	{
+		item = SPtrLCanvasItem(new LCanvasText());
+		item->setFillColor(toColor(values[SvgAttribute::AttrFill]));
+
+		QFont font;
+		if (!values[SvgAttribute::AttrFontFamily].isEmpty())
+			font.setFamily(values[SvgAttribute::AttrFontFamily].toString());
+		if (toInt(values[SvgAttribute::AttrFontSize]) > 0)
+			font.setPointSize(toInt(values[SvgAttribute::AttrFontSize]));
+		item->setFont(font);
+
+		item->setStartPos(QPoint(toInt(values[SvgAttribute::AttrX]), toInt(values[SvgAttribute::AttrY])));
+		item->setText(reader.readElementText());
+		break;
+	}
+	case SvgTag::TagUse:
+	{
+		SPtrLCanvasSymbol symbol = m_symbols.value(symbolId(values[SvgAttribute::AttrHref].toString()));
+		if (!symbol)
+			return SPtrLCanvasItem();
+
+		QStringView transform = values[SvgAttribute::AttrTransform];
+		LCanvasInstance *instance = new LCanvasInstance(symbol);
+		instance->setTransform(QTransform::fromTranslate(toInt(values[SvgAttribute::AttrX]), toInt(values[SvgAttribute::AttrY])) *
+							   readTransform(transform.utf16(), transform.utf16() + transform.size()));
+		item = SPtrLCanvasItem(instance);
+		readStyleOverrides(attributes, item);
+		break;
+	}
+	default:
+	{
+		break;
+	}
+	}
+
+	// bounds are taken here, on the loader thread, rather than on first paint
+	if (item)
+		item->updateGeometry();
+
+	return item;
+}
+
+void LCanvasReader::appendItem(SPtrLCanvasItem item)
+{
+	item->updateGeometry();
+	m_items << item;
+}
+
+} // namespace
@@ -0,0 +1,340 @@
+#include "lcanvasrecorder.h"
+#include "lcanvasview.h"
+
+#include <algorithm>
+
+namespace lwscode {
+
+static const char SessionMagic[4] = { 'L', 'W', 'S', 'R' };
+static const quint32 SessionVersion = 1;
+
+LCanvasRecorder::LCanvasRecorder(LCanvasView *view)
+	: QObject()
+	, m_view(view)
+{
+
+}
+
+LCanvasRecorder::~LCanvasRecorder()
+{
+	stop();
+}
+
+bool LCanvasRecorder::start(const QString &sessionPath, const QString &documentPath)
+{
+	stop();
+
+	m_file.setFileName(sessionPath);
+	if (!m_file.open(QFile::WriteOnly | QFile::Truncate))
+		return false;
+
+	m_stream.setDevice(&m_file);
+	m_stream.setVersion(QDataStream::Qt_5_6);
+	m_stream.writeRawData(SessionMagic, sizeof(SessionMagic));
+	m_stream << SessionVersion << m_view->size() << documentPath;
+
+	// replay checks it starts from the same document
+	LInputRecord record = emptyRecord();
+	record.type = InputRecordType::ChecksumRecord;
+	record.checksum = m_view->documentChecksum();
+	m_timer.start();
+	writeRecord(record);
+
+	m_view->installEventFilter(this);
+	return true;
+}
+
+void LCanvasRecorder::stop()
+{
+	if (!isRecording())
+		return;
+
+	m_view->removeEventFilter(this);
+
+	LInputRecord record = emptyRecord();
+	record.type = InputRecordType::ChecksumRecord;
+	record.checksum = m_view->documentChecksum();
+	writeRecord(record);
+
+	m_stream.setDevice(nullptr);
+	m_file.close();
+}
+
+bool LCanvasRecorder::isRecording() const
+{
+	return m_file.isOpen();
+}
+
+void LCanvasRecorder::recordAction(InputAction action, const QVariant &value)
+{
+	if (!isRecording())
+		return;
+
+	LInputRecord record = emptyRecord();
+	record.type = InputRecordType::ActionRecord;
+	record.action = action;
+	record.value = value;
+	writeRecord(record);
+}
+
+bool LCanvasRecorder::replay(const QString &sessionPath, const QString &documentPath, QTextStream &report)
+{
+	QFile file(sessionPath);
+	if (!file.open(QFile::ReadOnly))
+		return false;
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_6);
+
+	char magic[sizeof(SessionMagic)];
+	quint32 version = 0;
+	QSize viewSize;
+	QString recordedPath;
+	if (stream.readRawData(magic, sizeof(magic)) != sizeof(magic) ||
+		memcmp(magic, SessionMagic, sizeof(magic)) != 0)
+		return false;
+
+	stream >> version >> viewSize >> recordedPath;
+	if (version != SessionVersion || stream.status() != QDataStream::Ok)
+		return false;
+
+	// the replay is not the user's document, so it keeps out of the autosave directory
+	QStandardPaths::setTestModeEnabled(true);
+	LCanvasView view;
+	view.setJournalEnabled(false);
+	view.resize(viewSize);
+	view.show();
+
+	QString filePath = documentPath.isEmpty() ? recordedPath : documentPath;
+	if (!filePath.isEmpty())
+	{
+		bool loaded = false;
+		QEventLoop loop;
+		QObject::connect(&view, &LCanvasView::fileTaskFinished, &loop, [&](bool success) {
+			loaded = success;
+			loop.quit();
+		});
+		QMetaObject::invokeMethod(&view, "readItemsFromFile", Qt::DirectConnection, Q_ARG(QString, filePath));
+		if (view.isFileTaskRunning())
+			loop.exec();
+
+		if (!loaded)
+		{
+			report << "# cannot load " << filePath << "\n";
+			return false;
+		}
+	}
+
+	// every event is handled and then painted synchronously, so the two
+	// times add up to what the user waited for
+	report << "index,type,time_ms,handler_us,paint_us\n";
+
+	QVector<qint64> totals;
+	int checksums = 0;
+	bool matched = true;
+	LInputRecord record = emptyRecord();
+	for (int index = 0; readRecord(stream, record); ++index)
+	{
+		if (record.type == InputRecordType::ChecksumRecord)
+		{
+			quint64 checksum = view.documentChecksum();
+			bool match = checksum == record.checksum;
+			matched = matched && match;
+			report << "# " << (checksums++ == 0 ? "start" : "end") << " checksum recorded "
+				   << QString::number(record.checksum, 16) << " replayed " << QString::number(checksum, 16)
+				   << (match ? " match" : " MISMATCH") << "\n";
+			continue;
+		}
+
+		QElapsedTimer timer;
+		const char *type = "action";
+		if (record.type == InputRecordType::ActionRecord)
+		{
+			timer.start();
+			view.applyAction(InputAction(record.action), record.value);
+		}
+		else
+		{
+			QScopedPointer<QEvent> event(createEvent(record));
+			if (!event)
+				continue;
+
+			type = record.type == InputRecordType::WheelRecord ? "wheel" : "mouse";
+			timer.start();
+			QCoreApplication::sendEvent(&view, event.data());
+		}
+		qint64 handlerTime = timer.nsecsElapsed();
+		view.repaint();
+		qint64 totalTime = timer.nsecsElapsed();
+		totals << totalTime;
+
+		report << index << "," << type << "," << QString::number(record.time) << ","
+			   << QString::number(handlerTime / 1000.0, 'f', 1) << ","
+			   << QString::number((totalTime - handlerTime) / 1000.0, 'f', 1) << "\n";
+	}
+
+	if (!totals.isEmpty())
+	{
+		std::sort(totals.begin(), totals.end());
+		report << "# events " << totals.size()
+			   << " p50_us " << QString::number(totals[totals.size() / 2] / 1000.0, 'f', 1)
+			   << " p95_us " << QString::number(totals[totals.size() * 95 / 100] / 1000.0, 'f', 1)
+			   << " max_us " << QString::number(totals.last() / 1000.0, 'f', 1) << "\n";
+	}
+	report.flush();
+
+	return matched;
+}
+
+bool LCanvasRecorder::eventFilter(QObject *watched, QEvent *event)
+{
+	if (watched != m_view)
+		return QObject::eventFilter(watched, event);
+
+	switch (event->type())
+	{
+	case QEvent::MouseButtonPress:
+	case QEvent::MouseMove:
+	case QEvent::MouseButtonRelease:
+	case QEvent::MouseButtonDblClick:
+	{
+		QMouseEvent *mouseEvent = static_cast<QMouseEvent *>(event);
+		LInputRecord record = emptyRecord();
+		record.type = InputRecordType::MouseRecord;
+		record.eventType = event->type();
+		record.pos = mouseEvent->pos();
+		record.button = mouseEvent->button();
+		record.buttons = mouseEvent->buttons();
+		record.modifiers = mouseEvent->modifiers();
+		writeRecord(record);
+		break;
+	}
+	case QEvent::Wheel:
+	{
+		QWheelEvent *wheelEvent = static_cast<QWheelEvent *>(event);
+		LInputRecord record = emptyRecord();
+		record.type = InputRecordType::WheelRecord;
+		record.pos = wheelEvent->position().toPoint();
+		record.buttons = wheelEvent->buttons();
+		record.modifiers = wheelEvent->modifiers();
+		record.pixelDelta = wheelEvent->pixelDelta();
+		record.angleDelta = wheelEvent->angleDelta();
+		writeRecord(record);
+		break;
+	}
+	default:
+	{
+		break;
+	}
+	}
+
+	return QObject::eventFilter(watched, event);
+}
+
+void LCanvasRecorder::writeRecord(const LInputRecord &record)
+{
+	m_stream << record.type << qint64(m_timer.elapsed());
+	switch (record.type)
+	{
+	case InputRecordType::MouseRecord:
+	{
+		m_stream << record.eventType << record.pos << record.button << record.buttons << record.modifiers;
+		break;
+	}
+	case InputRecordType::WheelRecord:
+	{
+		m_stream << record.pos << record.buttons << record.modifiers << record.pixelDelta << record.angleDelta;
+		break;
+	}
+	case InputRecordType::ActionRecord:
+	{
+		m_stream << record.action << record.value;
+		break;
+	}
+	case InputRecordType::ChecksumRecord:
+	{
+		m_stream << record.checksum;
+		break;
+	}
+	default:
+	{
+		break;
+	}
+	}
+
+	// a session that ends in a crash is still worth replaying
+	m_file.flush();
+}
+
+LInputRecord LCanvasRecorder::emptyRecord()
+{
+	LInputRecord record;
+	record.type = InputRecordType::NoneRecord;
+	record.time = 0;
+	record.eventType = QEvent::None;
+	record.button = Qt::NoButton;
+	record.buttons = Qt::NoButton;
+	record.modifiers = Qt::NoModifier;
+	record.action = InputAction::NoneAction;
+	record.checksum = 0;
+	return record;
+}
+
+bool LCanvasRecorder::readRecord(QDataStream &stream, LInputRecord &record)
+{
+	if (stream.atEnd())
+		return false;
+
+	record = emptyRecord();
+	stream >> record.type >> record.time;
+	switch (record.type)
+	{
+	case InputRecordType::MouseRecord:
+	{
+		stream >> record.eventType >> record.pos >> record.button >> record.buttons >> record.modifiers;
+		break;
+	}
+	case InputRecordType::WheelRecord:
+	{
+		stream >> record.pos >> record.buttons >> record.modifiers >> record.pixelDelta >> record.angleDelta;
+		break;
+	}
+	case InputRecordType::ActionRecord:
+	{
+		stream >> record.action >> record.value;
+		break;
+	}
+	case InputRecordType::ChecksumRecord:
+	{
+		stream >> record.checksum;
+		break;
+	}
+	default:
+	{
+		return false;
+	}
+	}
+
+	return stream.status() == QDataStream::Ok;
+}
+
+QEvent *LCanvasRecorder::createEvent(const LInputRecord &record)
+{
+	if (record.type == InputRecordType::MouseRecord)
+	{
+		return new QMouseEvent(QEvent::Type(record.eventType), QPointF(record.pos),
+							   Qt::MouseButton(record.button), Qt::MouseButtons(record.buttons),
+							   Qt::KeyboardModifiers(record.modifiers));
+	}
+
+	if (record.type == InputRecordType::WheelRecord)
+	{
+		return new QWheelEvent(QPointF(record.pos), QPointF(record.pos), record.pixelDelta, record.angleDelta,
+							   Qt::MouseButtons(record.buttons), Qt::KeyboardModifiers(record.modifiers),
+							   Qt::NoScrollPhase, false);
+	}
+
+	return nullptr;
+}
+
+} // namespace
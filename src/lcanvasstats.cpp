@@ -0,0 +1,269 @@
+#include "lcanvasstats.h"
+
+#include <algorithm>
+
+namespace lwscode {
+
+static const int HistoryLength = 120;
+static const int OverlayWidth = 240;
+static const int GraphHeight = 48;
+static const int HistogramHeight = 32;
+static const int HistogramBuckets = 8;
+static const qint64 FrameBudget = 16666667;
+
+static QAtomicInteger<qint64> CacheHits;
+static QAtomicInteger<qint64> CacheMisses;
+
+static LCanvasFrameStats emptyFrame()
+{
+	LCanvasFrameStats frame;
+	memset(&frame, 0, sizeof(frame));
+	frame.inputLatency = -1;
+	return frame;
+}
+
+static double toMsecs(qint64 nsecs)
+{
+	return nsecs / 1000000.0;
+}
+
+LCanvasStats::LCanvasStats()
+	: m_bInputPending(false)
+	, m_current(emptyFrame())
+	, m_nNext(0)
+	, m_nCount(0)
+	, m_nCacheHits(CacheHits.loadAcquire())
+	, m_nCacheMisses(CacheMisses.loadAcquire())
+{
+	m_history.resize(HistoryLength);
+}
+
+void LCanvasStats::beginFrame(const QRegion &dirtyRegion)
+{
+	m_current = emptyFrame();
+	for (auto it = dirtyRegion.begin(); it != dirtyRegion.end(); ++it)
+		m_current.dirtyArea += qint64(it->width()) * it->height();
+
+	m_frameTimer.start();
+}
+
+void LCanvasStats::beginPhase(PaintPhase phase)
+{
+	Q_UNUSED(phase);
+	m_phaseTimer.start();
+}
+
+void LCanvasStats::endPhase(PaintPhase phase)
+{
+	m_current.phaseTimes[phase] += m_phaseTimer.nsecsElapsed();
+}
+
+void LCanvasStats::addDrawn(int count)
+{
+	m_current.itemsDrawn += count;
+}
+
+void LCanvasStats::addCulled(int count)
+{
+	m_current.itemsCulled += count;
+}
+
+void LCanvasStats::addCacheHit()
+{
+	CacheHits.fetchAndAddRelaxed(1);
+}
+
+void LCanvasStats::addCacheMiss()
+{
+	CacheMisses.fetchAndAddRelaxed(1);
+}
+
+void LCanvasStats::markInput()
+{
+	// events arriving before the next frame are shown by the same frame, the
+	// first one waited longest
+	if (!m_bInputPending)
+	{
+		m_bInputPending = true;
+		m_inputTimer.start();
+	}
+}
+
+void LCanvasStats::endFrame()
+{
+	m_current.frameTime = m_frameTimer.nsecsElapsed();
+	if (m_bInputPending)
+	{
+		m_current.inputLatency = m_inputTimer.nsecsElapsed();
+		m_bInputPending = false;
+	}
+
+	qint64 hits = CacheHits.loadAcquire();
+	qint64 misses = CacheMisses.loadAcquire();
+	m_current.cacheHits = hits - m_nCacheHits;
+	m_current.cacheMisses = misses - m_nCacheMisses;
+	m_nCacheHits = hits;
+	m_nCacheMisses = misses;
+
+	m_history[m_nNext] = m_current;
+	m_nNext = (m_nNext + 1) % HistoryLength;
+	m_nCount = qMin(m_nCount + 1, HistoryLength);
+}
+
+void LCanvasStats::reset()
+{
+	m_bInputPending = false;
+	m_current = emptyFrame();
+	m_nNext = 0;
+	m_nCount = 0;
+	m_nCacheHits = CacheHits.loadAcquire();
+	m_nCacheMisses = CacheMisses.loadAcquire();
+}
+
+int LCanvasStats::frameCount() const
+{
+	return m_nCount;
+}
+
+LCanvasFrameStats LCanvasStats::lastFrame() const
+{
+	if (m_nCount == 0)
+		return emptyFrame();
+
+	return m_history[(m_nNext + HistoryLength - 1) % HistoryLength];
+}
+
+LCanvasFrameStats LCanvasStats::averageFrame() const
+{
+	LCanvasFrameStats average = emptyFrame();
+	if (m_nCount == 0)
+		return average;
+
+	qint64 drawn = 0;
+	qint64 culled = 0;
+	qint64 latency = 0;
+	int latencyCount = 0;
+	foreach (auto &frame, history())
+	{
+		average.frameTime += frame.frameTime;
+		for (int i = 0; i < PaintPhase::PhaseCount; ++i)
+			average.phaseTimes[i] += frame.phaseTimes[i];
+		drawn += frame.itemsDrawn;
+		culled += frame.itemsCulled;
+		average.cacheHits += frame.cacheHits;
+		average.cacheMisses += frame.cacheMisses;
+		average.dirtyArea += frame.dirtyArea;
+		if (frame.inputLatency >= 0)
+		{
+			latency += frame.inputLatency;
+			++latencyCount;
+		}
+	}
+
+	// cache counters stay totals, so the hit rate over the window is exact
+	average.frameTime /= m_nCount;
+	for (int i = 0; i < PaintPhase::PhaseCount; ++i)
+		average.phaseTimes[i] /= m_nCount;
+	average.itemsDrawn = int(drawn / m_nCount);
+	average.itemsCulled = int(culled / m_nCount);
+	average.dirtyArea /= m_nCount;
+	if (latencyCount > 0)
+		average.inputLatency = latency / latencyCount;
+
+	return average;
+}
+
+QVector<LCanvasFrameStats> LCanvasStats::history() const
+{
+	QVector<LCanvasFrameStats> frames;
+	frames.reserve(m_nCount);
+	for (int i = m_nCount; i > 0; --i)
+		frames << m_history[(m_nNext + HistoryLength - i) % HistoryLength];
+
+	return frames;
+}
+
+QVector<int> LCanvasStats::histogram(qint64 bucketTime, int bucketCount) const
+{
+	// frame times by bucket, the last bucket also takes everything slower
+	QVector<int> buckets(qMax(1, bucketCount), 0);
+	if (bucketTime <= 0)
+		return buckets;
+
+	foreach (auto &frame, history())
+		++buckets[int(qMin<qint64>(frame.frameTime / bucketTime, buckets.size() - 1))];
+
+	return buckets;
+}
+
+void LCanvasStats::paintOverlay(QPainter &painter, const QPoint &pos) const
+{
+	LCanvasFrameStats last = lastFrame();
+	LCanvasFrameStats average = averageFrame();
+
+	QStringList lines;
+	lines << QString::fromUtf8("frame %1 ms (avg %2 ms)")
+		.arg(toMsecs(last.frameTime), 0, 'f', 2).arg(toMsecs(average.frameTime), 0, 'f', 2);
+	lines << QString::fromUtf8("items %1 / selection %2 / hud %3 ms")
+		.arg(toMsecs(last.phaseTimes[PaintPhase::ItemsPhase]), 0, 'f', 2)
+		.arg(toMsecs(last.phaseTimes[PaintPhase::SelectionPhase]), 0, 'f', 2)
+		.arg(toMsecs(last.phaseTimes[PaintPhase::OverlayPhase]), 0, 'f', 2);
+	lines << QString::fromUtf8("drawn %1, culled %2").arg(last.itemsDrawn).arg(last.itemsCulled);
+
+	qint64 lookups = average.cacheHits + average.cacheMisses;
+	if (lookups > 0)
+		lines << QString::fromUtf8("cache hits %1%").arg(100.0 * average.cacheHits / lookups, 0, 'f', 1);
+	else
+		lines << QString::fromUtf8("cache hits -");
+
+	lines << QString::fromUtf8("dirty %1 kpx").arg(last.dirtyArea / 1000);
+	if (average.inputLatency >= 0)
+		lines << QString::fromUtf8("input latency %1 ms").arg(toMsecs(average.inputLatency), 0, 'f', 2);
+	else
+		lines << QString::fromUtf8("input latency -");
+
+	painter.save();
+	painter.resetTransform();
+	painter.setRenderHint(QPainter::Antialiasing, false);
+
+	QFontMetrics fontMetrics(painter.font());
+	int lineHeight = fontMetrics.height();
+	QRect rect(pos, QSize(OverlayWidth, lines.size() * lineHeight + GraphHeight + HistogramHeight + 16));
+	painter.fillRect(rect, QColor(0, 0, 0, 180));
+
+	painter.setPen(Qt::white);
+	for (int i = 0; i < lines.size(); ++i)
+		painter.drawText(rect.left() + 4, rect.top() + 2 + fontMetrics.ascent() + i * lineHeight, lines[i]);
+
+	// rolling frame times, one bar per frame, scaled so two budgets fill the graph
+	QRect graph(rect.left() + 4, rect.bottom() - HistogramHeight - GraphHeight - 8, OverlayWidth - 8, GraphHeight);
+	QVector<LCanvasFrameStats> frames = history();
+	double barWidth = double(graph.width()) / HistoryLength;
+	for (int i = 0; i < frames.size(); ++i)
+	{
+		qint64 frameTime = frames[i].frameTime;
+		int height = int(qMin<qint64>(graph.height(), frameTime * graph.height() / (2 * FrameBudget)));
+		QColor color = frameTime > FrameBudget ? QColor(230, 80, 60) : QColor(90, 200, 90);
+		painter.fillRect(QRectF(graph.left() + i * barWidth, graph.bottom() - height, qMax(1.0, barWidth - 1), height), color);
+	}
+
+	painter.setPen(QColor(255, 255, 255, 120));
+	painter.drawLine(graph.left(), graph.bottom() - graph.height() / 2, graph.right(), graph.bottom() - graph.height() / 2);
+
+	// frame times over the window by quarter budget, the last bucket holds
+	// everything past two budgets
+	QRect histogramRect(graph.left(), rect.bottom() - HistogramHeight - 4, graph.width(), HistogramHeight);
+	QVector<int> buckets = histogram(FrameBudget / 4, HistogramBuckets);
+	int maxCount = qMax(1, *std::max_element(buckets.constBegin(), buckets.constEnd()));
+	double bucketWidth = double(histogramRect.width()) / buckets.size();
+	for (int i = 0; i < buckets.size(); ++i)
+	{
+		int height = buckets[i] * histogramRect.height() / maxCount;
+		QColor color = i >= 4 ? QColor(230, 80, 60) : QColor(90, 160, 230);
+		painter.fillRect(QRectF(histogramRect.left() + i * bucketWidth, histogramRect.bottom() - height,
+								qMax(1.0, bucketWidth - 2), height), color);
+	}
+	painter.restore();
+}
+
+} // namespace
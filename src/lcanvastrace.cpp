@@ -0,0 +1,200 @@
+#include "lcanvastrace.h"
+
+namespace lwscode {
+
+// a runaway recording stops growing at about 64 MB per thread
+static const int MaxEventsPerThread = 2 * 1024 * 1024;
+
+struct LTraceEvent
+{
+	const char *category;
+	const char *name;
+	qint64 begin;
+	qint64 duration;
+	qint64 arg;
+};
+
+// each thread appends to its own buffer, the lock is only contended while
+// the trace is written out
+struct LTraceBuffer
+{
+	QMutex mutex;
+	int threadId;
+	QString threadName;
+	QVector<LTraceEvent> events;
+};
+
+struct LTraceRegistry
+{
+	QMutex mutex;
+	QList<LTraceBuffer *> buffers;
+	QAtomicInt recording;
+	QElapsedTimer clock;
+
+	LTraceRegistry()
+	{
+		clock.start();
+	}
+
+	~LTraceRegistry()
+	{
+		qDeleteAll(buffers);
+	}
+};
+
+static LTraceRegistry &registry()
+{
+	static LTraceRegistry registry;
+	return registry;
+}
+
+static LTraceBuffer *threadBuffer()
+{
+	// buffers outlive their threads, so events from finished file tasks still
+	// reach the output
+	static thread_local LTraceBuffer *buffer = nullptr;
+	if (!buffer)
+	{
+		LTraceRegistry &traceRegistry = registry();
+		QMutexLocker locker(&traceRegistry.mutex);
+		buffer = new LTraceBuffer();
+		buffer->threadId = traceRegistry.buffers.size() + 1;
+		buffer->threadName = QThread::currentThread()->objectName();
+		if (buffer->threadName.isEmpty())
+		{
+			bool mainThread = QCoreApplication::instance() &&
+				QThread::currentThread() == QCoreApplication::instance()->thread();
+			buffer->threadName = mainThread ? QString::fromUtf8("main")
+											: QString::fromUtf8("worker %1").arg(buffer->threadId);
+		}
+		traceRegistry.buffers << buffer;
+	}
+
+	return buffer;
+}
+
+static void appendJsonString(QByteArray &json, const char *string)
+{
+	json += '"';
+	for (const char *ch = string; *ch; ++ch)
+	{
+		if (*ch == '"' || *ch == '\\')
+			json += '\\';
+		json += *ch;
+	}
+	json += '"';
+}
+
+bool LCanvasTrace::isAvailable()
+{
+#ifdef LCANVAS_TRACE_ENABLED
+	return true;
+#else
+	return false;
+#endif
+}
+
+void LCanvasTrace::start()
+{
+	LTraceRegistry &traceRegistry = registry();
+	QMutexLocker locker(&traceRegistry.mutex);
+	foreach (auto buffer, traceRegistry.buffers)
+	{
+		QMutexLocker bufferLocker(&buffer->mutex);
+		buffer->events.clear();
+	}
+	traceRegistry.recording.storeRelease(isAvailable() ? 1 : 0);
+}
+
+void LCanvasTrace::stop()
+{
+	registry().recording.storeRelease(0);
+}
+
+bool LCanvasTrace::isRecording()
+{
+	return registry().recording.loadAcquire() != 0;
+}
+
+qint64 LCanvasTrace::now()
+{
+	return registry().clock.nsecsElapsed();
+}
+
+void LCanvasTrace::addEvent(const char *category, const char *name, qint64 begin, qint64 duration, qint64 arg)
+{
+	if (!isRecording())
+		return;
+
+	LTraceBuffer *buffer = threadBuffer();
+	QMutexLocker locker(&buffer->mutex);
+	if (buffer->events.size() >= MaxEventsPerThread)
+		return;
+
+	LTraceEvent event = { category, name, begin, duration, arg };
+	buffer->events << event;
+}
+
+bool LCanvasTrace::write(const QString &filePath)
+{
+	QSaveFile file(filePath);
+	if (!file.open(QFile::WriteOnly))
+		return false;
+
+	QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+	QByteArray json;
+	json.reserve(1024 * 1024);
+	json += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+	bool first = true;
+	LTraceRegistry &traceRegistry = registry();
+	QMutexLocker locker(&traceRegistry.mutex);
+	foreach (auto buffer, traceRegistry.buffers)
+	{
+		QMutexLocker bufferLocker(&buffer->mutex);
+		QByteArray tid = QByteArray::number(buffer->threadId);
+
+		// thread names as metadata events
+		json += first ? "\n" : ",\n";
+		first = false;
+		json += "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" + pid + ",\"tid\":" + tid + ",\"args\":{\"name\":";
+		appendJsonString(json, buffer->threadName.toUtf8().constData());
+		json += "}}";
+
+		// complete events, timestamps in microseconds
+		foreach (auto &event, buffer->events)
+		{
+			json += ",\n{\"ph\":\"X\",\"cat\":";
+			appendJsonString(json, event.category);
+			json += ",\"name\":";
+			appendJsonString(json, event.name);
+			json += ",\"ts\":" + QByteArray::number(event.begin / 1000.0, 'f', 3);
+			json += ",\"dur\":" + QByteArray::number(event.duration / 1000.0, 'f', 3);
+			json += ",\"pid\":" + pid + ",\"tid\":" + tid;
+			if (event.arg >= 0)
+				json += ",\"args\":{\"value\":" + QByteArray::number(event.arg) + "}";
+			json += "}";
+
+			if (json.size() >= 1024 * 1024)
+			{
+				if (file.write(json) != json.size())
+				{
+					file.cancelWriting();
+					return false;
+				}
+				json.clear();
+			}
+		}
+	}
+	json += "\n]}\n";
+
+	if (file.write(json) != json.size())
+	{
+		file.cancelWriting();
+		return false;
+	}
+
+	return file.commit();
+}
+
+} // namespace
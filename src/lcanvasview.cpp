@@ -1,7 +1,14 @@
 #include "lcanvasview.h"
+#include "lcanvaswriter.h"
+#include "lcanvastrace.h"
+
+#include <algorithm>
 
 namespace lwscode {
 
+// items painted per trace event
+static const int PaintBatchSize = 4096;
+
 LCanvasView::LCanvasView(QWidget *parent)
 	: QWidget(parent)
 	, m_rightClickMenu(nullptr)
@@ -15,6 +22,13 @@ LCanvasView::LCanvasView(QWidget *parent)
 	, m_lineEdit(nullptr)
 	, m_hitTestStatus(HitTestStatus::NoneStatus)
 	, m_itemHitPos(ItemHitPos::NonePos)
+	, m_fileTaskMode(FileTaskMode::NoneTask)
+	, m_fileTaskTimer(nullptr)
+	, m_bLoadingPreview(false)
+	, m_bShareGeometry(false)
+	, m_nSymbolNumber(0)
+	, m_bPickSynced(false)
+	, m_bStatsVisible(false)
 {
 	this->resize(500, 500);
 	this->setMinimumSize(QSize(100, 100));
@@ -26,13 +40,25 @@ LCanvasView::LCanvasView(QWidget *parent)
 	palette.setColor(role, m_canvasColor);
 	this->setPalette(palette);
 
+	qRegisterMetaType<LCanvasItemList>("LCanvasItemList");
+	m_fileTaskPool.setMaxThreadCount(1);
+
+	m_fileTaskTimer = new QTimer(this);
+	m_fileTaskTimer->setInterval(100);
+	connect(m_fileTaskTimer, SIGNAL(timeout()), this, SLOT(updateFileTaskProgress()));
+
 	initLineEdit();
 	initRightClickMenu();
+
+	m_journal.open();
 }
 
 LCanvasView::~LCanvasView()
 {
-
+	stopRecording();
+	cancelFileTask();
+	m_fileTaskPool.waitForDone();
+	m_journal.discard();
 }
 
 void LCanvasView::setCanvasColor(const QColor &color)
@@ -50,14 +76,18 @@ void LCanvasView::setCanvasColor(const QColor &color)
 
 void LCanvasView::setFillColor(const QColor &color)
 {
+	recordAction(InputAction::FillColorAction, color);
 	if (color.isValid() && m_fillColor != color)
 	{
 		m_fillColor = color;
 
 		if (!m_selectedItems.isEmpty())
 		{
-			foreach (auto &item, m_selectedItems)
-				item->setFillColor(m_fillColor);
+			for (int i = 0; i < m_selectedItems.size(); ++i)
+				detachSelectedItem(i)->setFillColor(m_fillColor);
+
+			m_journal.setItemFillColor(selectedIndices(), m_fillColor);
+			compactJournal();
 
 			this->update();
 		}
@@ -66,14 +96,18 @@ void LCanvasView::setFillColor(const QColor &color)
 
 void LCanvasView::setStrokeColor(const QColor &color)
 {
+	recordAction(InputAction::StrokeColorAction, color);
 	if (color.isValid() && m_strokeColor != color)
 	{
 		m_strokeColor = color;
 
 		if (!m_selectedItems.isEmpty())
 		{
-			foreach (auto &item, m_selectedItems)
-				item->setStrokeColor(m_strokeColor);
+			for (int i = 0; i < m_selectedItems.size(); ++i)
+				detachSelectedItem(i)->setStrokeColor(m_strokeColor);
+
+			m_journal.setItemStrokeColor(selectedIndices(), m_strokeColor);
+			compactJournal();
 
 			this->update();
 		}
@@ -82,26 +116,41 @@ void LCanvasView::setStrokeColor(const QColor &color)
 
 void LCanvasView::setStrokeWidth(int width)
 {
+	recordAction(InputAction::StrokeWidthAction, width);
 	if (m_nStrokeWidth != width)
 	{
 		m_nStrokeWidth = width;
 
 		if (!m_selectedItems.isEmpty())
 		{
-			foreach (auto &item, m_selectedItems)
-				item->setStrokeWidth(m_nStrokeWidth);
+			for (int i = 0; i < m_selectedItems.size(); ++i)
+				detachSelectedItem(i)->setStrokeWidth(m_nStrokeWidth);
+
+			m_journal.setItemStrokeWidth(selectedIndices(), m_nStrokeWidth);
+			compactJournal();
 
 			this->update();
 		}
 	}
 }
 
+void LCanvasView::setCanvasSize(const QSize &size)
+{
+	recordAction(InputAction::ResizeAction, size);
+	this->resize(size);
+}
+
 void LCanvasView::clearCanvas()
 {
+	recordAction(InputAction::ClearAction);
 	m_allItems.clear();
 	m_textItems.clear();
 	m_selectedItems.clear();
 	m_duplicatedItems.clear();
+	m_textGroup.clear();
+	m_journal.clearItems();
+	m_pickBuffer.reset();
+	m_bPickSynced = false;
 
 	this->update();
 }
@@ -111,27 +160,313 @@ bool LCanvasView::existItems()
 	return !m_allItems.isEmpty();
 }
 
-void LCanvasView::paintEvent(QPaintEvent *)
+bool LCanvasView::isFileTaskRunning() const
+{
+	return m_fileTaskMode != FileTaskMode::NoneTask;
+}
+
+bool LCanvasView::recoverFromJournal()
+{
+	QString journalPath = LCanvasJournal::findOrphan();
+	if (journalPath.isEmpty())
+		return false;
+
+	LCanvasItemList items;
+	QSize canvasSize;
+	QString documentPath;
+	if (!LCanvasJournal::replay(journalPath, items, canvasSize, documentPath))
+		return false;
+
+	replaceItems(items);
+	m_journal.setDocumentPath(documentPath);
+
+	// the orphan is only the copy of the work until this session's journal holds it
+	if (m_journal.compact(m_allItems, this->size()))
+		LCanvasJournal::remove(journalPath);
+	return true;
+}
+
+// views that are not the user's document, such as replays and benchmarks,
+// turn the journal off so that they leave nothing in the autosave directory
+void LCanvasView::setJournalEnabled(bool enabled)
+{
+	if (enabled == m_journal.isOpen())
+		return;
+
+	if (enabled)
+	{
+		if (m_journal.open())
+			m_journal.compact(m_allItems, this->size());
+	}
+	else
+	{
+		m_journal.discard();
+	}
+}
+
+bool LCanvasView::isJournalEnabled() const
+{
+	return m_journal.isOpen();
+}
+
+bool LCanvasView::isStatsVisible() const
+{
+	return m_bStatsVisible;
+}
+
+const LCanvasStats &LCanvasView::stats() const
+{
+	return m_stats;
+}
+
+bool LCanvasView::startRecording(const QString &sessionPath)
+{
+	if (!m_recorder)
+		m_recorder.reset(new LCanvasRecorder(this));
+
+	return m_recorder->start(sessionPath, m_fileTaskPath);
+}
+
+void LCanvasView::stopRecording()
+{
+	if (m_recorder)
+		m_recorder->stop();
+}
+
+bool LCanvasView::isRecording() const
+{
+	return m_recorder && m_recorder->isRecording();
+}
+
+void LCanvasView::applyAction(InputAction action, const QVariant &value)
+{
+	switch (action)
+	{
+	case InputAction::ItemTypeAction:
+	{
+		setItemType(ItemType(value.toInt()));
+		break;
+	}
+	case InputAction::FillColorAction:
+	{
+		setFillColor(value.value<QColor>());
+		break;
+	}
+	case InputAction::StrokeColorAction:
+	{
+		setStrokeColor(value.value<QColor>());
+		break;
+	}
+	case InputAction::StrokeWidthAction:
+	{
+		setStrokeWidth(value.toInt());
+		break;
+	}
+	case InputAction::TextAction:
+	{
+		// the line edit was placed by the press that opened it
+		m_lineEdit->setText(value.toString());
+		addText();
+		break;
+	}
+	case InputAction::ClearAction:
+	{
+		clearCanvas();
+		break;
+	}
+	case InputAction::CopyAction:
+	{
+		copyItem();
+		break;
+	}
+	case InputAction::PasteAction:
+	{
+		pasteItem();
+		break;
+	}
+	case InputAction::DeleteAction:
+	{
+		deleteItem();
+		break;
+	}
+	case InputAction::MoveTopAction:
+	{
+		moveTopItem();
+		break;
+	}
+	case InputAction::MoveUpAction:
+	{
+		moveUpItem();
+		break;
+	}
+	case InputAction::MoveDownAction:
+	{
+		moveDownItem();
+		break;
+	}
+	case InputAction::MoveBottomAction:
+	{
+		moveBottomItem();
+		break;
+	}
+	case InputAction::GroupAction:
+	{
+		groupItems();
+		break;
+	}
+	case InputAction::UngroupAction:
+	{
+		ungroupItems();
+		break;
+	}
+	case InputAction::SymbolAction:
+	{
+		makeSymbol();
+		break;
+	}
+	case InputAction::ResizeAction:
+	{
+		setCanvasSize(value.toSize());
+		break;
+	}
+	default:
+	{
+		break;
+	}
+	}
+}
+
+quint64 LCanvasView::documentChecksum()
+{
+	commitSelectionTransform();
+
+	// FNV-1a over the item hashes in z-order
+	quint64 checksum = Q_UINT64_C(0xcbf29ce484222325);
+	auto mix = [&checksum](quint64 value) {
+		for (int i = 0; i < 8; ++i)
+		{
+			checksum ^= (value >> (i * 8)) & 0xff;
+			checksum *= Q_UINT64_C(0x100000001b3);
+		}
+	};
+
+	mix(quint64(m_allItems.size()));
+	foreach (auto &item, m_allItems)
+		mix(item->contentHash());
+
+	return checksum;
+}
+
+LCanvasMemoryReport LCanvasView::memoryReport() const
+{
+	LCanvasMemoryReport report;
+	report.addItems(m_allItems, MemoryScope::DocumentScope);
+	report.addItems(m_duplicatedItems, MemoryScope::ClipboardScope);
+
+	// the other lists only hold handles to items counted above
+	report.addList(QString::fromUtf8("all items"), m_allItems);
+	report.addList(QString::fromUtf8("text items"), m_textItems);
+	report.addList(QString::fromUtf8("selected items"), m_selectedItems);
+	report.addList(QString::fromUtf8("clipboard"), m_duplicatedItems);
+	report.addList(QString::fromUtf8("replaced items"), m_replacedItems);
+
+	return report;
+}
+
+void LCanvasView::cancelFileTask()
 {
+	if (m_fileTaskProgress)
+		m_fileTaskProgress->cancel();
+}
+
+void LCanvasView::setStatsVisible(bool visible)
+{
+	if (m_bStatsVisible != visible)
+	{
+		m_bStatsVisible = visible;
+		m_stats.reset();
+		this->update();
+	}
+}
+
+// applies to the next load, the document in the view is left as it is
+void LCanvasView::setShareGeometry(bool share)
+{
+	m_bShareGeometry = share;
+}
+
+void LCanvasView::paintEvent(QPaintEvent *event)
+{
+	LCANVAS_TRACE("paint", "paintEvent");
+	m_stats.beginFrame(event->region());
+
 	QPainter painter(this);
 	painter.setRenderHint(QPainter::Antialiasing);
 	painter.scale(m_fScaleFactor, m_fScaleFactor);
 
-	foreach (auto &item, m_allItems)
-		item->paintItem(painter);
+	// items outside the exposed area are skipped instead of clipped; bounds
+	// are only rebuilt for items changed since the last frame
+	QRect exposedRect = QTransform::fromScale(1.0 / m_fScaleFactor, 1.0 / m_fScaleFactor)
+		.mapRect(event->rect()).adjusted(-1, -1, 1, 1);
+	int drawn = 0;
+	bool pending = !m_selectionOffset.isNull() || !m_selectionTransform.isIdentity();
+	m_stats.beginPhase(PaintPhase::ItemsPhase);
+	for (int begin = 0; begin < m_allItems.size(); begin += PaintBatchSize)
+	{
+		LCANVAS_TRACE_ARG("paint", "paintItems", begin);
+		int end = qMin(begin + PaintBatchSize, m_allItems.size());
+		for (int i = begin; i < end; ++i)
+		{
+			const SPtrLCanvasItem &item = m_allItems.at(i);
+			QRect bounds = item->boundingRect();
+			bool dragged = pending && item->isSelected();
+			QTransform transform;
+			if (dragged)
+			{
+				transform = selectionTransform(item);
+				bounds = transform.mapRect(bounds);
+			}
+			if (bounds.isValid() && !exposedRect.intersects(bounds))
+				continue;
 
+			if (dragged)
+			{
+				painter.save();
+				painter.setTransform(transform, true);
+				item->paintItem(painter);
+				painter.restore();
+			}
+			else
+			{
+				item->paintItem(painter);
+			}
+			++drawn;
+		}
+	}
+	m_stats.endPhase(PaintPhase::ItemsPhase);
+	m_stats.addDrawn(drawn);
+	m_stats.addCulled(m_allItems.size() - drawn);
+
+	m_stats.beginPhase(PaintPhase::SelectionPhase);
 	if (m_selectedItems.size() > 1)
 	{
 		foreach (auto &item, m_selectedItems)
-		{
-			item->setBoundingRect();
 			paintRubberBand(item, painter);
-		}
+
+		// the handles resize the selection as a whole
+		QRect rect = m_resizeBox.isNull() ? selectionRect() : resizeHandleRect();
+		painter.save();
+		painter.setPen(Qt::blue);
+		painter.drawRect(rect.translated(m_selectionOffset));
+		painter.restore();
+		paintHandles(rect.translated(m_selectionOffset), painter);
 	}
 	else if (m_selectedItems.size() == 1)
 	{
-		m_selectedItems[0]->setBoundingRect();
-		paintRubberBand(m_selectedItems[0], painter, true);
+		// while resizing, the handles stay at the stroke's distance from the geometry
+		paintRubberBand(m_selectedItems[0], painter, m_resizeBox.isNull());
+		if (!m_resizeBox.isNull())
+			paintHandles(resizeHandleRect(), painter);
 	}
 
 	if ((m_hitTestStatus & HitTestStatus::SelectingItems) && m_selectedBox.isValid())
@@ -144,10 +479,24 @@ void LCanvasView::paintEvent(QPaintEvent *)
 		painter.drawRect(m_selectedBox);
 		painter.restore();
 	}
+	m_stats.endPhase(PaintPhase::SelectionPhase);
+
+	if (m_bStatsVisible)
+	{
+		// pinned to the visible corner when the canvas scrolls
+		m_stats.beginPhase(PaintPhase::OverlayPhase);
+		QRect visibleRect = this->visibleRegion().boundingRect();
+		m_stats.paintOverlay(painter, visibleRect.topLeft() + QPoint(8, 8));
+		m_stats.endPhase(PaintPhase::OverlayPhase);
+	}
+
+	m_stats.endFrame();
 }
 
 void LCanvasView::mousePressEvent(QMouseEvent *event)
 {
+	LCANVAS_TRACE("input", "mousePressEvent");
+	m_stats.markInput();
 	QPoint pos = event->pos();
 	m_startPos = m_lastPos = pos;
 	startMouseAction(pos);
@@ -158,19 +507,18 @@ void LCanvasView::mousePressEvent(QMouseEvent *event)
 		deselectAllItems();
 		m_spItem->setStartPos(pos);
 		m_spItem->setEndPos(pos);
-		m_spItem->updatePath();
 	}
 
 	if (m_hitTestStatus == HitTestStatus::PaintingPath)
-	{
-		m_spItem->movePathTo(pos);
-	}
+		m_spItem->addPoint(pos);
 
 	this->update();
 }
 
 void LCanvasView::mouseMoveEvent(QMouseEvent *event)
 {
+	LCANVAS_TRACE("input", "mouseMoveEvent");
+	m_stats.markInput();
 	QPoint pos = event->pos();
 
 	if (m_hitTestStatus & HitTestStatus::ScalingItem)
@@ -179,10 +527,8 @@ void LCanvasView::mouseMoveEvent(QMouseEvent *event)
 	}
 	else if (m_hitTestStatus & HitTestStatus::MovingItems)
 	{
-		int dx = pos.x() - m_lastPos.x();
-		int dy = pos.y() - m_lastPos.y();
-		foreach (auto &item, m_selectedItems)
-			item->moveItem(dx, dy);
+		// the items themselves move once, when the drag ends
+		m_selectionOffset += pos - m_lastPos;
 	}
 	else if (m_hitTestStatus & HitTestStatus::SelectingItems)
 	{
@@ -200,13 +546,10 @@ void LCanvasView::mouseMoveEvent(QMouseEvent *event)
 	else if (m_hitTestStatus == HitTestStatus::PaintingPath)
 	{
 		m_spItem->addPoint(pos);
-		m_spItem->linePathTo(pos);
-		m_spItem->updatePath();
 	}
 	else if (m_hitTestStatus & HitTestStatus::PaintingItem)
 	{
 		m_spItem->setEndPos(pos);
-		m_spItem->updatePath();
 	}
 	this->update();
 	m_lastPos = pos;
@@ -214,17 +557,32 @@ void LCanvasView::mouseMoveEvent(QMouseEvent *event)
 
 void LCanvasView::mouseReleaseEvent(QMouseEvent *event)
 {
+	LCANVAS_TRACE("input", "mouseReleaseEvent");
+	m_stats.markInput();
 	if (m_hitTestStatus & HitTestStatus::PaintingItem)
 	{
 		deselectAllItems();
 		m_spItem->setSelected(true);
 		m_selectedItems << m_spItem;
+		m_journal.addItems(m_allItems.indexOf(m_spItem), LCanvasItemList() << m_spItem);
+		compactJournal();
 	}
 
 	if (m_hitTestStatus & HitTestStatus::ScalingItem)
 	{
 		m_itemHitPos = ItemHitPos::NonePos;
 		this->setCursor(Qt::ArrowCursor);
+		commitSelectionTransform();
+		m_resizeBox = QRect();
+		m_resizeMargins = QMargins();
+		m_resizeGrab = QPoint();
+	}
+
+	if ((m_hitTestStatus & HitTestStatus::MovingItems) && m_lastPos != m_startPos)
+	{
+		commitSelectionTransform();
+		m_journal.moveItems(selectedIndices(), m_lastPos.x() - m_startPos.x(), m_lastPos.y() - m_startPos.y());
+		compactJournal();
 	}
 
 	m_startPos = m_lastPos = QPoint();
@@ -234,27 +592,130 @@ void LCanvasView::mouseReleaseEvent(QMouseEvent *event)
 	this->update();
 }
 
+// a group with the given children and the style of the one it replaces
+static SPtrLCanvasItem copyGroup(const SPtrLCanvasItem &group, const LCanvasItemList &children)
+{
+	SPtrLCanvasItem copy = LCanvasItem::createItem(ItemType::Group);
+	foreach (auto &child, children)
+		copy->addChild(child);
+	copy->setStyle(group->styleOverrides(), group->fillColor(), group->strokeColor(), group->strokeWidth());
+	copy->updateGeometry();
+	return copy;
+}
+
+// copies of the groups down to the topmost text under pos, with the text
+// taken out; path gets the child index at every level. Text inside symbols
+// is shared by every instance and is not edited this way
+static SPtrLCanvasItem takeGroupText(const SPtrLCanvasItem &group, const QPoint &pos,
+									 SPtrLCanvasItem &text, QVector<int> &path)
+{
+	if (!group->boundingRect().contains(pos))
+		return SPtrLCanvasItem();
+
+	LCanvasItemList children = group->children();
+	for (int i = children.size() - 1; i >= 0; --i)
+	{
+		if (children[i]->getItemType() == ItemType::Text && children[i]->containsPos(pos))
+		{
+			text = children[i];
+			children.removeAt(i);
+		}
+		else if (children[i]->getItemType() == ItemType::Group)
+		{
+			SPtrLCanvasItem child = takeGroupText(children[i], pos, text, path);
+			if (!child)
+				continue;
+			children[i] = child;
+		}
+		else
+		{
+			continue;
+		}
+
+		path.prepend(i);
+		return copyGroup(group, children);
+	}
+
+	return SPtrLCanvasItem();
+}
+
+// copies of the groups along path, with the text put back where it was taken
+static SPtrLCanvasItem putGroupText(const SPtrLCanvasItem &group, const QVector<int> &path, int depth,
+									const SPtrLCanvasItem &text)
+{
+	LCanvasItemList children = group->children();
+	int index = qBound(0, path.at(depth), children.size());
+	if (depth == path.size() - 1)
+		children.insert(index, text);
+	else if (index < children.size())
+		children[index] = putGroupText(children[index], path, depth + 1, text);
+
+	return copyGroup(group, children);
+}
+
 void LCanvasView::mouseDoubleClickEvent(QMouseEvent *event)
 {
+	LCANVAS_TRACE("input", "mouseDoubleClickEvent");
+	m_stats.markInput();
 	deselectAllItems();
 
+	// text in a group is edited out of a copy of the group, which takes the
+	// group's place until the edit puts the text back
 	QPoint pos = event->pos();
-	for (int i = m_textItems.size() - 1; i >= 0; --i)
-	{
-		if (m_textItems[i]->containsPos(pos))
+	SPtrLCanvasItem text = pickItem(pos);
+	if (text && text->getItemType() == ItemType::Group)
+	{
+		SPtrLCanvasItem groupText;
+		QVector<int> path;
+		SPtrLCanvasItem group = takeGroupText(text, pos, groupText, path);
+		int index = m_allItems.indexOf(text);
+		if (group && index >= 0)
 		{
-			m_lineEdit->move(m_textItems[i]->startPos());
-			m_lineEdit->setFont(m_textItems[i]->font());
-			m_lineEdit->setText(m_textItems[i]->text());
-			m_allItems.removeOne(m_textItems[i]);
+			m_journal.removeItems(QVector<int>() << index);
+			m_allItems[index] = group;
+			m_journal.addItems(index, LCanvasItemList() << group);
+			compactJournal();
+			m_textGroup = group;
+			m_textPath = path;
+
+			m_lineEdit->move(groupText->startPos());
+			m_lineEdit->setFont(groupText->font());
+			m_lineEdit->setText(groupText->text());
 			showLineEdit();
-			break;
+			return;
 		}
 	}
+
+	// text covered by other items is still found through the text list
+	if (!text || text->getItemType() != ItemType::Text)
+	{
+		text.clear();
+		for (int i = m_textItems.size() - 1; i >= 0; --i)
+		{
+			if (m_textItems[i]->containsPos(pos))
+			{
+				text = m_textItems[i];
+				break;
+			}
+		}
+	}
+
+	if (text)
+	{
+		m_lineEdit->move(text->startPos());
+		m_lineEdit->setFont(text->font());
+		m_lineEdit->setText(text->text());
+		m_journal.removeItems(QVector<int>() << m_allItems.indexOf(text));
+		m_allItems.removeOne(text);
+		m_bPickSynced = false;
+		showLineEdit();
+	}
 }
 
 void LCanvasView::wheelEvent(QWheelEvent *event)
 {
+	LCANVAS_TRACE("input", "wheelEvent");
+	m_stats.markInput();
 	if (event->modifiers() & Qt::ControlModifier)
 	{
 		int width = this->width();
@@ -284,6 +745,13 @@ void LCanvasView::wheelEvent(QWheelEvent *event)
 	}
 }
 
+// the pick buffer is sized to the view, it is synced again at the new size
+void LCanvasView::resizeEvent(QResizeEvent *event)
+{
+	QWidget::resizeEvent(event);
+	m_bPickSynced = false;
+}
+
 void LCanvasView::contextMenuEvent(QContextMenuEvent *event)
 {
 	if (m_itemType == ItemType::NoneType)
@@ -292,6 +760,7 @@ void LCanvasView::contextMenuEvent(QContextMenuEvent *event)
 
 void LCanvasView::setItemType(ItemType itemType)
 {
+	recordAction(InputAction::ItemTypeAction, int(itemType));
 	m_itemType = itemType;
 	if (itemType == ItemType::NoneType)
 	{
@@ -316,8 +785,28 @@ void LCanvasView::resizeLineEdit()
 
 void LCanvasView::addText()
 {
+	// editingFinished comes again with the focus-out of hiding the line edit,
+	// the edit was committed by the first one
+	if (m_lineEdit->isHidden())
+		return;
+
+	recordAction(InputAction::TextAction, m_lineEdit->text());
+
+	// text taken out of a group for editing goes back into it
+	SPtrLCanvasItem textGroup = m_textGroup;
+	int index = textGroup ? m_allItems.indexOf(textGroup) : -1;
+	m_textGroup.clear();
+
 	if (m_lineEdit->text().isEmpty())
 	{
+		// a group that only held the text goes with it
+		if (index >= 0 && textGroup->children().isEmpty())
+		{
+			m_journal.removeItems(QVector<int>() << index);
+			m_allItems.removeAt(index);
+			compactJournal();
+			this->update();
+		}
 		m_lineEdit->hide();
 		return;
 	}
@@ -326,113 +815,101 @@ void LCanvasView::addText()
 	text->setStartPos(QPoint(m_lineEdit->x(), m_lineEdit->y()));
 	text->setFont(m_lineEdit->font());
 	text->setText(m_lineEdit->text());
-	m_allItems << text;
-	m_textItems << text;
+	if (index >= 0)
+	{
+		SPtrLCanvasItem group = putGroupText(textGroup, m_textPath, 0, text);
+		m_journal.removeItems(QVector<int>() << index);
+		m_allItems[index] = group;
+		m_journal.addItems(index, LCanvasItemList() << group);
+	}
+	else
+	{
+		m_journal.addItems(m_allItems.size(), LCanvasItemList() << text);
+		m_allItems << text;
+		m_textItems << text;
+	}
 	m_lineEdit->clear();
 	m_lineEdit->hide();
+	compactJournal();
 	this->update();
 }
 
 void LCanvasView::readItemsFromFile(const QString &filePath)
 {
-	if (filePath.isEmpty())
-		return;
+	startFileTask(FileTaskMode::LoadTask, filePath);
+}
 
-	QFile file(filePath);
-	file.open(QFile::ReadOnly);
+void LCanvasView::writeItemsToFile(const QString &filePath)
+{
+	startFileTask(FileTaskMode::SaveTask, filePath);
+}
 
-	QXmlStreamReader reader(&file);
+void LCanvasView::updateFileTaskProgress()
+{
+	if (m_fileTaskProgress)
+		emit fileTaskProgress(m_fileTaskProgress->percent());
+}
 
-	while(reader.name().toString() != QLatin1String("svg"))
+void LCanvasView::appendLoadedItems(const LCanvasItemList &items)
+{
+	LCANVAS_TRACE_ARG("file", "appendLoadedItems", items.size());
+	if (m_fileTaskMode != FileTaskMode::LoadTask)
+		return;
+
+	// the preview only feeds painting; the ordered list arrives with finishFileTask
+	if (!m_bLoadingPreview)
 	{
-		reader.readNext();
+		deselectAllItems();
+		m_replacedItems = m_allItems;
+		m_allItems.clear();
+		m_bLoadingPreview = true;
 	}
 
-	if (reader.attributes().value(QString::fromUtf8("subset")).toString() != QLatin1String("lwscode"))
-		return;
+	m_allItems << items;
+	m_bPickSynced = false;
+	this->update();
+}
 
-	while (!reader.atEnd())
+void LCanvasView::finishFileTask(bool success, const LCanvasItemList &items)
+{
+	LCANVAS_TRACE_ARG("file", "finishFileTask", items.size());
+	FileTaskMode mode = m_fileTaskMode;
+	m_fileTaskMode = FileTaskMode::NoneTask;
+	m_fileTaskProgress.clear();
+	m_fileTaskTimer->stop();
+
+	if (mode == FileTaskMode::LoadTask)
 	{
-		if (reader.isEndElement())
+		if (success)
 		{
-			reader.readNext();
-			continue;
+			replaceItems(items);
+			m_journal.setDocumentPath(m_fileTaskPath);
+			m_journal.compact(m_allItems, this->size());
 		}
-
-		if (reader.isStartElement())
+		else if (m_bLoadingPreview)
 		{
-			if (reader.name().toString() == QLatin1String("path"))
-			{
-				readItemFromXml(ItemType::Path, reader);
-			}
-			else if (reader.name().toString() == QLatin1String("line"))
-			{
-				readItemFromXml(ItemType::Line, reader);
-			}
-			else if (reader.name().toString() == QLatin1String("rect"))
-			{
-				readItemFromXml(ItemType::Rect, reader);
-			}
-			else if (reader.name().toString() == QLatin1String("polygon"))
-			{
-				switch (reader.attributes().value(QString::fromUtf8("points")).toString().count(","))
-				{
-				case 3:
-				{
-					readItemFromXml(ItemType::Triangle, reader);
-					break;
-				}
-				case 6:
-				{
-					readItemFromXml(ItemType::Hexagon, reader);
-					break;
-				}
-				default:
-				{
-					break;
-				}
-				}
-			}
-			else if (reader.name().toString() == QLatin1String("ellipse"))
-			{
-				readItemFromXml(ItemType::Ellipse, reader);
-			}
-			else if (reader.name().toString() == QLatin1String("text"))
-			{
-				readItemFromXml(ItemType::Text, reader);
-			}
+			m_allItems = m_replacedItems;
+			m_bPickSynced = false;
 		}
-		reader.readNext();
+
+		m_replacedItems.clear();
+		m_bLoadingPreview = false;
+		this->setEnabled(true);
+		this->update();
+	}
+	else if (mode == FileTaskMode::SaveTask)
+	{
+		m_savingItems.clear();
+		if (success)
+			m_journal.setDocumentPath(m_fileTaskPath);
 	}
 
-	file.close();
+	emit fileTaskFinished(success);
 }
 
-void LCanvasView::writeItemsToFile(const QString &filePath)
+void LCanvasView::reportSharedGeometry(const QString &summary)
 {
-	if (filePath.isEmpty())
-		return;
-
-	QFile file(filePath);
-	file.open(QFile::WriteOnly);
-
-	QXmlStreamWriter writer(&file);
-	writer.setAutoFormatting(true);
-
-	writer.writeStartDocument();
-	writer.writeStartElement(QString::fromUtf8("svg"));
-	writer.writeAttribute(QString::fromUtf8("subset"), QString::fromUtf8("lwscode"));
-	writer.writeAttribute(QString::fromUtf8("width"), QString::number(this->width()));
-	writer.writeAttribute(QString::fromUtf8("height"), QString::number(this->height()));
-	writer.writeAttribute(QString::fromUtf8("xmlns"), QString::fromUtf8("http://www.w3.org/2000/svg"));
-
-	foreach (auto &item, m_allItems)
-		item->writeItemToXml(writer);
-
-	writer.writeEndElement();
-	writer.writeEndDocument();
-
-	file.close();
+	emit geometryShared(summary);
 }
 
 void LCanvasView::cutItem()
@@ -443,9 +920,12 @@ void LCanvasView::cutItem()
 
 void LCanvasView::copyItem()
 {
+	recordAction(InputAction::CopyAction);
 	if (m_selectedItems.isEmpty())
 		return;
 
+	commitSelectionTransform();
+
 	m_duplicatedItems.clear();
 	foreach (auto &item, m_selectedItems)
 	{
@@ -453,33 +933,71 @@ void LCanvasView::copyItem()
 		duplicatedItem->moveItem(8, 8);
 		m_duplicatedItems << duplicatedItem;
 	}
+
+	// other applications get the selection as a compact svg document
+	LCanvasWriter writer;
+	writer.setMinified(true);
+	QByteArray svg = writer.toByteArray(m_selectedItems, this->size());
+
+	QMimeData *mimeData = new QMimeData();
+	mimeData->setData(QString::fromUtf8("image/svg+xml"), svg);
+	mimeData->setText(QString::fromUtf8(svg));
+	QApplication::clipboard()->setMimeData(mimeData);
 }
 
 void LCanvasView::pasteItem()
 {
+	recordAction(InputAction::PasteAction);
 	if (m_duplicatedItems.isEmpty())
 		return;
 
-	m_allItems << m_duplicatedItems;
+	// every paste is a copy of its own, they share geometry until edited
+	LCanvasItemList pastedItems;
+	foreach (auto &item, m_duplicatedItems)
+	{
+		SPtrLCanvasItem pastedItem = item->clone();
+		if (pastedItem->getItemType() == ItemType::Text)
+			m_textItems << pastedItem;
+		pastedItems << pastedItem;
+	}
+
+	m_journal.addItems(m_allItems.size(), pastedItems);
+	m_allItems << pastedItems;
+	compactJournal();
 	deselectAllItems();
-	m_selectedItems << m_duplicatedItems;
+	foreach (auto &item, pastedItems)
+	{
+		item->setSelected(true);
+		m_selectedItems << item;
+	}
 
 	this->update();
 }
 
 void LCanvasView::deleteItem()
 {
+	recordAction(InputAction::DeleteAction);
 	if (m_selectedItems.isEmpty())
 		return;
 
-	foreach (auto &item, m_selectedItems)
+	commitSelectionTransform();
+
+	m_journal.removeItems(selectedIndices());
+	LCanvasItemList items = m_selectedItems;
+	deselectAllItems();
+	foreach (auto &item, items)
+	{
 		m_allItems.removeOne(item);
+		m_textItems.removeOne(item);
+	}
+	compactJournal();
 
 	this->update();
 }
 
 void LCanvasView::moveTopItem()
 {
+	recordAction(InputAction::MoveTopAction);
 	if (m_selectedItems.size() != 1)
 		return;
 
@@ -488,12 +1006,15 @@ void LCanvasView::moveTopItem()
 	if (idx >= 0 && idx < lastIdx)
 	{
 		m_allItems.move(idx, lastIdx);
+		m_journal.reorderItem(idx, lastIdx);
+		compactJournal();
 		this->update();
 	}
 }
 
 void LCanvasView::moveUpItem()
 {
+	recordAction(InputAction::MoveUpAction);
 	if (m_selectedItems.size() != 1)
 		return;
 
@@ -501,12 +1022,15 @@ void LCanvasView::moveUpItem()
 	if (idx >= 0 && idx < m_allItems.size() - 1)
 	{
 		m_allItems.move(idx, idx + 1);
+		m_journal.reorderItem(idx, idx + 1);
+		compactJournal();
 		this->update();
 	}
 }
 
 void LCanvasView::moveDownItem()
 {
+	recordAction(InputAction::MoveDownAction);
 	if (m_selectedItems.size() != 1)
 		return;
 
@@ -514,12 +1038,15 @@ void LCanvasView::moveDownItem()
 	if (idx > 0)
 	{
 		m_allItems.move(idx, idx - 1);
+		m_journal.reorderItem(idx, idx - 1);
+		compactJournal();
 		this->update();
 	}
 }
 
 void LCanvasView::moveBottomItem()
 {
+	recordAction(InputAction::MoveBottomAction);
 	if (m_selectedItems.size() != 1)
 		return;
 
@@ -527,10 +1054,176 @@ void LCanvasView::moveBottomItem()
 	if (idx > 0)
 	{
 		m_allItems.move(idx, 0);
+		m_journal.reorderItem(idx, 0);
+		compactJournal();
 		this->update();
 	}
 }
 
+// the group takes the place of the topmost selected item, its children keep
+// their order
+void LCanvasView::groupItems()
+{
+	recordAction(InputAction::GroupAction);
+	if (m_selectedItems.size() < 2)
+		return;
+
+	commitSelectionTransform();
+
+	// items no longer in the document have nothing to be grouped with
+	QVector<int> indices = selectedIndices();
+	indices.erase(std::remove(indices.begin(), indices.end(), -1), indices.end());
+	if (indices.size() < 2)
+		return;
+	std::sort(indices.begin(), indices.end());
+
+	SPtrLCanvasItem group = LCanvasItem::createItem(ItemType::Group);
+	foreach (int index, indices)
+	{
+		group->addChild(m_allItems[index]);
+		m_textItems.removeOne(m_allItems[index]);
+	}
+
+	int index = indices.last() - (indices.size() - 1);
+	m_journal.removeItems(indices);
+	for (int i = indices.size() - 1; i >= 0; --i)
+		m_allItems.removeAt(indices[i]);
+	m_allItems.insert(index, group);
+	m_journal.addItems(index, LCanvasItemList() << group);
+	compactJournal();
+
+	deselectAllItems();
+	group->setSelected(true);
+	m_selectedItems << group;
+
+	this->update();
+}
+
+// the children of every selected group go back into the document where the
+// group was, taking on the style the group overrides; an instance releases
+// an editable copy of its symbol
+void LCanvasView::ungroupItems()
+{
+	recordAction(InputAction::UngroupAction);
+	if (m_selectedItems.isEmpty())
+		return;
+
+	commitSelectionTransform();
+
+	LCanvasItemList groups = m_selectedItems;
+	deselectAllItems();
+	foreach (auto &group, groups)
+	{
+		LCanvasItemList children = group->children();
+		if (group->getItemType() == ItemType::Instance && group->symbol())
+		{
+			SPtrLCanvasItem master = group->symbol()->master();
+			children.clear();
+			foreach (auto &child, master->children())
+			{
+				SPtrLCanvasItem copy = child->clone();
+				copy->setStyle(master->styleOverrides(), master->fillColor(), master->strokeColor(), master->strokeWidth());
+				copy->transformItem(group->transform());
+				children << copy;
+			}
+		}
+
+		// children a running save still writes are restyled as copies
+		if (m_savingItems.contains(group.data()))
+		{
+			for (int i = 0; i < children.size(); ++i)
+				children[i] = children[i]->clone();
+		}
+
+		foreach (auto &child, children)
+			child->setStyle(group->styleOverrides(), group->fillColor(), group->strokeColor(), group->strokeWidth());
+
+		int index = m_allItems.indexOf(group);
+		if ((group->getItemType() != ItemType::Group && group->getItemType() != ItemType::Instance) || index < 0)
+		{
+			group->setSelected(true);
+			m_selectedItems << group;
+			continue;
+		}
+
+		m_journal.removeItems(QVector<int>() << index);
+		m_allItems.removeAt(index);
+		m_journal.addItems(index, children);
+		foreach (auto &child, children)
+		{
+			m_allItems.insert(index++, child);
+			if (child->getItemType() == ItemType::Text)
+				m_textItems << child;
+			child->setSelected(true);
+			m_selectedItems << child;
+		}
+	}
+	compactJournal();
+
+	this->update();
+}
+
+// the selection becomes the master of a new symbol, placed back as one
+// instance where the topmost selected item was
+void LCanvasView::makeSymbol()
+{
+	recordAction(InputAction::SymbolAction);
+	if (m_selectedItems.isEmpty())
+		return;
+
+	commitSelectionTransform();
+
+	QVector<int> indices = selectedIndices();
+	indices.erase(std::remove(indices.begin(), indices.end(), -1), indices.end());
+	if (indices.isEmpty())
+		return;
+	std::sort(indices.begin(), indices.end());
+
+	QRect rect;
+	foreach (int index, indices)
+		rect = rect.united(m_allItems[index]->boundingRect());
+
+	SPtrLCanvasItem master = LCanvasItem::createItem(ItemType::Group);
+	foreach (int index, indices)
+	{
+		SPtrLCanvasItem copy = m_allItems[index]->clone();
+		copy->moveItem(-rect.x(), -rect.y());
+		master->addChild(copy);
+		m_textItems.removeOne(m_allItems[index]);
+	}
+	master->updateGeometry();
+
+	QSet<QString> ids;
+	foreach (auto &symbol, LCanvasSymbol::collect(m_allItems + m_duplicatedItems))
+		ids.insert(symbol->id());
+	// numbers are not handed out twice in a session, even once their symbol
+	// is deleted, the journal still holds instances of it
+	int number = qMax(ids.size(), m_nSymbolNumber) + 1;
+	while (ids.contains(QString::fromUtf8("symbol%1").arg(number)))
+		++number;
+	m_nSymbolNumber = number;
+
+	SPtrLCanvasSymbol symbol(new LCanvasSymbol(QString::fromUtf8("symbol%1").arg(number), master));
+	LCanvasInstance *instance = new LCanvasInstance(symbol);
+	instance->setTransform(QTransform::fromTranslate(rect.x(), rect.y()));
+	SPtrLCanvasItem item(instance);
+	item->updateGeometry();
+
+	int index = indices.last() - (indices.size() - 1);
+	m_journal.removeItems(indices);
+	for (int i = indices.size() - 1; i >= 0; --i)
+		m_allItems.removeAt(indices[i]);
+	m_allItems.insert(index, item);
+	m_journal.addItems(index, LCanvasItemList() << item);
+	compactJournal();
+
+	deselectAllItems();
+	item->setSelected(true);
+	m_selectedItems << item;
+
+	this->update();
+}
+
 ItemHitPos LCanvasView::getItemHitPos(const QPoint &point)
 {
 	if (m_topLeftPos.contains(point))
@@ -615,6 +1308,14 @@ void LCanvasView::initRightClickMenu()
 
 	QAction *moveBottomAction = new QAction(tr("Move Bottom"), m_rightClickMenu);
 
+	QAction *groupAction = new QAction(tr("Group"), m_rightClickMenu);
+	groupAction->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_G));
+
+	QAction *ungroupAction = new QAction(tr("Ungroup"), m_rightClickMenu);
+	ungroupAction->setShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_G));
+
+	QAction *symbolAction = new QAction(tr("Make Symbol"), m_rightClickMenu);
+
 	m_rightClickMenu->addAction(cutAction);
 	m_rightClickMenu->addAction(copyAction);
 	m_rightClickMenu->addAction(pasteAction);
@@ -625,6 +1326,10 @@ void LCanvasView::initRightClickMenu()
 	m_rightClickMenu->addAction(moveUpAction);
 	m_rightClickMenu->addAction(moveDownAction);
 	m_rightClickMenu->addAction(moveBottomAction);
+	m_rightClickMenu->addSeparator();
+	m_rightClickMenu->addAction(groupAction);
+	m_rightClickMenu->addAction(ungroupAction);
+	m_rightClickMenu->addAction(symbolAction);
 
 	connect(cutAction, SIGNAL(triggered()), this, SLOT(cutItem()));
 	connect(copyAction, SIGNAL(triggered()), this, SLOT(copyItem()));
@@ -634,6 +1339,9 @@ void LCanvasView::initRightClickMenu()
 	connect(moveUpAction, SIGNAL(triggered()), this, SLOT(moveUpItem()));
 	connect(moveDownAction, SIGNAL(triggered()), this, SLOT(moveDownItem()));
 	connect(moveBottomAction, SIGNAL(triggered()), this, SLOT(moveBottomItem()));
+	connect(groupAction, SIGNAL(triggered()), this, SLOT(groupItems()));
+	connect(ungroupAction, SIGNAL(triggered()), this, SLOT(ungroupItems()));
+	connect(symbolAction, SIGNAL(triggered()), this, SLOT(makeSymbol()));
 }
 
 void LCanvasView::setCursorByPos(const QPoint &pos)
@@ -677,46 +1385,59 @@ void LCanvasView::deselectAllItems()
 	if (m_selectedItems.isEmpty())
 		return;
 
+	commitSelectionTransform();
+
 	foreach (auto &item, m_selectedItems)
 		item->setSelected(false);
 
+	// the handles of the old selection are gone with it
+	m_topLeftPos = m_topMiddlePos = m_topRightPos = m_middleRightPos = QRect();
+	m_bottomRightPos = m_bottomMiddlePos = m_bottomLeftPos = m_middleLeftPos = QRect();
+
 	m_selectedItems.clear();
 }
 
 void LCanvasView::paintRubberBand(SPtrLCanvasItem item, QPainter &painter, bool flag)
 {
 	QRect rubberBand = item->boundingRect();
+	if (item->isSelected())
+		rubberBand = selectionTransform(item).mapRect(rubberBand);
 
 	painter.save();
 	painter.setPen(Qt::blue);
 	painter.drawRect(rubberBand);
+	painter.restore();
 
 	if (flag)
-	{
-		int left = rubberBand.left();
-		int top = rubberBand.top();
-		int width = rubberBand.width();
-		int height = rubberBand.height();
-		m_topLeftPos = QRect(left - 4, top - 4, 8, 8);
-		m_topMiddlePos = QRect(left + width / 2, top - 4, 8, 8);
-		m_topRightPos = QRect(left + width - 4, top - 4, 8, 8);
-		m_middleRightPos = QRect(left + width - 4, top + height / 2, 8, 8);
-		m_bottomRightPos = QRect(left + width - 4, top + height - 4, 8, 8);
-		m_bottomMiddlePos = QRect(left + width / 2, top + height - 4, 8, 8);
-		m_bottomLeftPos = QRect(left - 4, top + height - 4, 8, 8);
-		m_middleLeftPos = QRect(left - 4, top + height / 2, 8, 8);
-
-		painter.setBrush(Qt::blue);
-		painter.drawRect(m_topLeftPos);
-		painter.drawRect(m_topMiddlePos);
-		painter.drawRect(m_topRightPos);
-		painter.drawRect(m_middleRightPos);
-		painter.drawRect(m_bottomRightPos);
-		painter.drawRect(m_bottomMiddlePos);
-		painter.drawRect(m_bottomLeftPos);
-		painter.drawRect(m_middleLeftPos);
-	}
+		paintHandles(rubberBand, painter);
+}
+
+void LCanvasView::paintHandles(const QRect &rect, QPainter &painter)
+{
+	int left = rect.left();
+	int top = rect.top();
+	int width = rect.width();
+	int height = rect.height();
+	m_topLeftPos = QRect(left - 4, top - 4, 8, 8);
+	m_topMiddlePos = QRect(left + width / 2, top - 4, 8, 8);
+	m_topRightPos = QRect(left + width - 4, top - 4, 8, 8);
+	m_middleRightPos = QRect(left + width - 4, top + height / 2, 8, 8);
+	m_bottomRightPos = QRect(left + width - 4, top + height - 4, 8, 8);
+	m_bottomMiddlePos = QRect(left + width / 2, top + height - 4, 8, 8);
+	m_bottomLeftPos = QRect(left - 4, top + height - 4, 8, 8);
+	m_middleLeftPos = QRect(left - 4, top + height / 2, 8, 8);
 
+	painter.save();
+	painter.setPen(Qt::blue);
+	painter.setBrush(Qt::blue);
+	painter.drawRect(m_topLeftPos);
+	painter.drawRect(m_topMiddlePos);
+	painter.drawRect(m_topRightPos);
+	painter.drawRect(m_middleRightPos);
+	painter.drawRect(m_bottomRightPos);
+	painter.drawRect(m_bottomMiddlePos);
+	painter.drawRect(m_bottomLeftPos);
+	painter.drawRect(m_middleLeftPos);
 	painter.restore();
 }
 
@@ -796,27 +1517,61 @@ void LCanvasView::startMouseAction(const QPoint &pos)
 	}
 }
 
+static StretchItemDir stretchDir(ItemHitPos hitPos)
+{
+	switch (hitPos)
+	{
+	case ItemHitPos::TopLeft: { return StretchItemDir::ToTopLeft; }
+	case ItemHitPos::TopMiddle: { return StretchItemDir::ToTopMiddle; }
+	case ItemHitPos::TopRight: { return StretchItemDir::ToTopRight; }
+	case ItemHitPos::MiddleRight: { return StretchItemDir::ToMiddleRight; }
+	case ItemHitPos::BottomRight: { return StretchItemDir::ToBottomRight; }
+	case ItemHitPos::BottomMiddle: { return StretchItemDir::ToBottomMiddle; }
+	case ItemHitPos::BottomLeft: { return StretchItemDir::ToBottomLeft; }
+	case ItemHitPos::MiddleLeft: { return StretchItemDir::ToMiddleLeft; }
+	default: { return StretchItemDir::NoneDir; }
+	}
+}
+
 void LCanvasView::hitTest(const QPoint &pos)
 {
+	LCANVAS_TRACE_ARG("input", "hitTest", m_allItems.size());
 	m_itemHitPos = getItemHitPos(pos);
-	if (m_itemHitPos != ItemHitPos::NonePos)
+	if (m_itemHitPos != ItemHitPos::NonePos && !m_selectedItems.isEmpty())
 	{
 		m_hitTestStatus = HitTestStatus::ScalingItem;
+		commitSelectionTransform();
+
+		// the geometry is scaled, not the padded bounds the handles sit on; the
+		// handle keeps its distance from the edge it drags
+		QRect handleRect = selectionRect();
+		m_resizeBox = selectionGeometryRect();
+		m_resizeMargins = QMargins(m_resizeBox.left() - handleRect.left(), m_resizeBox.top() - handleRect.top(),
+								   handleRect.right() - m_resizeBox.right(), handleRect.bottom() - m_resizeBox.bottom());
+
+		StretchItemDir dir = stretchDir(m_itemHitPos);
+		QPoint edge = pos;
+		if (dir & StretchItemDir::ToLeft)
+			edge.rx() = m_resizeBox.x();
+		else if (dir & StretchItemDir::ToRight)
+			edge.rx() = m_resizeBox.x() + m_resizeBox.width();
+		if (dir & StretchItemDir::ToTop)
+			edge.ry() = m_resizeBox.y();
+		else if (dir & StretchItemDir::ToBottom)
+			edge.ry() = m_resizeBox.y() + m_resizeBox.height();
+		m_resizeGrab = pos - edge;
 	}
 	else
 	{
-		for (int i = m_allItems.size() - 1; i >= 0; --i)
+		SPtrLCanvasItem item = pickItem(pos);
+		if (item)
 		{
-			if (m_allItems[i]->containsPos(pos))
+			m_hitTestStatus = HitTestStatus::MovingItems;
+			if (!item->isSelected())
 			{
-				m_hitTestStatus = HitTestStatus::MovingItems;
-				if (m_allItems[i]->isSelected())
-					break;
-
 				deselectAllItems();
-				m_allItems[i]->setSelected(true);
-				m_selectedItems << m_allItems[i];
-				break;
+				item->setSelected(true);
+				m_selectedItems << item;
 			}
 		}
 
@@ -828,203 +1583,226 @@ void LCanvasView::hitTest(const QPoint &pos)
 	}
 }
 
-void LCanvasView::resizeSelectedItem(const QPoint &pos)
+// the topmost item under pos; the pick buffer answers with one pixel read,
+// items are only tested one by one while a drag is still pending
+SPtrLCanvasItem LCanvasView::pickItem(const QPoint &pos)
 {
-	if (m_selectedItems.size() != 1)
-		return;
-
-	switch (m_itemHitPos)
-	{
-	case ItemHitPos::TopLeft:
-	{
-		m_selectedItems[0]->setStartPos(pos);
-		m_selectedItems[0]->updatePath();
-		break;
-	}
-	case ItemHitPos::TopMiddle:
-	{
-		int height = pos.y() - m_lastPos.y();
-		m_selectedItems[0]->moveStartPos(0, height);
-		m_selectedItems[0]->updatePath();
-		break;
-	}
-	case ItemHitPos::TopRight:
-	{
-		int width = pos.x() - m_lastPos.x();
-		int height = pos.y() - m_lastPos.y();
-		m_selectedItems[0]->moveStartPos(0, height);
-		m_selectedItems[0]->moveEndPos(width, 0);
-		m_selectedItems[0]->updatePath();
-		break;
-	}
-	case ItemHitPos::MiddleRight:
+	bool pending = !m_selectionOffset.isNull() || !m_selectionTransform.isIdentity();
+	if (!pending)
 	{
-		int width = pos.x() - m_lastPos.x();
-		m_selectedItems[0]->moveEndPos(width, 0);
-		m_selectedItems[0]->updatePath();
-		break;
-	}
-	case ItemHitPos::BottomRight:
-	{
-		m_selectedItems[0]->setEndPos(pos);
-		m_selectedItems[0]->updatePath();
-		break;
+		if (!m_bPickSynced)
+		{
+			m_pickBuffer.sync(m_allItems, this->size());
+			m_bPickSynced = true;
+		}
+		// a drag can run past the view, where the buffer has no pixels
+		if (m_pickBuffer.isValid() && this->rect().contains(pos))
+			return m_pickBuffer.pick(m_allItems, pos);
 	}
-	case ItemHitPos::BottomMiddle:
+
+	for (int i = m_allItems.size() - 1; i >= 0; --i)
 	{
-		int height = pos.y() - m_lastPos.y();
-		m_selectedItems[0]->moveEndPos(0, height);
-		m_selectedItems[0]->updatePath();
-		break;
+		QPoint itemPos = pos;
+		if (m_allItems[i]->isSelected())
+			itemPos = selectionTransform(m_allItems[i]).inverted().map(pos);
+		if (m_allItems[i]->containsPos(itemPos))
+			return m_allItems[i];
 	}
-	case ItemHitPos::BottomLeft:
+
+	return SPtrLCanvasItem();
+}
+
+QRect LCanvasView::selectionRect()
+{
+	QRect rect;
+	foreach (auto &item, m_selectedItems)
+		rect |= item->boundingRect();
+	return rect;
+}
+
+QRect LCanvasView::selectionGeometryRect()
+{
+	QRect rect;
+	foreach (auto &item, m_selectedItems)
+		rect |= item->geometryRect();
+	return rect;
+}
+
+// the geometry box as the pending resize has it, padded as it was when the
+// resize started
+QRect LCanvasView::resizeHandleRect()
+{
+	return m_selectionTransform.mapRect(m_resizeBox).marginsAdded(m_resizeMargins);
+}
+
+// where a selected item is drawn while a drag is pending; text is not
+// scaled, it only follows its anchor
+QTransform LCanvasView::selectionTransform(const SPtrLCanvasItem &item)
+{
+	QTransform transform = m_selectionTransform;
+	if (!transform.isIdentity() && item->getItemType() == ItemType::Text)
 	{
-		int width = pos.x() - m_lastPos.x();
-		int height = pos.y() - m_lastPos.y();
-		m_selectedItems[0]->moveStartPos(width, 0);
-		m_selectedItems[0]->moveEndPos(0, height);
-		m_selectedItems[0]->updatePath();
-		break;
+		QPoint startPos = item->startPos();
+		QPoint mappedPos = transform.map(startPos);
+		transform = QTransform::fromTranslate(mappedPos.x() - startPos.x(), mappedPos.y() - startPos.y());
 	}
-	case ItemHitPos::MiddleLeft:
+
+	return transform * QTransform::fromTranslate(m_selectionOffset.x(), m_selectionOffset.y());
+}
+
+void LCanvasView::commitSelectionTransform()
+{
+	if (!m_selectionTransform.isIdentity())
 	{
-		int width = pos.x() - m_lastPos.x();
-		m_selectedItems[0]->moveStartPos(width, 0);
-		m_selectedItems[0]->updatePath();
-		break;
+		LCANVAS_TRACE_ARG("input", "commitSelectionTransform", m_selectedItems.size());
+		for (int i = 0; i < m_selectedItems.size(); ++i)
+			detachSelectedItem(i)->transformItem(m_selectionTransform);
+		m_journal.transformItems(selectedIndices(), m_selectionTransform);
+		compactJournal();
+
+		if (!m_resizeBox.isNull())
+			m_resizeBox = m_selectionTransform.mapRect(m_resizeBox);
+		m_selectionTransform = QTransform();
 	}
-	default:
+
+	if (!m_selectionOffset.isNull())
 	{
-		break;
-	}
+		LCANVAS_TRACE_ARG("input", "commitSelectionOffset", m_selectedItems.size());
+		for (int i = 0; i < m_selectedItems.size(); ++i)
+			detachSelectedItem(i)->moveItem(m_selectionOffset.x(), m_selectionOffset.y());
+		m_selectionOffset = QPoint();
+		m_bPickSynced = false;
 	}
 }
 
-void LCanvasView::readItemFromXml(ItemType itemType, QXmlStreamReader &reader)
+// the whole selection scales around the edges opposite the handle; items
+// only take the transform when the drag ends
+void LCanvasView::resizeSelectedItem(const QPoint &pos)
 {
-	switch (itemType)
-	{
-	case ItemType::Path:
-	{
-		m_spItem = SPtrLCanvasItem(new LCanvasPath());
-		m_spItem->setStrokeColor(QColor(reader.attributes().value(QString::fromUtf8("stroke")).toString()));
-		m_spItem->setStrokeWidth(reader.attributes().value(QString::fromUtf8("stroke-width")).toInt());
+	if (m_selectedItems.isEmpty() || m_resizeBox.isNull())
+		return;
 
-		QString path = reader.attributes().value(QString::fromUtf8("d")).toString();
-		QStringList points = path.split(QRegularExpression(QString::fromUtf8("\\D+")), Qt::SkipEmptyParts);
-		int size = points.size();
-		m_spItem->setStartPos(QPoint(points[0].toInt(), points[1].toInt()));
-		m_spItem->setEndPos(QPoint(points[size - 2].toInt(), points[size - 1].toInt()));
-		m_spItem->updatePath();
+	m_selectionTransform = LCanvasItem::stretchTransform(m_resizeBox, stretchDir(m_itemHitPos), pos - m_resizeGrab);
+}
 
-		for (int i = 0; i < points.size() - 1; i += 2)
-			m_spItem->addPoint(QPoint(points[i].toInt(), points[i + 1].toInt()));
+// fills in everything items compute on first use, children included
+static void prepareSharedItem(const SPtrLCanvasItem &item)
+{
+	item->contentHash();
+	item->updateGeometry(DerivedGeometry::AllGeometry);
+	foreach (auto &child, item->children())
+		prepareSharedItem(child);
+}
 
-		m_allItems << m_spItem;
-		break;
-	}
-	case ItemType::Line:
-	{
-		m_spItem = SPtrLCanvasItem(new LCanvasLine());
-		m_spItem->setStrokeColor(QColor(reader.attributes().value(QString::fromUtf8("stroke")).toString()));
-		m_spItem->setStrokeWidth(reader.attributes().value(QString::fromUtf8("stroke-width")).toInt());
+void LCanvasView::startFileTask(FileTaskMode mode, const QString &filePath)
+{
+	LCANVAS_TRACE("file", "startFileTask");
+	if (filePath.isEmpty() || isFileTaskRunning())
+		return;
 
-		m_spItem->setStartPos(QPoint(reader.attributes().value(QString::fromUtf8("x1")).toInt(),
-								   reader.attributes().value(QString::fromUtf8("y1")).toInt()));
-		m_spItem->setEndPos(QPoint(reader.attributes().value(QString::fromUtf8("x2")).toInt(),
-								 reader.attributes().value(QString::fromUtf8("y2")).toInt()));
-		m_spItem->updatePath();
+	commitSelectionTransform();
 
-		m_allItems << m_spItem;
-		break;
-	}
-	case ItemType::Rect:
+	m_fileTaskMode = mode;
+	m_fileTaskPath = filePath;
+	m_fileTaskProgress = QSharedPointer<LCanvasProgress>(new LCanvasProgress());
+	LCanvasFileTask *task = new LCanvasFileTask(mode, filePath, m_fileTaskProgress, this);
+
+	if (mode == FileTaskMode::LoadTask)
 	{
-		m_spItem = SPtrLCanvasItem(new LCanvasRect());
-		m_spItem->setFillColor(QColor(reader.attributes().value(QString::fromUtf8("fill")).toString()));
-		m_spItem->setStrokeColor(QColor(reader.attributes().value(QString::fromUtf8("stroke")).toString()));
-		m_spItem->setStrokeWidth(reader.attributes().value(QString::fromUtf8("stroke-width")).toInt());
-
-		int x = reader.attributes().value(QString::fromUtf8("x")).toInt();
-		int y = reader.attributes().value(QString::fromUtf8("y")).toInt();
-		int width = reader.attributes().value(QString::fromUtf8("width")).toInt();
-		int height = reader.attributes().value(QString::fromUtf8("height")).toInt();
-		m_spItem->setStartPos(QPoint(x, y));
-		m_spItem->setEndPos(QPoint(x + width, y + height));
-		m_spItem->updatePath();
+		// the loaded model replaces the current one, so edits made meanwhile would be lost
+		m_lineEdit->hide();
+		this->setEnabled(false);
 
-		m_allItems << m_spItem;
-		break;
+		QRect visibleRect = this->visibleRegion().boundingRect();
+		if (visibleRect.isEmpty())
+			visibleRect = this->rect();
+		task->setPriorityRect(QTransform::fromScale(1.0 / m_fScaleFactor, 1.0 / m_fScaleFactor).mapRect(visibleRect));
+		task->setShareGeometry(m_bShareGeometry);
 	}
-	case ItemType::Ellipse:
+	else
 	{
-		m_spItem = SPtrLCanvasItem(new LCanvasEllipse());
-		m_spItem->setFillColor(QColor(reader.attributes().value(QString::fromUtf8("fill")).toString()));
-		m_spItem->setStrokeColor(QColor(reader.attributes().value(QString::fromUtf8("stroke")).toString()));
-		m_spItem->setStrokeWidth(reader.attributes().value(QString::fromUtf8("stroke-width")).toInt());
-
-		int cx = reader.attributes().value(QString::fromUtf8("cx")).toInt();
-		int cy = reader.attributes().value(QString::fromUtf8("cy")).toInt();
-		int rx = reader.attributes().value(QString::fromUtf8("rx")).toInt();
-		int ry = reader.attributes().value(QString::fromUtf8("ry")).toInt();
-		m_spItem->setStartPos(QPoint(cx - rx, cy - ry));
-		m_spItem->setEndPos(QPoint(cx + rx, cy + cy));
-		m_spItem->updatePath();
+		// the writer shares the items with the view, which copies an item before
+		// editing it while the save runs; hashes and derived geometry are taken
+		// here first, so neither side fills them in under the other
+		m_savingItems.clear();
+		m_savingItems.reserve(m_allItems.size());
+		foreach (auto &item, m_allItems)
+		{
+			prepareSharedItem(item);
+			m_savingItems.insert(item.data());
+		}
 
-		m_allItems << m_spItem;
-		break;
+		task->setItems(m_allItems);
+		task->setCanvasSize(this->size());
 	}
-	case ItemType::Triangle:
-	{
-		m_spItem = SPtrLCanvasItem(new LCanvasTriangle());
-		m_spItem->setFillColor(QColor(reader.attributes().value(QString::fromUtf8("fill")).toString()));
-		m_spItem->setStrokeColor(QColor(reader.attributes().value(QString::fromUtf8("stroke")).toString()));
-		m_spItem->setStrokeWidth(reader.attributes().value(QString::fromUtf8("stroke-width")).toInt());
 
-		QString polygon = reader.attributes().value(QString::fromUtf8("points")).toString();
-		QStringList points = polygon.split(QRegularExpression(QString::fromUtf8("\\D+")), Qt::SkipEmptyParts);
-		m_spItem->setStartPos(QPoint(points[4].toInt(), points[1].toInt()));
-		m_spItem->setEndPos(QPoint(points[2].toInt(), points[3].toInt()));
-		m_spItem->updatePath();
+	emit fileTaskStarted(filePath);
+	m_fileTaskTimer->start();
+	m_fileTaskPool.start(task);
+}
 
-		m_allItems << m_spItem;
-		break;
-	}
-	case ItemType::Hexagon:
+void LCanvasView::replaceItems(const LCanvasItemList &items)
+{
+	deselectAllItems();
+	m_spItem.clear();
+	m_allItems = items;
+	m_textItems.clear();
+	m_duplicatedItems.clear();
+	m_textGroup.clear();
+	m_pickBuffer.reset();
+	m_bPickSynced = false;
+
+	foreach (auto &item, m_allItems)
 	{
-		m_spItem = SPtrLCanvasItem(new LCanvasHexagon());
-		m_spItem->setFillColor(QColor(reader.attributes().value(QString::fromUtf8("fill")).toString()));
-		m_spItem->setStrokeColor(QColor(reader.attributes().value(QString::fromUtf8("stroke")).toString()));
-		m_spItem->setStrokeWidth(reader.attributes().value(QString::fromUtf8("stroke-width")).toInt());
+		if (item->getItemType() == ItemType::Text)
+			m_textItems << item;
+	}
 
-		QString polygon = reader.attributes().value(QString::fromUtf8("points")).toString();
-		QStringList points = polygon.split(QRegularExpression(QString::fromUtf8("\\D+")), Qt::SkipEmptyParts);
-		m_spItem->setStartPos(QPoint(points[10].toInt(), points[1].toInt()));
-		m_spItem->setEndPos(QPoint(points[4].toInt(), points[7].toInt()));
-		m_spItem->updatePath();
+	this->update();
+}
 
-		m_allItems << m_spItem;
-		break;
-	}
-	case ItemType::Text:
-	{
-		m_spItem = SPtrLCanvasItem(new LCanvasText());
-		m_spItem->setFillColor(QColor(reader.attributes().value(QString::fromUtf8("fill")).toString()));
+// the selected item at index, replaced by a copy of its own first when a
+// running save shares it
+SPtrLCanvasItem LCanvasView::detachSelectedItem(int index)
+{
+	SPtrLCanvasItem item = m_selectedItems.at(index);
+	if (!m_savingItems.remove(item.data()))
+		return item;
+
+	SPtrLCanvasItem copy = item->clone();
+	m_selectedItems[index] = copy;
+	int allIndex = m_allItems.indexOf(item);
+	if (allIndex >= 0)
+		m_allItems[allIndex] = copy;
+	int textIndex = m_textItems.indexOf(item);
+	if (textIndex >= 0)
+		m_textItems[textIndex] = copy;
+	m_bPickSynced = false;
+	return copy;
+}
 
-		m_spItem->setStartPos(QPoint(reader.attributes().value(QString::fromUtf8("x")).toInt(),
-								   reader.attributes().value(QString::fromUtf8("y")).toInt()));
-		m_spItem->setText(reader.readElementText());
-		m_spItem->updatePath();
+QVector<int> LCanvasView::selectedIndices() const
+{
+	QVector<int> indices;
+	indices.reserve(m_selectedItems.size());
+	foreach (auto &item, m_selectedItems)
+		indices << m_allItems.indexOf(item);
 
-		m_allItems << m_spItem;
-		m_textItems << m_spItem;
-		break;
-	}
-	default:
-	{
-		break;
-	}
-	}
+	return indices;
+}
+
+void LCanvasView::recordAction(InputAction action, const QVariant &value)
+{
+	if (m_recorder)
+		m_recorder->recordAction(action, value);
+}
+
+// every journaled edit ends here, so the pick buffer resyncs on the next pick
+void LCanvasView::compactJournal()
+{
+	m_bPickSynced = false;
+	if (m_journal.needsCompaction())
+		m_journal.compact(m_allItems, this->size());
 }
 
 } // namespace
@@ -0,0 +1,660 @@
+#include "lcanvaswriter.h"
+#include "lcanvasgzip.h"
+#include "lcanvastrace.h"
+
+#include <limits>
+
+namespace lwscode {
+
+// the buffer is handed to the device whenever it grows past one block
+static const int WriteBlockSize = 1 << 20;
+static const char HexDigits[] = "0123456789abcdef";
+
+static const char IndexMagic[4] = { 'L', 'W', 'S', 'I' };
+static const quint32 IndexVersion = 2;
+
+struct LIndexHeader
+{
+	char magic[4];
+	quint32 version;
+	qint64 fileSize;
+	qint64 lastModified;
+	quint32 minified;
+	quint32 pathQuantum;
+	quint32 blockCount;
+	quint32 reserved;
+};
+
+LSvgStreamWriter::LSvgStreamWriter(QIODevice *device)
+	: m_device(device)
+	, m_nWritten(0)
+	, m_bMinified(false)
+	, m_nPathQuantum(0)
+	, m_bStartTagOpen(false)
+	, m_bError(false)
+{
+	m_buffer.reserve(WriteBlockSize + WriteBlockSize / 4);
+}
+
+void LSvgStreamWriter::setMinified(bool minified)
+{
+	m_bMinified = minified;
+}
+
+bool LSvgStreamWriter::isMinified() const
+{
+	return m_bMinified;
+}
+
+// 0 keeps absolute M/L path data, otherwise path data is written in compact
+// relative form snapped to multiples of the quantum
+void LSvgStreamWriter::setPathQuantum(int quantum)
+{
+	m_nPathQuantum = qMax(0, quantum);
+}
+
+int LSvgStreamWriter::pathQuantum() const
+{
+	return m_nPathQuantum;
+}
+
+bool LSvgStreamWriter::hasError() const
+{
+	return m_bError;
+}
+
+qint64 LSvgStreamWriter::position() const
+{
+	return m_nWritten + m_buffer.size();
+}
+
+void LSvgStreamWriter::writeStartDocument()
+{
+	static const char prolog[] = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>";
+	m_buffer.append(prolog, sizeof(prolog) - 1);
+}
+
+void LSvgStreamWriter::writeEndDocument()
+{
+	while (!m_elements.isEmpty())
+		writeEndElement();
+
+	if (!m_bMinified)
+		m_buffer.append('\n');
+
+	flushBlock();
+}
+
+void LSvgStreamWriter::writeStartElement(const char *name)
+{
+	closeStartTag();
+	if (!m_elements.isEmpty())
+		m_elements.last().hasChildren = true;
+
+	// elements are only ever started between items, a cheap point to hand off a block
+	if (m_buffer.size() >= WriteBlockSize)
+		flushBlock();
+
+	appendIndent();
+	m_buffer.append('<');
+	m_buffer.append(name);
+
+	Element element = { name, false };
+	m_elements.append(element);
+	m_bStartTagOpen = true;
+}
+
+void LSvgStreamWriter::writeEndElement()
+{
+	if (m_elements.isEmpty())
+		return;
+
+	Element element = m_elements.takeLast();
+	if (m_bStartTagOpen)
+	{
+		m_buffer.append("/>", 2);
+		m_bStartTagOpen = false;
+		return;
+	}
+
+	if (element.hasChildren)
+		appendIndent();
+	m_buffer.append("</", 2);
+	m_buffer.append(element.name);
+	m_buffer.append('>');
+}
+
+void LSvgStreamWriter::writeCharacters(const QString &text)
+{
+	closeStartTag();
+	appendEscaped(text);
+}
+
+// closes the parent's start tag and returns where the next child's markup begins
+qint64 LSvgStreamWriter::beginBlock()
+{
+	closeStartTag();
+	if (!m_elements.isEmpty())
+		m_elements.last().hasChildren = true;
+
+	return position();
+}
+
+void LSvgStreamWriter::writeRaw(const char *data, qint64 size)
+{
+	if (size <= 0)
+		return;
+
+	if (size < WriteBlockSize)
+	{
+		m_buffer.append(data, int(size));
+		if (m_buffer.size() >= WriteBlockSize)
+			flushBlock();
+		return;
+	}
+
+	flushBlock();
+	if (!m_bError && m_device->write(data, size) != size)
+		m_bError = true;
+	m_nWritten += size;
+}
+
+int LSvgStreamWriter::formatNumber(char *out, int value)
+{
+	char digits[12];
+	int count = 0;
+	unsigned int magnitude = value < 0 ? 0u - unsigned(value) : unsigned(value);
+	do
+	{
+		digits[count++] = char('0' + magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude);
+
+	int size = 0;
+	if (value < 0)
+		out[size++] = '-';
+	while (count)
+		out[size++] = digits[--count];
+
+	return size;
+}
+
+void LSvgStreamWriter::appendNumber(int value)
+{
+	char text[12];
+	m_buffer.append(text, formatNumber(text, value));
+}
+
+void LSvgStreamWriter::appendColor(const QColor &color)
+{
+	QRgb rgb = color.rgb();
+	char text[7] = {
+		'#',
+		HexDigits[(rgb >> 20) & 0xf], HexDigits[(rgb >> 16) & 0xf],
+		HexDigits[(rgb >> 12) & 0xf], HexDigits[(rgb >> 8) & 0xf],
+		HexDigits[(rgb >> 4) & 0xf], HexDigits[rgb & 0xf]
+	};
+	m_buffer.append(text, sizeof(text));
+}
+
+// svg matrix(a b c d e f) takes Qt's m11 m12 m21 m22 dx dy in that order
+void LSvgStreamWriter::appendTransform(const QTransform &transform)
+{
+	qreal values[6] = { transform.m11(), transform.m12(), transform.m21(), transform.m22(), transform.dx(), transform.dy() };
+	m_buffer.append("matrix(", 7);
+	for (int i = 0; i < 6; ++i)
+	{
+		if (i)
+			m_buffer.append(' ');
+		m_buffer.append(QByteArray::number(values[i], 'g', 10));
+	}
+	m_buffer.append(')');
+}
+
+void LSvgStreamWriter::appendEscaped(const QString &text)
+{
+	QByteArray utf8 = text.toUtf8();
+	const char *pos = utf8.constData();
+	const char *end = pos + utf8.size();
+	const char *run = pos;
+	for (; pos < end; ++pos)
+	{
+		const char *entity = nullptr;
+		switch (*pos)
+		{
+		case '&': entity = "&amp;"; break;
+		case '<': entity = "&lt;"; break;
+		case '>': entity = "&gt;"; break;
+		case '"': entity = "&quot;"; break;
+		default: continue;
+		}
+
+		m_buffer.append(run, int(pos - run));
+		m_buffer.append(entity);
+		run = pos + 1;
+	}
+	m_buffer.append(run, int(end - run));
+}
+
+void LSvgStreamWriter::appendPath(const QPoints &points)
+{
+	if (m_nPathQuantum > 0)
+	{
+		appendCompactPath(points);
+		return;
+	}
+
+	// sized for the worst case so the loop below never reallocates
+	char *out = nullptr;
+	int base = m_buffer.size();
+	m_buffer.resize(base + points.size() * 26);
+	out = m_buffer.data() + base;
+
+	char *pos = out;
+	for (int i = 0; i < points.size(); ++i)
+	{
+		if (i)
+			*pos++ = ' ';
+		*pos++ = i ? 'L' : 'M';
+		pos += formatNumber(pos, points[i].x());
+		*pos++ = ' ';
+		pos += formatNumber(pos, points[i].y());
+	}
+	m_buffer.resize(base + int(pos - out));
+}
+
+void LSvgStreamWriter::appendPoints(const QPoints &points)
+{
+	int base = m_buffer.size();
+	m_buffer.resize(base + points.size() * 25);
+	char *out = m_buffer.data() + base;
+
+	char *pos = out;
+	for (int i = 0; i < points.size(); ++i)
+	{
+		if (i)
+			*pos++ = ' ';
+		pos += formatNumber(pos, points[i].x());
+		*pos++ = ',';
+		pos += formatNumber(pos, points[i].y());
+	}
+	m_buffer.resize(base + int(pos - out));
+}
+
+static int quantize(int value, int quantum)
+{
+	int half = quantum / 2;
+	return (value >= 0 ? (value + half) / quantum : -((-value + half) / quantum)) * quantum;
+}
+
+// "M x y" then one relative lineto whose pairs repeat implicitly; zero-length
+// steps are dropped and collinear steps in the same direction merged
+void LSvgStreamWriter::appendCompactPath(const QPoints &points)
+{
+	if (points.isEmpty())
+		return;
+
+	QPoint last(quantize(points[0].x(), m_nPathQuantum), quantize(points[0].y(), m_nPathQuantum));
+	m_buffer.append('M');
+	appendNumber(last.x());
+	appendCompactNumber(last.y());
+
+	QPoint pending;
+	bool lineto = false;
+	for (int i = 1; i < points.size(); ++i)
+	{
+		QPoint point(quantize(points[i].x(), m_nPathQuantum), quantize(points[i].y(), m_nPathQuantum));
+		QPoint delta = point - last;
+		last = point;
+		if (delta.isNull())
+			continue;
+
+		if (!pending.isNull())
+		{
+			qint64 cross = qint64(pending.x()) * delta.y() - qint64(pending.y()) * delta.x();
+			qint64 dot = qint64(pending.x()) * delta.x() + qint64(pending.y()) * delta.y();
+			if (cross == 0 && dot > 0)
+			{
+				pending += delta;
+				continue;
+			}
+
+			if (!lineto)
+			{
+				m_buffer.append('l');
+				lineto = true;
+			}
+			appendCompactNumber(pending.x());
+			appendCompactNumber(pending.y());
+		}
+		pending = delta;
+	}
+
+	if (!pending.isNull())
+	{
+		if (!lineto)
+			m_buffer.append('l');
+		appendCompactNumber(pending.x());
+		appendCompactNumber(pending.y());
+	}
+}
+
+// a separator is only needed where two numbers would otherwise run together
+void LSvgStreamWriter::appendCompactNumber(int value)
+{
+	char last = m_buffer.isEmpty() ? 0 : m_buffer.at(m_buffer.size() - 1);
+	if (value >= 0 && last >= '0' && last <= '9')
+		m_buffer.append(' ');
+	appendNumber(value);
+}
+
+void LSvgStreamWriter::appendIndent()
+{
+	if (m_bMinified)
+		return;
+
+	m_buffer.append('\n');
+	for (int i = 0; i < m_elements.size(); ++i)
+		m_buffer.append("    ", 4);
+}
+
+void LSvgStreamWriter::closeStartTag()
+{
+	if (m_bStartTagOpen)
+	{
+		m_buffer.append('>');
+		m_bStartTagOpen = false;
+	}
+}
+
+void LSvgStreamWriter::flushBlock()
+{
+	if (m_buffer.isEmpty())
+		return;
+
+	if (!m_bError && m_device->write(m_buffer) != m_buffer.size())
+		m_bError = true;
+	m_nWritten += m_buffer.size();
+	m_buffer.truncate(0);
+}
+
+LCanvasWriter::LCanvasWriter()
+	: m_progress(nullptr)
+	, m_bMinified(false)
+	, m_nPathQuantum(1)
+{
+
+}
+
+void LCanvasWriter::setProgress(LCanvasProgress *progress)
+{
+	m_progress = progress;
+}
+
+void LCanvasWriter::setMinified(bool minified)
+{
+	m_bMinified = minified;
+}
+
+void LCanvasWriter::setPathQuantum(int quantum)
+{
+	m_nPathQuantum = qMax(0, quantum);
+}
+
+bool LCanvasWriter::write(const QString &filePath, const LCanvasItemList &items, const QSize &canvasSize)
+{
+	LCANVAS_TRACE_ARG("save", "write", items.size());
+
+	if (filePath.isEmpty())
+		return false;
+
+	// blocks of the previous save are only trusted while the file is the one the index
+	// describes; compressed files have no addressable blocks
+	bool compressed = LGzipDeflateDevice::isGzipSuffix(filePath);
+	QVector<LSaveBlock> previous = compressed ? QVector<LSaveBlock>() : readIndex(filePath);
+	QFile previousFile(filePath);
+	const char *previousData = nullptr;
+	if (!previous.isEmpty() && previousFile.open(QFile::ReadOnly))
+		previousData = reinterpret_cast<const char *>(previousFile.map(0, previousFile.size()));
+
+	QHash<quint64, int> previousIndices;
+	if (!previousData)
+		previous.clear();
+
+	// LSvgStreamWriter does its own block buffering
+	QSaveFile file(filePath);
+	if (!file.open(QFile::WriteOnly | QFile::Unbuffered))
+		return false;
+
+	LGzipDeflateDevice deflater(&file);
+	if (compressed && !deflater.open(QIODevice::WriteOnly))
+		return false;
+
+	if (m_progress)
+		m_progress->setTotal(items.size());
+
+	LSvgStreamWriter writer(compressed ? static_cast<QIODevice *>(&deflater) : &file);
+	writer.setMinified(m_bMinified);
+	writer.setPathQuantum(m_nPathQuantum);
+	writeStartDocument(writer, canvasSize);
+	writeSymbols(writer, items);
+
+	QVector<LSaveBlock> blocks;
+	blocks.reserve(items.size());
+
+	// consecutive reused blocks that were adjacent in the old file go out as one copy
+	qint64 runBegin = 0;
+	qint64 runEnd = 0;
+	for (int i = 0; i < items.size(); ++i)
+	{
+		LSaveBlock block;
+		block.hash = items[i]->contentHash();
+
+		const LSaveBlock *reused = nullptr;
+		if (!previous.isEmpty())
+		{
+			if (i < previous.size() && previous[i].hash == block.hash)
+			{
+				reused = &previous[i];
+			}
+			else
+			{
+				if (previousIndices.isEmpty())
+				{
+					previousIndices.reserve(previous.size());
+					for (int j = previous.size() - 1; j >= 0; --j)
+						previousIndices.insert(previous[j].hash, j);
+				}
+
+				auto it = previousIndices.constFind(block.hash);
+				if (it != previousIndices.constEnd())
+					reused = &previous[it.value()];
+			}
+		}
+
+		if (reused)
+		{
+			if (reused->offset != runEnd)
+			{
+				writer.writeRaw(previousData + runBegin, runEnd - runBegin);
+				runBegin = runEnd = reused->offset;
+			}
+
+			block.offset = writer.beginBlock() + (runEnd - runBegin);
+			block.size = reused->size;
+			runEnd += reused->size;
+		}
+		else
+		{
+			writer.writeRaw(previousData + runBegin, runEnd - runBegin);
+			runBegin = runEnd = 0;
+
+			block.offset = writer.beginBlock();
+			items[i]->writeItemToXml(writer);
+			block.size = writer.position() - block.offset;
+		}
+		blocks << block;
+
+		if (m_progress && (i & 0xff) == 0xff)
+		{
+			if (m_progress->isCanceled() || writer.hasError())
+			{
+				file.cancelWriting();
+				return false;
+			}
+			m_progress->advance(0x100);
+		}
+	}
+	writer.writeRaw(previousData + runBegin, runEnd - runBegin);
+
+	writer.writeEndDocument();
+	if (compressed)
+		deflater.close();
+
+	if (previousData)
+		previousFile.unmap(reinterpret_cast<uchar *>(const_cast<char *>(previousData)));
+	previousFile.close();
+
+	if (writer.hasError() || deflater.hasError() || (m_progress && m_progress->isCanceled()))
+	{
+		file.cancelWriting();
+		return false;
+	}
+
+	{
+		LCANVAS_TRACE("save", "commit");
+		if (!file.commit())
+			return false;
+	}
+
+	if (!compressed)
+		writeIndex(filePath, blocks);
+	return true;
+}
+
+// the selection as a standalone svg document, as put on the clipboard
+QByteArray LCanvasWriter::toByteArray(const LCanvasItemList &items, const QSize &canvasSize)
+{
+	LCANVAS_TRACE_ARG("save", "toByteArray", items.size());
+
+	QByteArray data;
+	QBuffer buffer(&data);
+	buffer.open(QIODevice::WriteOnly);
+
+	LSvgStreamWriter writer(&buffer);
+	writer.setMinified(m_bMinified);
+	writer.setPathQuantum(m_nPathQuantum);
+	writeStartDocument(writer, canvasSize);
+	writeSymbols(writer, items);
+	foreach (auto &item, items)
+		item->writeItemToXml(writer);
+	writer.writeEndDocument();
+
+	return data;
+}
+
+void LCanvasWriter::writeStartDocument(LSvgStreamWriter &writer, const QSize &canvasSize) const
+{
+	writer.writeStartDocument();
+	writer.writeStartElement("svg");
+	writer.writeAttribute(SvgAttr::Subset, "lwscode");
+	writer.writeAttribute(SvgAttr::Width, canvasSize.width());
+	writer.writeAttribute(SvgAttr::Height, canvasSize.height());
+	writer.writeAttribute(SvgAttr::Xmlns, "http://www.w3.org/2000/svg");
+}
+
+// every symbol an instance refers to, once and ahead of the items, which
+// is where the reader looks for them
+void LCanvasWriter::writeSymbols(LSvgStreamWriter &writer, const LCanvasItemList &items) const
+{
+	QList<SPtrLCanvasSymbol> symbols = LCanvasSymbol::collect(items);
+	if (symbols.isEmpty())
+		return;
+
+	writer.writeStartElement("defs");
+	foreach (auto &symbol, symbols)
+	{
+		writer.writeStartElement("symbol");
+		writer.writeAttribute(SvgAttr::Id, symbol->id());
+		foreach (auto &child, symbol->master()->children())
+			child->writeItemToXml(writer);
+		writer.writeEndElement();
+	}
+	writer.writeEndElement();
+}
+
+QVector<LSaveBlock> LCanvasWriter::readIndex(const QString &filePath) const
+{
+	LCANVAS_TRACE("save", "readIndex");
+
+	QFile file(indexPath(filePath));
+	if (!file.open(QFile::ReadOnly))
+		return QVector<LSaveBlock>();
+
+	LIndexHeader header;
+	if (file.read(reinterpret_cast<char *>(&header), sizeof(header)) != qint64(sizeof(header)) ||
+		memcmp(header.magic, IndexMagic, sizeof(IndexMagic)) != 0 || header.version != IndexVersion ||
+		header.minified != quint32(m_bMinified) || header.pathQuantum != quint32(m_nPathQuantum))
+	{
+		return QVector<LSaveBlock>();
+	}
+
+	QFileInfo info(filePath);
+	if (!info.exists() || info.size() != header.fileSize ||
+		info.lastModified().toMSecsSinceEpoch() != header.lastModified)
+	{
+		return QVector<LSaveBlock>();
+	}
+
+	// the block count comes from disk, it has to account for the rest of the
+	// file exactly before anything is allocated for it
+	qint64 size = qint64(header.blockCount) * qint64(sizeof(LSaveBlock));
+	if (size != file.size() - qint64(sizeof(header)) || header.blockCount > quint32(std::numeric_limits<int>::max()))
+		return QVector<LSaveBlock>();
+
+	QVector<LSaveBlock> blocks(int(header.blockCount));
+	if (file.read(reinterpret_cast<char *>(blocks.data()), size) != size)
+		return QVector<LSaveBlock>();
+
+	foreach (auto &block, blocks)
+	{
+		if (block.offset < 0 || block.size < 0 || block.offset + block.size > header.fileSize)
+			return QVector<LSaveBlock>();
+	}
+
+	return blocks;
+}
+
+void LCanvasWriter::writeIndex(const QString &filePath, const QVector<LSaveBlock> &blocks) const
+{
+	LCANVAS_TRACE("save", "writeIndex");
+
+	QFileInfo info(filePath);
+
+	LIndexHeader header;
+	memcpy(header.magic, IndexMagic, sizeof(IndexMagic));
+	header.version = IndexVersion;
+	header.fileSize = info.size();
+	header.lastModified = info.lastModified().toMSecsSinceEpoch();
+	header.minified = quint32(m_bMinified);
+	header.pathQuantum = quint32(m_nPathQuantum);
+	header.reserved = 0;
+	header.blockCount = quint32(blocks.size());
+
+	// a stale or missing index only costs the next save its reuse
+	QSaveFile file(indexPath(filePath));
+	if (!file.open(QFile::WriteOnly))
+		return;
+
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char *>(blocks.constData()), qint64(blocks.size()) * sizeof(LSaveBlock));
+	file.commit();
+}
+
+QString LCanvasWriter::indexPath(const QString &filePath)
+{
+	QFileInfo info(filePath);
+	return info.dir().filePath(QString::fromUtf8(".") + info.fileName() + QString::fromUtf8(".lwsi"));
+}
+
+} // namespace
@@ -1,10 +1,156 @@
 #include "mainwindow.h"
+#include "lcanvasbinary.h"
+#include "lcanvasgenerator.h"
+#include "lcanvastrace.h"
+#include "lcanvasrecorder.h"
 
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
+	// replays run headless unless a platform was asked for
+	for (int i = 1; i < argc; ++i)
+	{
+		if (qstrcmp(argv[i], "--replay") == 0 && qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+			qputenv("QT_QPA_PLATFORM", "offscreen");
+	}
+
 	QApplication a(argc, argv);
+
+	QCommandLineParser parser;
+	parser.addHelpOption();
+	QCommandLineOption convertOption(QStringList() << QString::fromUtf8("convert"),
+									 QApplication::translate("main", "Convert a document between svg, svgz and lwsb, then exit."));
+	QCommandLineOption minifyOption(QStringList() << QString::fromUtf8("minify"),
+									QApplication::translate("main", "Write svg output of --convert without indentation."));
+	QCommandLineOption quantizeOption(QStringList() << QString::fromUtf8("quantize"),
+									  QApplication::translate("main", "Snap svg path data of --convert to multiples of <step>, 0 keeps absolute paths."),
+									  QString::fromUtf8("step"), QString::fromUtf8("1"));
+	QCommandLineOption generateOption(QStringList() << QString::fromUtf8("generate"),
+									  QApplication::translate("main", "Write a synthetic document of <count> items to the target file, then exit."),
+									  QString::fromUtf8("count"));
+	QCommandLineOption seedOption(QStringList() << QString::fromUtf8("seed"),
+								  QApplication::translate("main", "Random seed of --generate."),
+								  QString::fromUtf8("seed"), QString::fromUtf8("1"));
+	QCommandLineOption mixOption(QStringList() << QString::fromUtf8("mix"),
+								 QApplication::translate("main", "Item type weights of --generate, e.g. rect=3,path=1,text."),
+								 QString::fromUtf8("weights"));
+	QCommandLineOption distributionOption(QStringList() << QString::fromUtf8("distribution"),
+										  QApplication::translate("main", "Item placement of --generate: uniform, clustered or grid."),
+										  QString::fromUtf8("kind"), QString::fromUtf8("uniform"));
+	QCommandLineOption overlapOption(QStringList() << QString::fromUtf8("overlap"),
+									 QApplication::translate("main", "Mean number of items over any point for --generate."),
+									 QString::fromUtf8("density"), QString::fromUtf8("1"));
+	QCommandLineOption pathPointsOption(QStringList() << QString::fromUtf8("path-points"),
+										QApplication::translate("main", "Path lengths of --generate as <min>:<max> points."),
+										QString::fromUtf8("range"), QString::fromUtf8("2:16"));
+	QCommandLineOption stylesOption(QStringList() << QString::fromUtf8("styles"),
+									QApplication::translate("main", "Number of distinct styles for --generate, 0 gives each item its own."),
+									QString::fromUtf8("count"), QString::fromUtf8("0"));
+	QCommandLineOption groupOption(QStringList() << QString::fromUtf8("group"),
+								   QApplication::translate("main", "Wrap every <size> consecutive items of --generate in a group."),
+								   QString::fromUtf8("size"), QString::fromUtf8("0"));
+	QCommandLineOption symbolsOption(QStringList() << QString::fromUtf8("symbols"),
+									 QApplication::translate("main", "Make every item or group of --generate an instance of one of the first <count>."),
+									 QString::fromUtf8("count"), QString::fromUtf8("0"));
+	QCommandLineOption traceOption(QStringList() << QString::fromUtf8("trace"),
+								   QApplication::translate("main", "Record trace events from startup and write them to <file> on exit."),
+								   QString::fromUtf8("file"));
+	QCommandLineOption replayOption(QStringList() << QString::fromUtf8("replay"),
+									QApplication::translate("main", "Replay a recorded input session, optionally against another document, then exit."),
+									QString::fromUtf8("session"));
+	QCommandLineOption reportOption(QStringList() << QString::fromUtf8("report"),
+									QApplication::translate("main", "Write the per-event times of --replay to <file> instead of stdout."),
+									QString::fromUtf8("file"));
+	parser.addOption(convertOption);
+	parser.addOption(minifyOption);
+	parser.addOption(quantizeOption);
+	parser.addOption(generateOption);
+	parser.addOption(seedOption);
+	parser.addOption(mixOption);
+	parser.addOption(distributionOption);
+	parser.addOption(overlapOption);
+	parser.addOption(pathPointsOption);
+	parser.addOption(stylesOption);
+	parser.addOption(groupOption);
+	parser.addOption(symbolsOption);
+	// builds without trace points reject the option instead of ignoring it
+	if (lwscode::LCanvasTrace::isAvailable())
+		parser.addOption(traceOption);
+	parser.addOption(replayOption);
+	parser.addOption(reportOption);
+	parser.addPositionalArgument(QString::fromUtf8("files"), QApplication::translate("main", "Source and target of --convert, the target of --generate, or the document of --replay."));
+	parser.process(a);
+
+	if (parser.isSet(convertOption))
+	{
+		QStringList files = parser.positionalArguments();
+		if (files.size() != 2)
+			parser.showHelp(1);
+
+		return lwscode::LCanvasBinaryFormat::convert(files.at(0), files.at(1), parser.isSet(minifyOption),
+													  parser.value(quantizeOption).toInt()) ? 0 : 1;
+	}
+
+	if (parser.isSet(generateOption))
+	{
+		QStringList files = parser.positionalArguments();
+		if (files.size() != 1)
+			parser.showHelp(1);
+
+		lwscode::LCanvasGenerator generator;
+		generator.setItemCount(parser.value(generateOption).toInt());
+		generator.setSeed(parser.value(seedOption).toUInt());
+		generator.setOverlap(parser.value(overlapOption).toDouble());
+		generator.setStyleCount(parser.value(stylesOption).toInt());
+		generator.setGroupSize(parser.value(groupOption).toInt());
+		generator.setSymbolCount(parser.value(symbolsOption).toInt());
+
+		QStringList range = parser.value(pathPointsOption).split(QLatin1Char(':'));
+		generator.setPathLength(range.first().toInt(), range.last().toInt());
+
+		QString distribution = parser.value(distributionOption);
+		if (distribution == QLatin1String("clustered"))
+			generator.setDistribution(lwscode::GeneratorDistribution::ClusteredDistribution);
+		else if (distribution == QLatin1String("grid"))
+			generator.setDistribution(lwscode::GeneratorDistribution::GridDistribution);
+		else if (distribution != QLatin1String("uniform"))
+			parser.showHelp(1);
+
+		if (parser.isSet(mixOption) && !generator.setTypeMix(parser.value(mixOption)))
+			parser.showHelp(1);
+
+		return generator.write(files.first()) ? 0 : 1;
+	}
+
+	if (parser.isSet(replayOption))
+	{
+		QStringList files = parser.positionalArguments();
+		if (files.size() > 1)
+			parser.showHelp(1);
+
+		QFile reportFile;
+		if (parser.isSet(reportOption))
+		{
+			reportFile.setFileName(parser.value(reportOption));
+			if (!reportFile.open(QFile::WriteOnly | QFile::Truncate | QFile::Text))
+				return 1;
+		}
+		else
+		{
+			reportFile.open(stdout, QFile::WriteOnly | QFile::Text);
+		}
+
+		QTextStream report(&reportFile);
+		return lwscode::LCanvasRecorder::replay(parser.value(replayOption), files.value(0), report) ? 0 : 1;
+	}
+
+	QString tracePath;
+	if (lwscode::LCanvasTrace::isAvailable())
+		tracePath = parser.value(traceOption);
+	if (!tracePath.isEmpty())
+		lwscode::LCanvasTrace::start();
+
 	MainWindow w;
 	if (QApplication::primaryScreen()->size().width() > w.width() &&
 		QApplication::primaryScreen()->size().height() > w.height())
@@ -18,5 +164,9 @@ int main(int argc, char *argv[])
 
 	QObject::connect(qApp, SIGNAL(lastWindowClosed()), qApp, SLOT(quit()));
 
-	return a.exec();
+	int result = a.exec();
+	if (!tracePath.isEmpty() && lwscode::LCanvasTrace::isRecording())
+		lwscode::LCanvasTrace::write(tracePath);
+
+	return result;
 }
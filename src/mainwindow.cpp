@@ -1,4 +1,5 @@
 #include "mainwindow.h"
+#include "lcanvastrace.h"
 
 MainWindow::MainWindow(QWidget *parent)
 	: QMainWindow(parent)
@@ -8,6 +9,10 @@ MainWindow::MainWindow(QWidget *parent)
 	, m_centralWidget(nullptr)
 	, m_canvas(nullptr)
 	, m_canvasColorButton(nullptr)
+	, m_fileTaskLabel(nullptr)
+	, m_fileTaskProgressBar(nullptr)
+	, m_fileTaskCancelButton(nullptr)
+	, m_memoryPanel(nullptr)
 	, m_canvasWidth(500)
 	, m_canvasHeight(500)
 {
@@ -22,6 +27,9 @@ MainWindow::MainWindow(QWidget *parent)
 	file.close();
 
 	initUI();
+
+	if (m_canvas->recoverFromJournal())
+		this->statusBar()->showMessage(tr("Recovered unsaved changes"), 5000);
 }
 
 void MainWindow::initUI()
@@ -31,6 +39,7 @@ void MainWindow::initUI()
 	initLeftToolBar();
 	initRightToolBar();
 	initBottomToolBar();
+	initStatusBar();
 }
 
 void MainWindow::initCanvas()
@@ -45,6 +54,10 @@ void MainWindow::initCanvas()
 	connect(this, SIGNAL(changeItemType(ItemType)), m_canvas, SLOT(setItemType(ItemType)));
 	connect(this, SIGNAL(sigReadItemsFromFile(QString)), m_canvas, SLOT(readItemsFromFile(QString)));
 	connect(this, SIGNAL(sigWriteItemsToFile(QString)), m_canvas, SLOT(writeItemsToFile(QString)));
+	connect(m_canvas, SIGNAL(fileTaskStarted(QString)), this, SLOT(onFileTaskStarted(QString)));
+	connect(m_canvas, SIGNAL(fileTaskProgress(int)), this, SLOT(onFileTaskProgress(int)));
+	connect(m_canvas, SIGNAL(fileTaskFinished(bool)), this, SLOT(onFileTaskFinished(bool)));
+	connect(m_canvas, SIGNAL(geometryShared(QString)), this, SLOT(onGeometryShared(QString)));
 }
 
 void MainWindow::initMenuBar()
@@ -124,11 +137,23 @@ void MainWindow::initMenuBar()
 
 	QAction *moveBottomObjectAction = new QAction(tr("Move Bottom"), objectMenu);
 
+	QAction *groupObjectAction = new QAction(tr("Group"), objectMenu);
+	groupObjectAction->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_G));
+
+	QAction *ungroupObjectAction = new QAction(tr("Ungroup"), objectMenu);
+	ungroupObjectAction->setShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_G));
+
+	QAction *symbolObjectAction = new QAction(tr("Make Symbol"), objectMenu);
+
 	m_mainMenuBar->addAction(objectMenu->menuAction());
 	objectMenu->addAction(moveTopObjectAction);
 	objectMenu->addAction(moveUpObjectAction);
 	objectMenu->addAction(moveDownObjectAction);
 	objectMenu->addAction(moveBottomObjectAction);
+	objectMenu->addSeparator();
+	objectMenu->addAction(groupObjectAction);
+	objectMenu->addAction(ungroupObjectAction);
+	objectMenu->addAction(symbolObjectAction);
 
 	// view menu
 	QMenu *viewMenu = new QMenu(tr("View"), m_mainMenuBar);
@@ -136,8 +161,37 @@ void MainWindow::initMenuBar()
 	QAction *showRulesViewAction = new QAction(tr("Show Rules"), viewMenu);
 	showRulesViewAction->setCheckable(true);
 
+	QAction *showStatsViewAction = new QAction(tr("Show Statistics"), viewMenu);
+	showStatsViewAction->setCheckable(true);
+	showStatsViewAction->setShortcut(QKeySequence(Qt::Key_F12));
+
 	m_mainMenuBar->addAction(viewMenu->menuAction());
 	viewMenu->addAction(showRulesViewAction);
+	viewMenu->addAction(showStatsViewAction);
+
+	QAction *recordInputViewAction = new QAction(tr("Record Input"), viewMenu);
+	recordInputViewAction->setCheckable(true);
+	viewMenu->addAction(recordInputViewAction);
+	connect(recordInputViewAction, SIGNAL(toggled(bool)), this, SLOT(onRecordInput(bool)));
+
+	QAction *shareGeometryViewAction = new QAction(tr("Share Identical Shapes on Load"), viewMenu);
+	shareGeometryViewAction->setCheckable(true);
+	viewMenu->addAction(shareGeometryViewAction);
+	connect(shareGeometryViewAction, SIGNAL(toggled(bool)), m_canvas, SLOT(setShareGeometry(bool)));
+
+	QAction *memoryUsageViewAction = new QAction(tr("Memory Usage"), viewMenu);
+	viewMenu->addAction(memoryUsageViewAction);
+	connect(memoryUsageViewAction, SIGNAL(triggered()), this, SLOT(onShowMemoryUsage()));
+
+	// only builds with trace points have anything to record
+	if (LCanvasTrace::isAvailable())
+	{
+		QAction *recordTraceViewAction = new QAction(tr("Record Trace"), viewMenu);
+		recordTraceViewAction->setCheckable(true);
+		recordTraceViewAction->setChecked(LCanvasTrace::isRecording());
+		viewMenu->addAction(recordTraceViewAction);
+		connect(recordTraceViewAction, SIGNAL(toggled(bool)), this, SLOT(onRecordTrace(bool)));
+	}
 
 	// init connect
 	connect(newFileAction, SIGNAL(triggered()), this, SLOT(onNewFile()));
@@ -148,6 +202,12 @@ void MainWindow::initMenuBar()
 	connect(copyEditAction, SIGNAL(triggered()), m_canvas, SLOT(copyItem()));
 	connect(pasteEditAction, SIGNAL(triggered()), m_canvas, SLOT(pasteItem()));
 	connect(deleteEditAction, SIGNAL(triggered()), m_canvas, SLOT(deleteItem()));
+
+	connect(groupObjectAction, SIGNAL(triggered()), m_canvas, SLOT(groupItems()));
+	connect(ungroupObjectAction, SIGNAL(triggered()), m_canvas, SLOT(ungroupItems()));
+	connect(symbolObjectAction, SIGNAL(triggered()), m_canvas, SLOT(makeSymbol()));
+
+	connect(showStatsViewAction, SIGNAL(toggled(bool)), m_canvas, SLOT(setStatsVisible(bool)));
 }
 
 void MainWindow::initLeftToolBar()
@@ -325,6 +385,27 @@ void MainWindow::initBottomToolBar()
 	connect(clearCanvasButton, SIGNAL(clicked()), this, SLOT(onNewFile()));
 }
 
+void MainWindow::initStatusBar()
+{
+	m_fileTaskLabel = new QLabel(this);
+
+	m_fileTaskProgressBar = new QProgressBar(this);
+	m_fileTaskProgressBar->setRange(0, 100);
+	m_fileTaskProgressBar->setFixedWidth(200);
+
+	m_fileTaskCancelButton = new QToolButton(this);
+	m_fileTaskCancelButton->setText(tr("Cancel"));
+
+	this->statusBar()->addPermanentWidget(m_fileTaskLabel);
+	this->statusBar()->addPermanentWidget(m_fileTaskProgressBar);
+	this->statusBar()->addPermanentWidget(m_fileTaskCancelButton);
+	m_fileTaskLabel->hide();
+	m_fileTaskProgressBar->hide();
+	m_fileTaskCancelButton->hide();
+
+	connect(m_fileTaskCancelButton, SIGNAL(clicked()), m_canvas, SLOT(cancelFileTask()));
+}
+
 void MainWindow::onPaintNone()
 {
 	emit changeItemType(ItemType::NoneType);
@@ -385,8 +466,11 @@ void MainWindow::onNewFile()
 
 void MainWindow::onOpenFile()
 {
+	if (m_canvas->isFileTaskRunning())
+		return;
+
 	QString filePath = QFileDialog::getOpenFileName(
-				this, tr("Open File"), QString(), tr("SVG FILES(*.svg)"));
+				this, tr("Open File"), QString(), tr("SVG FILES(*.svg *.svgz);;BINARY FILES(*.lwsb)"));
 
 	if (!filePath.isEmpty())
 		emit sigReadItemsFromFile(filePath);
@@ -394,13 +478,74 @@ void MainWindow::onOpenFile()
 
 void MainWindow::onSaveFile()
 {
+	if (m_canvas->isFileTaskRunning())
+		return;
+
 	QString filePath = QFileDialog::getSaveFileName(
-				this, tr("Save File"), QString(), tr("SVG FILES(*.svg)"));
+				this, tr("Save File"), QString(), tr("SVG FILES(*.svg);;COMPRESSED SVG FILES(*.svgz);;BINARY FILES(*.lwsb)"));
 
 	if (!filePath.isEmpty())
 		emit sigWriteItemsToFile(filePath);
 }
 
+void MainWindow::onRecordTrace(bool checked)
+{
+	if (checked)
+	{
+		LCanvasTrace::start();
+		return;
+	}
+
+	LCanvasTrace::stop();
+	QString filePath = QFileDialog::getSaveFileName(
+				this, tr("Save Trace"), QString(), tr("TRACE FILES(*.json)"));
+
+	if (!filePath.isEmpty() && !LCanvasTrace::write(filePath))
+		this->statusBar()->showMessage(tr("The trace could not be written"), 3000);
+}
+
+void MainWindow::onRecordInput(bool checked)
+{
+	if (!checked)
+	{
+		m_canvas->stopRecording();
+		return;
+	}
+
+	QString filePath = QFileDialog::getSaveFileName(
+				this, tr("Record Input"), QString(), tr("SESSION FILES(*.lwsr)"));
+
+	if (filePath.isEmpty() || !m_canvas->startRecording(filePath))
+	{
+		QAction *action = qobject_cast<QAction *>(sender());
+		if (action)
+			action->setChecked(false);
+
+		if (!filePath.isEmpty())
+			this->statusBar()->showMessage(tr("The session file could not be created"), 3000);
+	}
+}
+
+void MainWindow::onShowMemoryUsage()
+{
+	if (!m_memoryPanel)
+	{
+		m_memoryPanel = new LCanvasMemoryPanel(this);
+		connect(m_memoryPanel, SIGNAL(refreshRequested()), this, SLOT(updateMemoryUsage()));
+	}
+
+	updateMemoryUsage();
+	m_memoryPanel->show();
+	m_memoryPanel->raise();
+	m_memoryPanel->activateWindow();
+}
+
+void MainWindow::updateMemoryUsage()
+{
+	if (m_memoryPanel)
+		m_memoryPanel->setReport(m_canvas->memoryReport());
+}
+
 void MainWindow::setCanvasColor()
 {
 	QColor color = QColorDialog::getColor();
@@ -416,13 +561,13 @@ void MainWindow::setCanvasColor()
 void MainWindow::setCanvasWidth(int width)
 {
 	m_canvasHeight = m_canvas->height();
-	m_canvas->resize(QSize(width, m_canvasHeight));
+	m_canvas->setCanvasSize(QSize(width, m_canvasHeight));
 }
 
 void MainWindow::setCanvasHeight(int height)
 {
 	m_canvasWidth = m_canvas->width();
-	m_canvas->resize(QSize(m_canvasWidth, height));
+	m_canvas->setCanvasSize(QSize(m_canvasWidth, height));
 }
 
 void MainWindow::setFillColor()
@@ -443,3 +588,32 @@ void MainWindow::setStrokeWidth(int width)
 {
 	m_canvas->setStrokeWidth(width);
 }
+
+void MainWindow::onFileTaskStarted(const QString &filePath)
+{
+	m_fileTaskLabel->setText(QFileInfo(filePath).fileName());
+	m_fileTaskProgressBar->setValue(0);
+	m_fileTaskLabel->show();
+	m_fileTaskProgressBar->show();
+	m_fileTaskCancelButton->show();
+}
+
+void MainWindow::onFileTaskProgress(int value)
+{
+	m_fileTaskProgressBar->setValue(value);
+}
+
+void MainWindow::onFileTaskFinished(bool success)
+{
+	m_fileTaskLabel->hide();
+	m_fileTaskProgressBar->hide();
+	m_fileTaskCancelButton->hide();
+
+	if (!success)
+		this->statusBar()->showMessage(tr("The file operation was canceled or failed"), 3000);
+}
+
+void MainWindow::onGeometryShared(const QString &summary)
+{
+	this->statusBar()->showMessage(tr("Shared geometry: %1").arg(summary), 8000);
+}